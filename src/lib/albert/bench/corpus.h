@@ -0,0 +1,272 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+#include <QString>
+#include <QStringList>
+#include <malloc.h>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+#include "indexable.h"
+
+// Synthetic corpora shaped like the items of the plugins, shared by the benchmarks
+
+namespace Bench {
+
+using Core::Indexable;
+using std::shared_ptr;
+using std::vector;
+
+// Queries of each type generated per corpus
+const size_t QUERY_COUNT = 1024;
+
+/** ***************************************************************************/
+inline size_t heapBytes() {
+    // glibc, the bytes in use by the allocator including mapped chunks. The
+    // int fields of mallinfo overflow at 2 GiB, glibc 2.33 has mallinfo2.
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+#else
+    struct mallinfo info = mallinfo();
+#endif
+    return static_cast<size_t>(info.uordblks) + static_cast<size_t>(info.hblkhd);
+}
+
+/** ***************************************************************************/
+class Item final : public Indexable
+{
+public:
+    vector<WeightedKeyword> indexKeywords() const override { return keywords; }
+    vector<WeightedKeyword> keywords;
+};
+
+/** ***************************************************************************/
+struct Corpus {
+
+    enum Kind { Applications, Files, Bookmarks };
+
+    Corpus(Kind kind, size_t size) : kind(kind), size(size), generator(static_cast<std::mt19937::result_type>(2 * size + kind)) {
+
+        // The vocabulary grows sublinearly with the corpus (Heaps' law)
+        const char *syllables[] = {"ka", "lo", "re", "tor", "in", "da", "mi", "fox", "zen", "ber", "ul",
+                                   "sa", "po", "ter", "ni", "ck", "ar", "el", "on", "is", "ve", "gra"};
+        std::uniform_int_distribution<int> syllable(0, sizeof(syllables) / sizeof(*syllables) - 1);
+        std::uniform_int_distribution<int> syllableCount(1, 4);
+        const size_t vocabularySize = 500 + static_cast<size_t>(30 * std::pow(static_cast<double>(size), 0.6));
+        for (size_t i = 0; i < vocabularySize; ++i) {
+            QString word;
+            for (int j = syllableCount(generator); j > 0; --j)
+                word.append(syllables[syllable(generator)]);
+            vocabulary.push_back(word);
+        }
+
+        // The words of every item as the tokenizer splits them, to derive queries
+        vector<QStringList> words;
+        items.reserve(size);
+        words.reserve(size);
+        for (size_t i = 0; i < size; ++i) {
+            shared_ptr<Item> item = std::make_shared<Item>();
+            switch (kind) {
+            case Applications: words.push_back(application(*item)); break;
+            case Bookmarks: words.push_back(bookmark(*item)); break;
+            default: words.push_back(fileName(*item)); break;
+            }
+            items.push_back(item);
+        }
+
+        std::uniform_int_distribution<size_t> anyItem(0, size - 1);
+        auto anyWord = [this](const QStringList &words){
+            return words[std::uniform_int_distribution<int>(0, words.size() - 1)(generator)];
+        };
+        auto prefix = [this](const QString &word, int minLength){
+            const int maxLength = std::max(minLength, std::min(6, word.size()));
+            return word.left(std::uniform_int_distribution<int>(minLength, maxLength)(generator));
+        };
+
+        // Prefixes of words of items, from the first letter typed on
+        while (prefixQueries.size() < QUERY_COUNT)
+            prefixQueries.push_back(prefix(anyWord(words[anyItem(generator)]), 1));
+
+        // Prefixes of words with a random edit behind the first letter
+        std::uniform_int_distribution<int> edit(0, 2);
+        while (fuzzyQueries.size() < QUERY_COUNT) {
+            const size_t source = anyItem(generator);
+            QString word = anyWord(words[source]);
+            if (word.size() < 4)
+                continue;
+            word = prefix(word, 4);
+            int position = std::uniform_int_distribution<int>(1, word.size() - 1)(generator);
+            switch (edit(generator)) {
+            case 0: word[position] = QChar('a' + (word[position].unicode() - 'a' + 1) % 26); break;
+            case 1: word.remove(position, 1); break;
+            default: word.insert(position, QChar('q')); break;
+            }
+            fuzzyQueries.push_back(word);
+            fuzzySources.push_back(items[source].get());
+        }
+
+        // A word and the prefix of another word of the same item
+        while (multiWordQueries.size() < QUERY_COUNT) {
+            const QStringList &itemWords = words[anyItem(generator)];
+            if (itemWords.size() < 2)
+                continue;
+            QString first = anyWord(itemWords), second = anyWord(itemWords);
+            if (first != second)
+                multiWordQueries.push_back(QString("%1 %2").arg(first, prefix(second, 1)));
+        }
+    }
+
+    QString zipfWord() {
+        // Rank r is drawn with probability ~1/r
+        std::uniform_real_distribution<double> uniform(0, 1);
+        size_t rank = static_cast<size_t>(std::pow(static_cast<double>(vocabulary.size()), uniform(generator))) - 1;
+        return vocabulary[std::min(rank, vocabulary.size() - 1)];
+    }
+
+    QString number(int digits) {
+        QString number;
+        std::uniform_int_distribution<int> digit(0, 9);
+        for (int i = 0; i < digits; ++i)
+            number.append(QChar('0' + digit(generator)));
+        return number;
+    }
+
+    static QString capitalized(const QString &word) {
+        return word.left(1).toUpper() + word.mid(1);
+    }
+
+    /*
+     * The names of a home directory: documents named by a few words, camera
+     * and screenshot files named by dates, numbered versions, source files
+     * and dot files. Extensions are drawn by their frequency.
+     */
+    QStringList fileName(Item &item) {
+        static const char *extensions[] = {"jpg", "jpg", "jpg", "jpg", "png", "png", "pdf", "pdf", "txt",
+                                           "mp3", "mp3", "odt", "docx", "html", "json", "md", "xml", "zip"};
+        static const char *sourceExtensions[] = {"cpp", "h", "py", "js", "c", "java"};
+        static const char *separators[] = {"_", "-", " ", "."};
+        std::uniform_int_distribution<int> extension(0, sizeof(extensions) / sizeof(*extensions) - 1);
+        std::uniform_int_distribution<int> sourceExtension(0, sizeof(sourceExtensions) / sizeof(*sourceExtensions) - 1);
+        std::uniform_int_distribution<int> separator(0, sizeof(separators) / sizeof(*separators) - 1);
+        std::uniform_int_distribution<int> wordCount(1, 4);
+
+        QString name;
+        QStringList words;
+        const int pattern = std::uniform_int_distribution<int>(0, 99)(generator);
+        if (pattern < 45) {
+            // Documents
+            const QString joint = separators[separator(generator)];
+            for (int i = wordCount(generator); i > 0; --i)
+                words << zipfWord();
+            name = words.join(joint);
+            words << extensions[extension(generator)];
+            name += "." + words.back();
+        } else if (pattern < 65) {
+            // Photos and screenshots
+            QString date = QString("20%1").arg(number(6)), time = number(6);
+            if (pattern < 58) {
+                words << "img" << date << time << "jpg";
+                name = QString("IMG_%1_%2.jpg").arg(date, time);
+            } else {
+                words << "screenshot" << date << time << "png";
+                name = QString("Screenshot_%1-%2.png").arg(date, time);
+            }
+        } else if (pattern < 80) {
+            // Numbered versions
+            QString version = number(std::uniform_int_distribution<int>(1, 2)(generator));
+            words << zipfWord() << zipfWord() << QString("v%1").arg(version) << extensions[extension(generator)];
+            name = QString("%1_%2_v%3.%4").arg(words[0], words[1], version, words[3]);
+        } else if (pattern < 95) {
+            // Sources, camel case identifiers are a single token
+            QString identifier = zipfWord();
+            for (int i = wordCount(generator) - 1; i > 0; --i)
+                identifier += capitalized(zipfWord());
+            words << identifier.toLower() << sourceExtensions[sourceExtension(generator)];
+            name = identifier + "." + words.back();
+        } else {
+            // Dot files
+            words << zipfWord() + "rc";
+            name = "." + words.back();
+        }
+        item.keywords.emplace_back(name, USHRT_MAX);
+        return words;
+    }
+
+    /*
+     * Desktop entries: a name of one to three capitalized words, often
+     * prefixed by the desktop environment, a generic name and keywords,
+     * weighted like the applications plugin does.
+     */
+    QStringList application(Item &item) {
+        static const char *vendors[] = {"GNOME", "KDE", "Qt", "LibreOffice", "Xfce"};
+        static const char *generic[] = {"Web Browser", "Text Editor", "Image Viewer", "Terminal Emulator",
+                                        "File Manager", "Music Player", "Video Player", "Office Suite",
+                                        "Email Client", "System Monitor", "Archive Manager", "Calculator"};
+        std::uniform_int_distribution<int> vendor(0, sizeof(vendors) / sizeof(*vendors) - 1);
+        std::uniform_int_distribution<int> genericName(0, sizeof(generic) / sizeof(*generic) - 1);
+
+        QStringList names;
+        if (std::uniform_int_distribution<int>(0, 3)(generator) == 0)
+            names << vendors[vendor(generator)];
+        for (int i = std::uniform_int_distribution<int>(1, 2)(generator); i > 0; --i)
+            names << capitalized(zipfWord());
+        item.keywords.emplace_back(names.join(" "), USHRT_MAX);
+
+        QString genericNames = generic[genericName(generator)];
+        item.keywords.emplace_back(genericNames, USHRT_MAX * 0.9);
+
+        QStringList keywords;
+        for (int i = std::uniform_int_distribution<int>(0, 4)(generator); i > 0; --i)
+            keywords << zipfWord();
+        for (const QString &keyword : keywords)
+            item.keywords.emplace_back(keyword, USHRT_MAX * 0.8);
+
+        QStringList words;
+        for (const QString &name : names)
+            words << name.toLower();
+        for (const QString &name : genericNames.split(' '))
+            words << name.toLower();
+        return words + keywords;
+    }
+
+    /*
+     * Bookmark titles: a handful of words, looked up by any of them.
+     */
+    QStringList bookmark(Item &item) {
+        QStringList words;
+        for (int i = std::uniform_int_distribution<int>(3, 8)(generator); i > 0; --i)
+            words << zipfWord();
+        item.keywords.emplace_back(words.join(" "), USHRT_MAX);
+        return words;
+    }
+
+    Kind kind;
+    size_t size;
+    std::mt19937 generator;
+    vector<QString> vocabulary;
+    vector<shared_ptr<Indexable>> items;
+    vector<QString> prefixQueries;
+    vector<QString> fuzzyQueries;
+    vector<const Indexable*> fuzzySources; // The items the fuzzy queries are derived from
+    vector<QString> multiWordQueries;
+};
+
+}
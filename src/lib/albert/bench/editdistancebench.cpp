@@ -0,0 +1,122 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QString>
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "editdistance.h"
+using Core::PrefixEditDistance;
+using Core::Term;
+using std::vector;
+
+namespace {
+
+// Size of the synthetic vocabulary, roughly the candidates of a short word
+const size_t VOCABULARY_SIZE = 4096;
+
+/** ***************************************************************************/
+uint matrixPrefixEditDistance(const QString &prefix, const QString &str, uint delta) {
+    // The full matrix implementation the kernel replaced
+    uint n = prefix.size() + 1;
+    uint m = std::min(prefix.size() + delta + 1, static_cast<uint>(str.size()) + 1);
+
+    uint* matrix = new uint[n*m];
+
+    for (uint i = 0; i < n; ++i) { matrix[i*m+0] = i; }
+    for (uint i = 0; i < m; ++i) { matrix[0*m+i] = i; }
+
+    for (uint i = 1; i < n; ++i) {
+        for (uint j = 1; j < m; ++j) {
+            uint dia = matrix[(i-1)*m+j-1] + (prefix[i-1] == str[j-1] ? 0 : 1);
+            matrix[i*m+j] = std::min(std::min(dia, matrix[i*m+j-1] + 1), matrix[(i-1)*m+j] + 1);
+        }
+    }
+
+    uint result = matrix[(n-1)*m+0];
+    for (uint j = 1; j < m; ++j)
+        result = std::min(result, matrix[(n-1)*m+j]);
+    delete[] matrix;
+    return result;
+}
+
+/** ***************************************************************************/
+QString randomWord(std::mt19937 &generator, int length) {
+    std::uniform_int_distribution<int> letter('a', 'z');
+    QString word;
+    for (int i = 0; i < length; ++i)
+        word.append(QChar(letter(generator)));
+    return word;
+}
+
+/** ***************************************************************************/
+struct Corpus {
+    // A query word of the given length and candidates sharing q-grams with it
+    Corpus(int wordLength) {
+        std::mt19937 generator(42);
+        std::uniform_int_distribution<int> position(0, wordLength - 1);
+        std::uniform_int_distribution<int> suffix(0, 8);
+        word = randomWord(generator, wordLength);
+        for (size_t i = 0; i < VOCABULARY_SIZE; ++i) {
+            QString candidate = word;
+            candidate[position(generator)] = QChar('a' + static_cast<int>(i % 26));
+            candidate.append(randomWord(generator, suffix(generator)));
+            vocabulary.push_back(candidate);
+        }
+        for (const QString &candidate : vocabulary)
+            terms.emplace_back(candidate);
+    }
+    QString word;
+    vector<QString> vocabulary;
+    vector<Term> terms;
+};
+
+}
+
+
+
+/** ***************************************************************************/
+void BM_Matrix(benchmark::State &state) {
+    Corpus corpus(static_cast<int>(state.range(0)));
+    const uint delta = static_cast<uint>(state.range(1));
+    for (auto _ : state)
+        for (const QString &candidate : corpus.vocabulary)
+            benchmark::DoNotOptimize(matrixPrefixEditDistance(corpus.word, candidate, delta));
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * corpus.vocabulary.size()));
+}
+
+
+
+/** ***************************************************************************/
+void BM_Kernel(benchmark::State &state) {
+    Corpus corpus(static_cast<int>(state.range(0)));
+    const uint delta = static_cast<uint>(state.range(1));
+    for (auto _ : state) {
+        PrefixEditDistance prefixEditDistance(Term(corpus.word), delta);
+        for (const Term &candidate : corpus.terms)
+            benchmark::DoNotOptimize(prefixEditDistance(candidate));
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * corpus.terms.size()));
+}
+
+
+
+// Word length and δ. Words longer than 64 code units use the banded kernel.
+BENCHMARK(BM_Matrix)->Args({4, 1})->Args({8, 2})->Args({16, 3})->Args({80, 3});
+BENCHMARK(BM_Kernel)->Args({4, 1})->Args({8, 2})->Args({16, 3})->Args({80, 3});
+
+BENCHMARK_MAIN();
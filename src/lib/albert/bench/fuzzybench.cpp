@@ -0,0 +1,93 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QString>
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <vector>
+#include "corpus.h"
+#include "offlineindex.h"
+using Bench::Corpus;
+using Bench::heapBytes;
+using Core::Indexable;
+using Core::OfflineIndex;
+using std::shared_ptr;
+using std::vector;
+
+namespace {
+
+// Results fetched per query, like the files plugin
+const size_t RESULT_COUNT = 64;
+
+/** ***************************************************************************/
+const Corpus &corpus(Corpus::Kind kind) {
+    // Generated once, shared by the engines. Sizes follow the plugins: a few
+    // hundred applications, thousands of bookmarks and a home directory.
+    static std::unique_ptr<Corpus> corpora[3];
+    static const size_t sizes[3] = {300, 300000, 10000};
+    if (!corpora[kind])
+        corpora[kind].reset(new Corpus(kind, sizes[kind]));
+    return *corpora[kind];
+}
+
+}
+
+
+
+/** ***************************************************************************/
+void BM_FuzzySearch(benchmark::State &state) {
+    const Corpus &c = corpus(static_cast<Corpus::Kind>(state.range(0)));
+    const OfflineIndex::FuzzyEngine engine = static_cast<OfflineIndex::FuzzyEngine>(state.range(1));
+
+    const size_t before = heapBytes();
+    OfflineIndex index(false);
+    index.setFuzzyEngine(engine);
+    index.setFuzzy(true);
+    index.build(c.items);
+    index.commit();
+    const size_t after = heapBytes();
+
+    for (auto _ : state)
+        for (const QString &query : c.fuzzyQueries)
+            benchmark::DoNotOptimize(index.scoredSearch(query, RESULT_COUNT));
+
+    // Recall is the share of typos matching the item they were derived from
+    size_t found = 0;
+    for (size_t i = 0; i < c.fuzzyQueries.size(); ++i) {
+        vector<shared_ptr<Indexable>> results = index.search(c.fuzzyQueries[i]);
+        for (const shared_ptr<Indexable> &result : results)
+            if (result.get() == c.fuzzySources[i]) {
+                ++found;
+                break;
+            }
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * c.fuzzyQueries.size()));
+    state.counters["recall"] = static_cast<double>(found) / c.fuzzyQueries.size();
+    state.counters["memory_MiB"] = (after > before) ? (after - before) / 1048576.0 : 0;
+}
+
+
+
+
+// Corpus (applications, files, bookmarks) and engine (q-gram, SymSpell)
+BENCHMARK(BM_FuzzySearch)
+        ->Args({Corpus::Applications, 0})->Args({Corpus::Applications, 1})
+        ->Args({Corpus::Bookmarks, 0})->Args({Corpus::Bookmarks, 1})
+        ->Args({Corpus::Files, 0})->Args({Corpus::Files, 1})
+        ->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
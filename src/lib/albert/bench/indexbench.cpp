@@ -0,0 +1,189 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QString>
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <tuple>
+#include <vector>
+#include "corpus.h"
+#include "offlineindex.h"
+using Bench::Corpus;
+using Bench::heapBytes;
+using Core::OfflineIndex;
+using std::vector;
+
+/*
+ * Build time, memory and query latency of the offline index on synthetic
+ * corpora. The corpora are generated from fixed seeds, hence runs on
+ * different revisions measure the same data. Write the results as JSON and
+ * compare two runs with the tools of Google Benchmark:
+ *
+ *   albert_index_bench --benchmark_out=before.json --benchmark_out_format=json
+ *   compare.py benchmarks before.json after.json
+ *
+ * Large corpora take a while, select the benchmarks by --benchmark_filter,
+ * e.g. "Query/corpus:1/items:1000$" for the queries on a thousand file names.
+ */
+
+namespace {
+
+// Results fetched per query, like the files plugin
+const size_t RESULT_COUNT = 64;
+
+/** ***************************************************************************/
+const Corpus &corpus(const benchmark::State &state) {
+    // Only the last corpus is kept, the large ones take gigabytes
+    static std::unique_ptr<Corpus> corpus;
+    const Corpus::Kind kind = static_cast<Corpus::Kind>(state.range(0));
+    const size_t size = static_cast<size_t>(state.range(1));
+    if (!corpus || corpus->kind != kind || corpus->size != size) {
+        corpus.reset();
+        corpus.reset(new Corpus(kind, size));
+    }
+    return *corpus;
+}
+
+/** ***************************************************************************/
+const OfflineIndex &index(const benchmark::State &state, bool fuzzy, size_t fuzzyFallback = 0,
+                          bool positions = false) {
+    // Queries of the same corpus share the index, it is built once
+    static std::unique_ptr<OfflineIndex> index;
+    static std::tuple<int64_t,int64_t,bool,bool> key;
+    std::tuple<int64_t,int64_t,bool,bool> current(state.range(0), state.range(1), fuzzy, positions);
+    if (!index || key != current) {
+        index.reset();
+        const Corpus &c = corpus(state);
+        index.reset(new OfflineIndex(fuzzy));
+        index->setPositions(positions);
+        index->build(c.items);
+        index->commit();
+        key = current;
+    }
+    index->setFuzzyFallback(fuzzyFallback);
+    return *index;
+}
+
+/** ***************************************************************************/
+void corpora(benchmark::internal::Benchmark *benchmark) {
+    // Kind and size. Few people have more than ten thousand applications.
+    benchmark->ArgNames({"corpus", "items"});
+    for (int64_t size : {1000, 10000})
+        benchmark->Args({Corpus::Applications, size});
+    for (int64_t size : {1000, 10000, 100000, 1000000, 5000000})
+        benchmark->Args({Corpus::Files, size});
+}
+
+/** ***************************************************************************/
+void query(benchmark::State &state, const OfflineIndex &index, const vector<QString> &queries) {
+    // One query per iteration, cycling through the queries
+    size_t i = 0, matches = 0;
+    for (auto _ : state) {
+        OfflineIndex::Results results = index.matches(queries[i], RESULT_COUNT);
+        matches += results.size();
+        benchmark::DoNotOptimize(results);
+        i = (i + 1) % queries.size();
+    }
+    state.counters["matches"] = benchmark::Counter(static_cast<double>(matches), benchmark::Counter::kAvgIterations);
+}
+
+}
+
+
+
+/** ***************************************************************************/
+void BM_Build(benchmark::State &state, bool fuzzy, bool positions) {
+    const Corpus &c = corpus(state);
+
+    // The memory is the growth of the heap, the stats are the index' own
+    // estimate. Building runs on the thread pool, the wall time counts.
+    std::unique_ptr<OfflineIndex> index;
+    size_t memory = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        index.reset();
+        const size_t before = heapBytes();
+        state.ResumeTiming();
+
+        index.reset(new OfflineIndex(fuzzy));
+        index->setPositions(positions);
+        index->build(c.items);
+        index->commit();
+
+        state.PauseTiming();
+        const size_t after = heapBytes();
+        memory = (after > before) ? after - before : 0;
+        state.ResumeTiming();
+    }
+
+    OfflineIndex::Stats stats = index->stats();
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * c.items.size()));
+    state.counters["memory_MiB"] = memory / 1048576.0;
+    state.counters["stats_MiB"] = stats.bytes() / 1048576.0;
+    state.counters["terms"] = stats.terms;
+    state.counters["postings"] = stats.postings;
+}
+BENCHMARK_CAPTURE(BM_Build, Prefix, false, false)->Apply(corpora)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Build, Fuzzy, true, false)->Apply(corpora)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Build, Positions, false, true)->Apply(corpora)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+
+
+/** ***************************************************************************/
+void BM_PrefixQuery(benchmark::State &state) {
+    query(state, index(state, false), corpus(state).prefixQueries);
+}
+BENCHMARK(BM_PrefixQuery)->Apply(corpora)->Unit(benchmark::kMicrosecond);
+
+
+
+/** ***************************************************************************/
+void BM_FuzzyQuery(benchmark::State &state) {
+    query(state, index(state, true), corpus(state).fuzzyQueries);
+}
+BENCHMARK(BM_FuzzyQuery)->Apply(corpora)->Unit(benchmark::kMicrosecond);
+
+
+
+/** ***************************************************************************/
+void BM_MultiWordQuery(benchmark::State &state) {
+    query(state, index(state, false), corpus(state).multiWordQueries);
+}
+BENCHMARK(BM_MultiWordQuery)->Apply(corpora)->Unit(benchmark::kMicrosecond);
+
+
+
+/** ***************************************************************************/
+void BM_FuzzyFallbackQuery(benchmark::State &state, const vector<QString> Corpus::*queries) {
+    // A fuzzy index searching fuzzy only if the prefix search does not fill the results
+    query(state, index(state, true, RESULT_COUNT), corpus(state).*queries);
+}
+BENCHMARK_CAPTURE(BM_FuzzyFallbackQuery, Prefix, &Corpus::prefixQueries)->Apply(corpora)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_FuzzyFallbackQuery, Fuzzy, &Corpus::fuzzyQueries)->Apply(corpora)->Unit(benchmark::kMicrosecond);
+
+
+
+/** ***************************************************************************/
+void BM_PositionsQuery(benchmark::State &state, const vector<QString> Corpus::*queries) {
+    // A prefix index ranking by the positions of the words in the keywords
+    query(state, index(state, false, 0, true), corpus(state).*queries);
+}
+BENCHMARK_CAPTURE(BM_PositionsQuery, Prefix, &Corpus::prefixQueries)->Apply(corpora)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_PositionsQuery, MultiWord, &Corpus::multiWordQueries)->Apply(corpora)->Unit(benchmark::kMicrosecond);
+
+
+
+BENCHMARK_MAIN();
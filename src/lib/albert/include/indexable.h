@@ -36,10 +36,32 @@ public:
         uint32_t relevance;
     };
 
+    /**
+     * @brief An attribute queries can filter by
+     * A query containing the operator name:operand matches only the items
+     * having a facet of that name whose value matches the operand, by
+     * default if it starts with the operand. The comparison is case
+     * insensitive. Prefix the operator with a minus to exclude the items
+     * instead, e.g. "ext:pdf -in:/tmp report".
+     */
+    struct Facet {
+        enum class Match {
+            Prefix, ///< The value starts with the operand
+            Exact,  ///< The value equals the operand
+            Path    ///< The value equals the operand or is a path below it
+        };
+        Facet(const QString& n, const QString& v, Match m = Match::Prefix) : name(n), value(v), match(m){}
+        QString name;
+        QString value;
+        Match match; ///< The same for all facets of a name
+    };
+
     virtual ~Indexable() {}
 
     virtual std::vector<WeightedKeyword> indexKeywords() const = 0;
 
+    virtual std::vector<Facet> indexFacets() const { return std::vector<Facet>(); }
+
 };
 
 }
@@ -0,0 +1,131 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QObject>
+#include <QString>
+#include <vector>
+#include <memory>
+#include "core_globals.h"
+#include "offlineindex.h"
+#include "queryhandler.h"
+
+namespace Core {
+
+class Indexable;
+class IndexServicePrivate;
+
+/**
+ * @brief The IndexService class
+ *
+ * Offline indexes owned by the core and shared by all extensions. Extensions
+ * register their items under a namespace, usually their id, instead of
+ * maintaining an index of their own. The namespaces asking for the same
+ * options share an index, their common keywords are stored once. A query is
+ * answered by a search of every index, whose matches are ranked together.
+ *
+ * The options of a namespace apply to its items only, e.g. the items of a
+ * namespace not asking for a fuzzy search never match fuzzily. The items have
+ * to be Items as well, e.g. StandardIndexItems.
+ */
+class EXPORT_CORE IndexService final : public QObject, public QueryHandler
+{
+public:
+
+    IndexService();
+    ~IndexService();
+
+    /**
+     * @brief Replace the items of a namespace
+     * The changes are committed, searches use the new items immediately.
+     * @param ns The namespace of the items
+     * @param items The items to index
+     */
+    void setItems(const QString &ns, std::vector<std::shared_ptr<Indexable>> items);
+
+    /**
+     * @brief Remove a namespace and its items
+     * Has to be called before the code of the items is unloaded. Queries
+     * running meanwhile may still hold the items, they have to finish
+     * before the code is unloaded too.
+     * @param ns The namespace to remove
+     */
+    void removeNamespace(const QString &ns);
+
+    /**
+     * @brief The number of items of a namespace
+     */
+    size_t size(const QString &ns) const;
+
+    /**
+     * @brief Sets a namespace to be searched fuzzy
+     * @see OfflineIndex::setFuzzy
+     */
+    void setFuzzy(const QString &ns, bool fuzzy = true);
+
+    /**
+     * @brief Whether the items of a namespace are searched fuzzy
+     */
+    bool fuzzy(const QString &ns) const;
+
+    /**
+     * @brief Sets a namespace to match sub-words
+     * @see OfflineIndex::setSubwords
+     */
+    void setSubwords(const QString &ns, bool subwords = true);
+
+    /**
+     * @brief Sets a namespace to match infixes
+     * @see OfflineIndex::setInfix
+     */
+    void setInfix(const QString &ns, bool infix = true);
+
+    /**
+     * @brief Sets a namespace to rank by the positions of words in keywords
+     * @see OfflineIndex::setPositions
+     */
+    void setPositions(const QString &ns, bool positions = true);
+
+    /**
+     * @brief Sets a namespace to tell apart words differing in diacritics
+     * @see OfflineIndex::setDiacritics
+     */
+    void setDiacritics(const QString &ns, bool diacritics = true);
+
+    /**
+     * @brief A report of the items of a namespace and the index holding them
+     * The measures of the index include the items of the namespaces sharing
+     * it, which the report names. Walks the index, see OfflineIndex::stats.
+     * @param ns The namespace
+     */
+    QString statsReport(const QString &ns) const;
+
+    /*
+     * Implementation of the query handler interface
+     */
+
+    void teardownSession() override;
+    void handleQuery(Query *query) override;
+
+    static IndexService *instance;
+
+private:
+
+    std::unique_ptr<IndexServicePrivate> d;
+
+};
+
+}
@@ -16,18 +16,140 @@
 
 #pragma once
 #include <QString>
+#include <cstdint>
+#include <utility>
 #include <vector>
 #include <memory>
 #include "core_globals.h"
 
 namespace Core {
 
-class IndexImpl;
 class Indexable;
+class OfflineIndexPrivate;
+struct SearchContext;
 
+/**
+ * @brief The OfflineIndex class
+ *
+ * Searches run on an immutable snapshot of the index and never block. Changes
+ * are made to a working copy and become visible to searches when they are
+ * committed. A search started before a commit keeps working on the snapshot
+ * it started with. Changes may be made from any thread, they are serialized.
+ */
 class EXPORT_CORE OfflineIndex final {
 
 public:
+    /**
+     * @brief The algorithms of the fuzzy search
+     */
+    enum class FuzzyEngine {
+        QGram,   ///< Candidates by common q-grams. Compact, the default.
+        SymSpell ///< Candidates by a precomputed deletion dictionary. Does not
+                 ///< miss short words, tolerates at most two errors and needs
+                 ///< considerably more memory.
+    };
+
+    /**
+     * @brief The shape and memory of an index, see stats
+     *
+     * Sizes are in bytes and estimate the heap memory of the structures.
+     * Structures shared with other snapshots, e.g. the segments of the
+     * dictionary, are counted fully. A loaded index counts the mapped file,
+     * which is paged in lazily.
+     */
+    struct Stats {
+        size_t items;            ///< Indexed items, including removed ones
+        size_t removedItems;     ///< Removed items not compacted yet
+        size_t shards;           ///< Shards searched in parallel, see setShardThreshold
+        size_t terms;            ///< Terms of the dictionary. A term split across
+                                 ///< several segments or shards counts once per
+                                 ///< segment.
+        size_t postings;         ///< Postings of the dictionary
+        size_t longestPostings;  ///< Length of the longest posting list of a segment
+        QString longestTerm;     ///< The term having the longest posting list
+        size_t dictionaryBytes;  ///< Terms of the dictionary
+        size_t postingsBytes;    ///< Posting lists of the dictionary
+        size_t subwordBytes;     ///< Dictionary of the sub-words
+        size_t infixBytes;       ///< Suffix array of the terms
+        size_t fuzzyBytes;       ///< Q-gram index or deletion dictionary and their words
+        size_t facetBytes;       ///< Bitmaps of the facets
+        size_t itemBytes;        ///< Item vector and the ids of the items
+        int64_t buildTime;       ///< Duration of the last build or load in ms,
+                                 ///< -1 if the index was built by adding items
+
+        /**
+         * @brief The total of the sizes
+         */
+        size_t bytes() const;
+
+        /**
+         * @brief A human readable report, one line per measure
+         */
+        QString toString() const;
+    };
+
+    /**
+     * @brief The stage of a search a match was found by, see setFuzzyFallback
+     * Searches without a fuzzy fallback run a single stage, exact if the
+     * search is not fuzzy and fuzzy otherwise.
+     */
+    enum class Tier : unsigned char {
+        Exact, ///< Prefix, sub-word and infix matches
+        Fuzzy  ///< Matches of the fuzzy search
+    };
+
+    /**
+     * @brief A match of a search
+     * Points to an item stored in the index.
+     */
+    struct Match {
+        const std::shared_ptr<Core::Indexable> *item;
+        short score;
+        Tier tier;
+    };
+
+    /**
+     * @brief The matches of a search, best first
+     *
+     * Refers to the items of the snapshot the search ran on and keeps the
+     * snapshot alive. Reading the matches copies no shared pointers, pass
+     * them to Query::addMatches as they are.
+     */
+    class Results final {
+    public:
+        typedef std::vector<Match>::const_iterator const_iterator;
+        inline const_iterator begin() const { return matches_.begin(); }
+        inline const_iterator end() const { return matches_.end(); }
+        inline size_t size() const { return matches_.size(); }
+        inline bool empty() const { return matches_.empty(); }
+    private:
+        friend class OfflineIndex;
+        std::shared_ptr<const void> snapshot_;
+        std::vector<Match> matches_;
+    };
+
+    /**
+     * @brief The searches of a typing user
+     *
+     * Remembers the last query and its matches. If the next query extends it,
+     * e.g. "fir" after "fi" or "firefox w" after "firefox", the search only
+     * narrows these matches down instead of starting over. Any other query,
+     * as well as a change of the index, starts a new search.
+     *
+     * Searches of one session may run concurrently, overlapping ones simply
+     * do not share their state.
+     */
+    class Session final {
+    public:
+        /**
+         * @brief Forgets the last query
+         */
+        inline void reset() { std::atomic_store(&context_, std::shared_ptr<SearchContext>()); }
+    private:
+        friend class OfflineIndex;
+        std::shared_ptr<SearchContext> context_;
+    };
+
     /**
      * @brief Contstructs a search
      * @param fuzzy Sets the type of the search. Defaults to false.
@@ -42,6 +164,7 @@ public:
 
     /**
      * @brief Sets the type of the search to fuzzy
+     * Takes effect immediately, pending changes are committed as well.
      * @param fuzzy The type to set. Defaults to true.
      */
     void setFuzzy(bool fuzzy = true);
@@ -52,13 +175,27 @@ public:
      */
     bool fuzzy();
 
+    /**
+     * @brief Sets the algorithm of the fuzzy search
+     * Takes effect immediately if the search is fuzzy, pending changes are
+     * committed as well.
+     * @param engine The algorithm to use
+     */
+    void setFuzzyEngine(FuzzyEngine engine);
+
+    /**
+     * @brief The algorithm of the fuzzy search
+     */
+    FuzzyEngine fuzzyEngine();
+
     /**
      * @brief Set the error tolerance of the fuzzy search
      *
      * If the value d is >1, the search tolerates d errors. If the value d is <1,
      * the search tolerates wordlength * d errors. The "amount of tolerance" is
      * measures in maximal prefix edit distance. If the search is not set to fuzzy
-     * setDelta has no effect.
+     * setDelta has no effect. Takes effect immediately, pending changes are
+     * committed as well.
      *
      * @param t The amount of error tolerance
      */
@@ -70,12 +207,211 @@ public:
      */
     double delta();
 
+    /**
+     * @brief Search fuzzy only if the exact search falls short
+     *
+     * A fuzzy search compares the query words to all words of the index,
+     * which costs considerably more than looking up their prefixes. With a
+     * fallback the prefix search runs first and the fuzzy search only if it
+     * finds fewer than minMatches items, or fewer than the k results asked
+     * for. The matches of the prefix search are tagged Tier::Exact, the ones
+     * added by the fuzzy search Tier::Fuzzy, and exact matches rank before
+     * fuzzy ones. Has no effect if the search is not fuzzy. Defaults to 0,
+     * which disables the fallback. Takes effect immediately, pending changes
+     * are committed as well.
+     *
+     * @param minMatches The number of exact matches sparing the fuzzy search
+     */
+    void setFuzzyFallback(size_t minMatches);
+
+    /**
+     * @brief The number of exact matches sparing the fuzzy search, 0 if disabled
+     */
+    size_t fuzzyFallback();
+
+    /**
+     * @brief Match the initials and camelCase parts of keywords
+     *
+     * Lets "vsc" find "Visual Studio Code", "lo" "LibreOffice" and "office"
+     * "LibreOffice" by a prefix lookup in a secondary dictionary of the
+     * sub-words of the keywords. Sub-word matches rank below prefix matches of
+     * whole words. Disabled by default. Takes effect immediately, pending
+     * changes are committed as well.
+     *
+     * @param subwords Whether to match sub-words. Defaults to true.
+     */
+    void setSubwords(bool subwords = true);
+
+    /**
+     * @brief Whether sub-words of keywords are matched
+     */
+    bool subwords();
+
+    /**
+     * @brief Match words inside of keywords
+     *
+     * Lets "book" find "notebook.pdf" by a lookup in a suffix array of the
+     * terms of the index. Infix matches rank below prefix matches of whole
+     * words, like sub-word matches. Words shorter than three characters do
+     * not match infixes. The suffix array is built on the first query after
+     * a build or load. Disabled by default. Takes effect immediately, pending
+     * changes are committed as well.
+     *
+     * @param infix Whether to match infixes. Defaults to true.
+     */
+    void setInfix(bool infix = true);
+
+    /**
+     * @brief Whether infixes of keywords are matched
+     */
+    bool infix();
+
+    /**
+     * @brief Rank by the positions of the words in the keywords
+     *
+     * Stores the position of every word in the keywords of an item with its
+     * postings, which takes a byte per posting. Matches of the first word of
+     * a keyword rank higher, so that "code" ranks "Code - OSS" before "Visual
+     * Studio Code", and so do matches of several words in the order and next
+     * to each other like in the keywords, so that "visual code" ranks
+     * "Visual Studio Code" before "Code Visual Diff". Disabled by default.
+     * Takes effect immediately, the index is rebuilt and pending changes are
+     * committed as well. Indexes saved with another setting fail to load.
+     *
+     * @param positions Whether to store positions. Defaults to true.
+     */
+    void setPositions(bool positions = true);
+
+    /**
+     * @brief Whether the positions of the words in the keywords are stored
+     */
+    bool positions();
+
+    /**
+     * @brief Tell words apart which differ in their diacritics only
+     *
+     * Words of keywords and queries are case folded and by default stripped
+     * of their diacritics, so that "cafe" finds "Café" and "café" finds
+     * "Cafe". Keeping the diacritics serves languages in which they make
+     * different letters, e.g. "Bar" and "Bär". Disabled by default. Takes
+     * effect immediately, the index is rebuilt and pending changes are
+     * committed as well. Indexes saved with another setting fail to load.
+     *
+     * @param diacritics Whether to keep diacritics. Defaults to true.
+     */
+    void setDiacritics(bool diacritics = true);
+
+    /**
+     * @brief Whether the words keep their diacritics
+     */
+    bool diacritics();
+
+    /**
+     * @brief Search large indexes in parallel
+     *
+     * An index of more than threshold items is split into shards of
+     * consecutive items, one per core, which are searched concurrently on the
+     * global thread pool. The matches are the same, a keystroke is answered
+     * faster at the price of some memory, since the shards do not share their
+     * terms. Takes effect when the index is built or loaded next. Defaults to
+     * 500000 items.
+     *
+     * @param threshold The number of items above which the index is split
+     */
+    void setShardThreshold(size_t threshold);
+
+    /**
+     * @brief The number of items above which the index is split into shards
+     */
+    size_t shardThreshold();
+
     /**
      * @brief Build the search index
      * @param The items to index
      */
     void add(std::shared_ptr<Core::Indexable> idxble);
 
+    /**
+     * @brief Replace the contents of the index by items
+     *
+     * Same as clear followed by add for every item, but the keywords are
+     * tokenized and sorted concurrently on the global thread pool and the
+     * dictionary is written in bulk. Prefer this when rebuilding an index from
+     * scratch. Like other changes the index has to be committed.
+     *
+     * @param items The items to index
+     */
+    void build(std::vector<std::shared_ptr<Core::Indexable>> items);
+
+    /**
+     * @brief Remove an item from the search index
+     *
+     * The item is hidden from searches immediately, its postings are dropped
+     * once enough items have been removed to make compacting the index pay
+     * off. The item is identified by its address.
+     *
+     * @param idxble The item to remove
+     * @return True if the item was in the index
+     */
+    bool remove(const std::shared_ptr<Core::Indexable> &idxble);
+
+    /**
+     * @brief Reindex an item whose keywords changed
+     * Adds the item if it is not in the index.
+     * @param idxble The item to update
+     */
+    void update(std::shared_ptr<Core::Indexable> idxble);
+
+    /**
+     * @brief Publish the changes made since the last commit to searches
+     */
+    void commit();
+
+    /**
+     * @brief Write the committed index to a file
+     *
+     * The file can be loaded on the next start instead of indexing all items
+     * again. Ids are stored as positions in items, hence the same items have
+     * to be passed to load in the same order. An index matching sub-words
+     * writes them to path.subwords in addition, a fuzzy index its words and
+     * their q-grams or deletions to path.fuzzy. A sharded
+     * index writes its shards to path.0, path.1 and so on, all files of a
+     * save are tagged with the same generation.
+     *
+     * @param path The file to write, usually in the cache location
+     * @param items All indexed items
+     * @return True on success
+     */
+    bool save(const QString &path, const std::vector<std::shared_ptr<Core::Indexable>> &items) const;
+
+    /**
+     * @brief Replace the index by one written by save
+     *
+     * The file is mapped into memory and searched in place. Loading reads
+     * and checks the header only, the rest is read when searched, where
+     * corrupted offsets read as empty terms. This holds for path.subwords and
+     * path.fuzzy too, which are rebuilt only if they are missing or stale.
+     * Besides hashing the items to find them on removal, no work is done per
+     * item: the facets of the items are asked for on the first query with
+     * facet operators, the infix index is built on the first infix query.
+     * The index is sharded like the saved one, regardless of the threshold.
+     * Like other changes the loaded index has to be committed.
+     *
+     * @param path The file to load
+     * @param items The items passed to save, in the same order
+     * @return False if the file is missing, has a corrupt header, is of
+     * another version or was saved for a different number of items or with
+     * other options. Also if its shards stem from different saves. The index
+     * is unchanged then.
+     */
+    bool load(const QString &path, std::vector<std::shared_ptr<Core::Indexable>> items);
+
+    /**
+     * @brief Remove the files written by save
+     * @param path The path passed to save
+     */
+    static void removeFiles(const QString &path);
+
     /**
      * @brief Clear the search index
      */
@@ -87,8 +423,78 @@ public:
      */
     std::vector<std::shared_ptr<Core::Indexable>> search(const QString &req) const;
 
+    /**
+     * @brief Perform a search on the index and rank the results
+     *
+     * The score of a result is derived from the relevance of the keywords
+     * that matched and from the type of the match. Exact matches score higher
+     * than prefix matches, which score higher than fuzzy matches.
+     *
+     * @param req The query string
+     * @return The matches and their scores in [0, SHRT_MAX], best first
+     */
+    std::vector<std::pair<std::shared_ptr<Core::Indexable>,short>> scoredSearch(const QString &req) const;
+
+    /**
+     * @brief Perform a search on the index and return the best results only
+     *
+     * Ranks like scoredSearch, but stops as soon as the remaining candidates
+     * can not beat the k-th best result. Prefer this when only the top of the
+     * results is shown, short queries on large indexes match a large part of
+     * the index.
+     *
+     * @param req The query string
+     * @param k The maximum number of results
+     * @return The k best matches and their scores, best first
+     */
+    std::vector<std::pair<std::shared_ptr<Core::Indexable>,short>> scoredSearch(const QString &req, size_t k) const;
+
+    /**
+     * @brief Perform a search on the index and rank the results in place
+     * Like scoredSearch, without copying the items. Use this for large result
+     * sets.
+     * @param req The query string
+     * @return The matches, best first
+     */
+    Results matches(const QString &req) const;
+
+    /**
+     * @brief Perform a search on the index and return the best results only
+     * Like scoredSearch(req, k), without copying the items.
+     * @param req The query string
+     * @param k The maximum number of results
+     * @return The k best matches, best first
+     */
+    Results matches(const QString &req, size_t k) const;
+
+    /**
+     * @brief Perform a search of a session, see Session
+     * @param req The query string
+     * @param session The session of the search
+     * @return The matches, best first
+     */
+    Results matches(const QString &req, Session &session) const;
+
+    /**
+     * @brief Perform a search of a session and return the best results only
+     * @param req The query string
+     * @param k The maximum number of results
+     * @param session The session of the search
+     * @return The k best matches, best first
+     */
+    Results matches(const QString &req, size_t k, Session &session) const;
+
+    /**
+     * @brief Measure the committed index
+     * The dictionaries are measured when they are built, no posting list is
+     * decoded. Hash tables and facets are walked, linear in the number of
+     * their entries. Meant for diagnostics, logs and tooltips, not for every
+     * query.
+     */
+    Stats stats() const;
+
 private:
-    IndexImpl *impl_;
+    std::unique_ptr<OfflineIndexPrivate> d;
 };
 
 }
@@ -22,6 +22,7 @@
 #include <utility>
 #include <memory>
 #include "core_globals.h"
+#include "offlineindex.h"
 #include "queryhandler.h"
 
 class QueryManager;
@@ -29,6 +30,7 @@ class QueryManager;
 namespace Core {
 
 class Extension;
+class Indexable;
 class Item;
 
 /**
@@ -40,6 +42,7 @@ class EXPORT_CORE Query : public QObject
     Q_OBJECT
 
     friend class ::QueryManager;
+    friend class IndexService;
     class QueryPrivate;
 
 public:
@@ -64,6 +67,18 @@ public:
     void addMatches(std::vector<std::pair<std::shared_ptr<Item>,short>>::iterator begin,
                     std::vector<std::pair<std::shared_ptr<Item>,short>>::iterator end);
 
+    /**
+     * @brief Adds the matches of an offline index
+     * The items are shared with the index, no intermediate copies are made.
+     * T is the item type the index holds.
+     */
+    template<typename T>
+    void addMatches(const OfflineIndex::Results &results) {
+        addMatches(results, [](Indexable *indexable) -> Item* {
+            return static_cast<T*>(indexable);
+        });
+    }
+
     std::map<QString,uint> runtimes();
 
 private:
@@ -83,6 +98,8 @@ private:
 
     void run();
 
+    void addMatches(const OfflineIndex::Results &results, Item *(*toItem)(Indexable*));
+
     std::unique_ptr<QueryPrivate> d;
 
 signals:
@@ -33,12 +33,14 @@
 #include "albert.h"
 #include "extensionmanager.h"
 #include "hotkeymanager.h"
+#include "indexservice.h"
 #include "mainwindow.h"
 #include "querymanager.h"
 #include "settingswidget.h"
 #include "trayicon.h"
 #include "xdgiconlookup.h"
 using Core::ExtensionManager;
+using Core::IndexService;
 
 static void myMessageOutput(QtMsgType type, const QMessageLogContext &context, const QString &message);
 static void shutdownHandler(int);
@@ -249,6 +251,7 @@ int Albert::run(int argc, char **argv) {
          */
 
         ExtensionManager::instance = new Core::ExtensionManager;
+        IndexService::instance     = new Core::IndexService;
         trayIcon         = new TrayIcon;
         trayIconMenu     = new QMenu;
         hotkeyManager    = new HotkeyManager;
@@ -256,6 +259,9 @@ int Albert::run(int argc, char **argv) {
         queryManager     = new QueryManager(ExtensionManager::instance);
         localServer      = new QLocalServer;
 
+        // The shared index answers queries for the extensions indexing with it
+        ExtensionManager::instance->registerObject(IndexService::instance);
+
 
         /*
          *  START IPC SERVER
@@ -428,6 +434,7 @@ int Albert::run(int argc, char **argv) {
     delete hotkeyManager;
     delete mainWindow;
     delete ExtensionManager::instance;
+    delete IndexService::instance; // Extensions remove their namespaces on unload
 
     localServer->close();
 
@@ -0,0 +1,331 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QDebug>
+#include <QStringList>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include "indexable.h"
+#include "indexservice.h"
+#include "item.h"
+#include "query.h"
+using std::map;
+using std::shared_ptr;
+using std::vector;
+
+Core::IndexService *Core::IndexService::instance = nullptr;
+
+namespace {
+
+/** ***************************************************************************/
+Core::Item *toItem(Core::Indexable *indexable) {
+    // Namespaces hold items of different types, cross cast at runtime
+    return dynamic_cast<Core::Item*>(indexable);
+}
+
+}
+
+
+/** ***************************************************************************/
+class Core::IndexServicePrivate {
+public:
+    struct Options {
+        bool fuzzy = false;
+        bool subwords = false;
+        bool infix = false;
+        bool positions = false;
+        bool diacritics = false;
+        bool operator<(const Options &rhs) const {
+            return std::tie(fuzzy, subwords, infix, positions, diacritics)
+                    < std::tie(rhs.fuzzy, rhs.subwords, rhs.infix, rhs.positions, rhs.diacritics);
+        }
+        bool operator==(const Options &rhs) const {
+            return std::tie(fuzzy, subwords, infix, positions, diacritics)
+                    == std::tie(rhs.fuzzy, rhs.subwords, rhs.infix, rhs.positions, rhs.diacritics);
+        }
+    };
+
+    // The index of the namespaces asking for the same options
+    struct Index {
+        explicit Index(const Options &options);
+        OfflineIndex index;
+        OfflineIndex::Session session;
+    };
+
+    struct Namespace {
+        vector<shared_ptr<Indexable>> items;
+        Options options;
+    };
+
+    void setItems(const QString &ns, vector<shared_ptr<Indexable>> items);
+    void setOptions(const QString &ns, const Options &options);
+    vector<shared_ptr<Index>> searchedIndexes() const;
+
+    // Guards namespaces and serializes the changes, the indexes keep the
+    // items of the namespaces in sync with them.
+    mutable std::mutex mutex;
+    map<QString, Namespace> namespaces;
+
+    // Guards the map of the indexes only, queries do not wait for changes
+    mutable std::mutex indexesMutex;
+    map<Options, shared_ptr<Index>> indexes;
+};
+
+
+
+/** ***************************************************************************/
+Core::IndexServicePrivate::Index::Index(const Options &options) : index(options.fuzzy) {
+    index.setSubwords(options.subwords);
+    index.setInfix(options.infix);
+    index.setPositions(options.positions);
+    index.setDiacritics(options.diacritics);
+}
+
+
+
+/** ***************************************************************************/
+void Core::IndexServicePrivate::setItems(const QString &ns, vector<shared_ptr<Indexable>> items) {
+    Namespace &space = namespaces[ns];
+    shared_ptr<Index> index;
+    {
+        std::lock_guard<std::mutex> lock(indexesMutex);
+        shared_ptr<Index> &entry = indexes[space.options];
+        if ( !entry )
+            entry = std::make_shared<Index>(space.options);
+        index = entry;
+    }
+
+    // Rebuild in bulk if no other namespace of the index holds items, else
+    // exchange the items one by one. Removed items are compacted by the index.
+    bool alone = std::all_of(namespaces.begin(), namespaces.end(),
+                             [&ns, &space](const std::pair<const QString, Namespace> &other){
+        return other.first == ns || other.second.items.empty() || !(other.second.options == space.options);
+    });
+    if ( alone )
+        index->index.build(items);
+    else {
+        for (const shared_ptr<Indexable> &item : space.items)
+            index->index.remove(item);
+        for (const shared_ptr<Indexable> &item : items)
+            index->index.add(item);
+    }
+    space.items = std::move(items);
+
+    // Searches running meanwhile use the old index, publish the new one. The
+    // session caches matches of the old index, which hold the old items.
+    index->index.commit();
+    index->session.reset();
+
+    // Drop the index once none of its namespaces holds items
+    if ( alone && space.items.empty() ) {
+        std::lock_guard<std::mutex> lock(indexesMutex);
+        indexes.erase(space.options);
+    }
+}
+
+
+
+/** ***************************************************************************/
+void Core::IndexServicePrivate::setOptions(const QString &ns, const Options &options) {
+    Namespace &space = namespaces[ns];
+    if ( space.options == options )
+        return;
+
+    // Move the items to the index of the new options
+    vector<shared_ptr<Indexable>> items = space.items;
+    if ( !items.empty() )
+        setItems(ns, vector<shared_ptr<Indexable>>());
+    space.options = options;
+    if ( !items.empty() )
+        setItems(ns, std::move(items));
+}
+
+
+
+/** ***************************************************************************/
+vector<shared_ptr<Core::IndexServicePrivate::Index>> Core::IndexServicePrivate::searchedIndexes() const {
+    std::lock_guard<std::mutex> lock(indexesMutex);
+    vector<shared_ptr<Index>> result;
+    for (const std::pair<const Options, shared_ptr<Index>> &index : indexes)
+        result.push_back(index.second);
+    return result;
+}
+
+
+
+/** ***************************************************************************/
+/** ***************************************************************************/
+/** ***************************************************************************/
+/** ***************************************************************************/
+Core::IndexService::IndexService()
+    : QueryHandler("org.albert.indexservice"),
+      d(new IndexServicePrivate) {
+
+}
+
+
+
+/** ***************************************************************************/
+Core::IndexService::~IndexService() {
+
+}
+
+
+
+/** ***************************************************************************/
+void Core::IndexService::setItems(const QString &ns, vector<shared_ptr<Indexable>> items) {
+
+    // Results are handed to queries as Items, skip anything else
+    vector<shared_ptr<Indexable>>::iterator end =
+            std::remove_if(items.begin(), items.end(), [](const shared_ptr<Indexable> &item){
+        return toItem(item.get()) == nullptr;
+    });
+    if ( end != items.end() ) {
+        qWarning() << qPrintable(QString("%1 indexables of '%2' are not items. Skipped.")
+                                 .arg(std::distance(end, items.end())).arg(ns));
+        items.erase(end, items.end());
+    }
+
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->setItems(ns, std::move(items));
+}
+
+
+
+/** ***************************************************************************/
+void Core::IndexService::removeNamespace(const QString &ns) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    if ( d->namespaces.count(ns) == 0 )
+        return;
+    d->setItems(ns, vector<shared_ptr<Indexable>>());
+    d->namespaces.erase(ns);
+}
+
+
+
+/** ***************************************************************************/
+size_t Core::IndexService::size(const QString &ns) const {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    map<QString, IndexServicePrivate::Namespace>::const_iterator it = d->namespaces.find(ns);
+    return ( it == d->namespaces.end() ) ? 0 : it->second.items.size();
+}
+
+
+
+/** ***************************************************************************/
+void Core::IndexService::setFuzzy(const QString &ns, bool fuzzy) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    IndexServicePrivate::Options options = d->namespaces[ns].options;
+    options.fuzzy = fuzzy;
+    d->setOptions(ns, options);
+}
+
+
+
+/** ***************************************************************************/
+bool Core::IndexService::fuzzy(const QString &ns) const {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    map<QString, IndexServicePrivate::Namespace>::const_iterator it = d->namespaces.find(ns);
+    return ( it != d->namespaces.end() ) && it->second.options.fuzzy;
+}
+
+
+
+/** ***************************************************************************/
+void Core::IndexService::setSubwords(const QString &ns, bool subwords) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    IndexServicePrivate::Options options = d->namespaces[ns].options;
+    options.subwords = subwords;
+    d->setOptions(ns, options);
+}
+
+
+
+/** ***************************************************************************/
+void Core::IndexService::setInfix(const QString &ns, bool infix) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    IndexServicePrivate::Options options = d->namespaces[ns].options;
+    options.infix = infix;
+    d->setOptions(ns, options);
+}
+
+
+
+/** ***************************************************************************/
+void Core::IndexService::setPositions(const QString &ns, bool positions) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    IndexServicePrivate::Options options = d->namespaces[ns].options;
+    options.positions = positions;
+    d->setOptions(ns, options);
+}
+
+
+
+/** ***************************************************************************/
+void Core::IndexService::setDiacritics(const QString &ns, bool diacritics) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    IndexServicePrivate::Options options = d->namespaces[ns].options;
+    options.diacritics = diacritics;
+    d->setOptions(ns, options);
+}
+
+
+
+/** ***************************************************************************/
+QString Core::IndexService::statsReport(const QString &ns) const {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    map<QString, IndexServicePrivate::Namespace>::const_iterator it = d->namespaces.find(ns);
+    if ( it == d->namespaces.end() )
+        return QString();
+
+    // The index is shared by the namespaces of the same options
+    QStringList sharing;
+    for (const std::pair<const QString, IndexServicePrivate::Namespace> &other : d->namespaces)
+        if ( !other.second.items.empty() && other.second.options == it->second.options )
+            sharing << other.first;
+    shared_ptr<IndexServicePrivate::Index> index;
+    {
+        std::lock_guard<std::mutex> indexesLock(d->indexesMutex);
+        map<IndexServicePrivate::Options, shared_ptr<IndexServicePrivate::Index>>::const_iterator indexIt =
+                d->indexes.find(it->second.options);
+        if ( indexIt != d->indexes.end() )
+            index = indexIt->second;
+    }
+    QString report = QString("Items of %1: %2").arg(ns).arg(it->second.items.size());
+    if ( index )
+        report += QString("\nIndex shared by %1:\n%2").arg(sharing.join(", "), index->index.stats().toString());
+    return report;
+}
+
+
+
+/** ***************************************************************************/
+void Core::IndexService::teardownSession() {
+    for (const shared_ptr<IndexServicePrivate::Index> &index : d->searchedIndexes())
+        index->session.reset();
+}
+
+
+
+/** ***************************************************************************/
+void Core::IndexService::handleQuery(Query *query) {
+
+    // One search per set of options, the query ranks the matches together
+    for (const shared_ptr<IndexServicePrivate::Index> &index : d->searchedIndexes())
+        query->addMatches(index->index.matches(query->searchTerm(), index->session), toItem);
+}
@@ -30,6 +30,7 @@
 #include <map>
 #include "action.h"
 #include "extension.h"
+#include "indexable.h"
 #include "item.h"
 #include "matchcompare.h"
 #include "query.h"
@@ -396,6 +397,21 @@ void Core::Query::addMatches(vector<pair<shared_ptr<Item>,short>>::iterator begi
 }
 
 
+/** ***************************************************************************/
+void Core::Query::addMatches(const OfflineIndex::Results &results,
+                             Item *(*toItem)(Indexable*)) {
+    if ( d->isValid ) {
+        d->pendingResultsMutex.lock();
+        d->pendingResults.reserve(d->pendingResults.size() + results.size());
+        // Aliasing constructor: shares ownership with the index entry
+        for (const OfflineIndex::Match &match : results)
+            d->pendingResults.emplace_back(shared_ptr<Item>(*match.item, toItem(match.item->get())),
+                                           match.score);
+        d->pendingResultsMutex.unlock();
+    }
+}
+
+
 /** ***************************************************************************/
 std::map<QString,uint> Core::Query::runtimes() {
     return d->runtimes;
@@ -0,0 +1,283 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <bitset>
+#include <iterator>
+#include "bitmap.h"
+using std::vector;
+
+namespace {
+
+// Number of 64 bit words of a bitset container
+const size_t BITSET_WORDS = (1 << 16) / 64;
+
+/** ***************************************************************************/
+uint32_t popcount(const vector<uint64_t> &bits) {
+    uint32_t count = 0;
+    for ( uint64_t word : bits )
+        count += static_cast<uint32_t>(std::bitset<64>(word).count());
+    return count;
+}
+
+}
+
+
+
+/** ***************************************************************************/
+void Core::Bitmap::add(uint32_t id) {
+    const uint16_t key = static_cast<uint16_t>(id >> 16);
+    const uint16_t low = static_cast<uint16_t>(id);
+
+    vector<Container>::iterator container = find(key);
+    if ( container == containers_.end() || container->key != key )
+        container = containers_.insert(container, Container{key, 0, vector<uint16_t>(), vector<uint64_t>()});
+
+    if ( container->bits.empty() ) {
+        vector<uint16_t>::iterator it = container->array.empty() || container->array.back() < low
+                ? container->array.end()
+                : std::lower_bound(container->array.begin(), container->array.end(), low);
+        if ( it != container->array.end() && *it == low )
+            return;
+        container->array.insert(it, low);
+        ++container->size;
+        if ( container->size > ARRAY_SIZE )
+            toBits(*container);
+    } else {
+        uint64_t &word = container->bits[low >> 6];
+        const uint64_t bit = uint64_t(1) << (low & 63);
+        if ( !(word & bit) ) {
+            word |= bit;
+            ++container->size;
+        }
+    }
+}
+
+
+
+/** ***************************************************************************/
+bool Core::Bitmap::contains(uint32_t id) const {
+    const uint16_t key = static_cast<uint16_t>(id >> 16);
+    vector<Container>::const_iterator container = find(key);
+    return container != containers_.end() && container->key == key
+            && contains(*container, static_cast<uint16_t>(id));
+}
+
+
+
+/** ***************************************************************************/
+uint32_t Core::Bitmap::size() const {
+    uint32_t size = 0;
+    for ( const Container &container : containers_ )
+        size += container.size;
+    return size;
+}
+
+
+
+/** ***************************************************************************/
+size_t Core::Bitmap::heapSize() const {
+    size_t size = containers_.capacity() * sizeof(Container);
+    for ( const Container &container : containers_ )
+        size += container.array.capacity() * sizeof(uint16_t) + container.bits.capacity() * sizeof(uint64_t);
+    return size;
+}
+
+
+
+/** ***************************************************************************/
+void Core::Bitmap::unite(const Bitmap &other) {
+    vector<Container> united;
+    united.reserve(containers_.size() + other.containers_.size());
+    vector<Container>::iterator lhs = containers_.begin();
+    vector<Container>::const_iterator rhs = other.containers_.begin();
+    while ( lhs != containers_.end() || rhs != other.containers_.end() ) {
+        if ( rhs == other.containers_.end() || (lhs != containers_.end() && lhs->key < rhs->key) )
+            united.push_back(std::move(*lhs++));
+        else if ( lhs == containers_.end() || rhs->key < lhs->key )
+            united.push_back(*rhs++);
+        else {
+            Container container{lhs->key, 0, vector<uint16_t>(), vector<uint64_t>()};
+            if ( lhs->bits.empty() && rhs->bits.empty() ) {
+                std::set_union(lhs->array.begin(), lhs->array.end(), rhs->array.begin(), rhs->array.end(),
+                               std::back_inserter(container.array));
+                container.size = static_cast<uint32_t>(container.array.size());
+            } else {
+                toBits(*lhs);
+                container.bits = std::move(lhs->bits);
+                if ( rhs->bits.empty() )
+                    for ( uint16_t low : rhs->array )
+                        container.bits[low >> 6] |= uint64_t(1) << (low & 63);
+                else
+                    for ( size_t i = 0; i < BITSET_WORDS; ++i )
+                        container.bits[i] |= rhs->bits[i];
+                container.size = popcount(container.bits);
+            }
+            normalize(container);
+            united.push_back(std::move(container));
+            ++lhs; ++rhs;
+        }
+    }
+    containers_.swap(united);
+}
+
+
+
+/** ***************************************************************************/
+void Core::Bitmap::intersect(const Bitmap &other) {
+    vector<Container>::iterator out = containers_.begin();
+    vector<Container>::const_iterator rhs = other.containers_.begin();
+    for ( vector<Container>::iterator lhs = containers_.begin(); lhs != containers_.end(); ++lhs ) {
+        while ( rhs != other.containers_.end() && rhs->key < lhs->key )
+            ++rhs;
+        if ( rhs == other.containers_.end() )
+            break;
+        if ( rhs->key != lhs->key )
+            continue;
+
+        if ( lhs->bits.empty() ) {
+            // Keep the lower bits contained in the other container
+            vector<uint16_t>::iterator end = std::remove_if(lhs->array.begin(), lhs->array.end(),
+                                                            [&rhs](uint16_t low){ return !contains(*rhs, low); });
+            lhs->array.erase(end, lhs->array.end());
+            lhs->size = static_cast<uint32_t>(lhs->array.size());
+        } else if ( rhs->bits.empty() ) {
+            // Take the lower bits of the other container contained in this one
+            vector<uint16_t> array;
+            for ( uint16_t low : rhs->array )
+                if ( contains(*lhs, low) )
+                    array.push_back(low);
+            lhs->bits.clear();
+            lhs->array.swap(array);
+            lhs->size = static_cast<uint32_t>(lhs->array.size());
+        } else {
+            for ( size_t i = 0; i < BITSET_WORDS; ++i )
+                lhs->bits[i] &= rhs->bits[i];
+            lhs->size = popcount(lhs->bits);
+        }
+
+        if ( lhs->size != 0 ) {
+            normalize(*lhs);
+            if ( out != lhs )
+                *out = std::move(*lhs);
+            ++out;
+        }
+    }
+    containers_.erase(out, containers_.end());
+}
+
+
+
+/** ***************************************************************************/
+void Core::Bitmap::subtract(const Bitmap &other) {
+    vector<Container>::iterator out = containers_.begin();
+    vector<Container>::const_iterator rhs = other.containers_.begin();
+    for ( vector<Container>::iterator lhs = containers_.begin(); lhs != containers_.end(); ++lhs ) {
+        while ( rhs != other.containers_.end() && rhs->key < lhs->key )
+            ++rhs;
+
+        if ( rhs != other.containers_.end() && rhs->key == lhs->key ) {
+            if ( lhs->bits.empty() ) {
+                vector<uint16_t>::iterator end = std::remove_if(lhs->array.begin(), lhs->array.end(),
+                                                                [&rhs](uint16_t low){ return contains(*rhs, low); });
+                lhs->array.erase(end, lhs->array.end());
+                lhs->size = static_cast<uint32_t>(lhs->array.size());
+            } else {
+                if ( rhs->bits.empty() )
+                    for ( uint16_t low : rhs->array )
+                        lhs->bits[low >> 6] &= ~(uint64_t(1) << (low & 63));
+                else
+                    for ( size_t i = 0; i < BITSET_WORDS; ++i )
+                        lhs->bits[i] &= ~rhs->bits[i];
+                lhs->size = popcount(lhs->bits);
+            }
+        }
+
+        if ( lhs->size != 0 ) {
+            normalize(*lhs);
+            if ( out != lhs )
+                *out = std::move(*lhs);
+            ++out;
+        }
+    }
+    containers_.erase(out, containers_.end());
+}
+
+
+
+/** ***************************************************************************/
+std::vector<Core::Bitmap::Container>::iterator Core::Bitmap::find(uint16_t key) {
+    // Ids are usually added in ascending order
+    if ( containers_.empty() || containers_.back().key < key )
+        return containers_.end();
+    if ( containers_.back().key == key )
+        return containers_.end() - 1;
+    return std::lower_bound(containers_.begin(), containers_.end(), key,
+                            [](const Container &lhs, uint16_t rhs){ return lhs.key < rhs; });
+}
+
+
+
+/** ***************************************************************************/
+std::vector<Core::Bitmap::Container>::const_iterator Core::Bitmap::find(uint16_t key) const {
+    return std::lower_bound(containers_.begin(), containers_.end(), key,
+                            [](const Container &lhs, uint16_t rhs){ return lhs.key < rhs; });
+}
+
+
+
+/** ***************************************************************************/
+void Core::Bitmap::toBits(Container &container) {
+    if ( !container.bits.empty() )
+        return;
+    container.bits.assign(BITSET_WORDS, 0);
+    for ( uint16_t low : container.array )
+        container.bits[low >> 6] |= uint64_t(1) << (low & 63);
+    vector<uint16_t>().swap(container.array);
+}
+
+
+
+/** ***************************************************************************/
+void Core::Bitmap::toArray(Container &container) {
+    if ( container.bits.empty() )
+        return;
+    container.array.clear();
+    container.array.reserve(container.size);
+    for ( uint32_t i = 0; i < BITSET_WORDS; ++i )
+        for ( uint64_t word = container.bits[i]; word != 0; word &= word - 1 )
+            container.array.push_back(static_cast<uint16_t>((i << 6) | lowestBit(word)));
+    vector<uint64_t>().swap(container.bits);
+}
+
+
+
+/** ***************************************************************************/
+void Core::Bitmap::normalize(Container &container) {
+    if ( container.size > ARRAY_SIZE )
+        toBits(container);
+    else
+        toArray(container);
+}
+
+
+
+/** ***************************************************************************/
+bool Core::Bitmap::contains(const Container &container, uint16_t low) {
+    if ( container.bits.empty() )
+        return std::binary_search(container.array.begin(), container.array.end(), low);
+    return container.bits[low >> 6] & (uint64_t(1) << (low & 63));
+}
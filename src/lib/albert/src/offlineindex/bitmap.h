@@ -0,0 +1,136 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Core {
+
+/**
+ * @brief The Bitmap class
+ * A compressed set of ids in the style of Roaring bitmaps. The ids are
+ * partitioned by their upper 16 bits into containers. A container holding
+ * few ids stores their lower 16 bits as a sorted array, a dense one as a
+ * bitset of 2^16 bits. Hence a sparse set costs two bytes per id and a dense
+ * one a bit per id. Set operations work container by container.
+ */
+class Bitmap final
+{
+public:
+
+    /**
+     * @brief Adds an id
+     * Adding ascending ids is amortized constant.
+     */
+    void add(uint32_t id);
+
+    /**
+     * @brief Checks if the set contains id
+     */
+    bool contains(uint32_t id) const;
+
+    /**
+     * @brief The number of ids in the set
+     */
+    uint32_t size() const;
+
+    /**
+     * @brief Checks if the set is empty
+     */
+    inline bool empty() const { return containers_.empty(); }
+
+    /**
+     * @brief The bytes allocated on the heap by this set
+     */
+    size_t heapSize() const;
+
+    /**
+     * @brief Adds the ids of other
+     */
+    void unite(const Bitmap &other);
+
+    /**
+     * @brief Keeps the ids also contained in other
+     */
+    void intersect(const Bitmap &other);
+
+    /**
+     * @brief Removes the ids contained in other
+     */
+    void subtract(const Bitmap &other);
+
+    /**
+     * @brief Calls visit(uint32_t id) for the ids in ascending order
+     */
+    template<typename Visitor>
+    void visit(Visitor visit) const;
+
+private:
+
+    // The lower bits of the ids sharing their upper bits, sorted if sparse
+    struct Container {
+        uint16_t key;
+        uint32_t size;
+        std::vector<uint16_t> array; // Lower bits if size <= ARRAY_SIZE
+        std::vector<uint64_t> bits;  // Else a bit per lower bits
+    };
+
+    // Beyond this size the bitset takes less space than the array
+    static const uint32_t ARRAY_SIZE = 4096;
+
+    std::vector<Container>::iterator find(uint16_t key);
+    std::vector<Container>::const_iterator find(uint16_t key) const;
+    static void toBits(Container &container);
+    static void toArray(Container &container);
+    static void normalize(Container &container);
+    static bool contains(const Container &container, uint16_t low);
+
+    // The position of the lowest set bit of a non-zero word (de Bruijn)
+    static inline uint32_t lowestBit(uint64_t word) {
+        static const uint8_t positions[64] = {
+             0,  1, 48,  2, 57, 49, 28,  3, 61, 58, 50, 42, 38, 29, 17,  4,
+            62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12,  5,
+            63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+            46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19,  9, 13,  8,  7,  6
+        };
+        return positions[((word & (~word + 1)) * UINT64_C(0x03f79d71b4cb0a89)) >> 58];
+    }
+
+    // Sorted by key, none is empty
+    std::vector<Container> containers_;
+};
+
+
+
+/** ***************************************************************************/
+template<typename Visitor>
+void Bitmap::visit(Visitor visit) const {
+    for ( const Container &container : containers_ ) {
+        const uint32_t high = static_cast<uint32_t>(container.key) << 16;
+        if ( container.bits.empty() ) {
+            for ( uint16_t low : container.array )
+                visit(high | low);
+        } else {
+            for ( uint32_t i = 0; i < container.bits.size(); ++i )
+                for ( uint64_t word = container.bits[i]; word != 0; word &= word - 1 )
+                    visit(high | (i << 6) | lowestBit(word));
+        }
+    }
+}
+
+}
@@ -0,0 +1,164 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "editdistance.h"
+
+const uint32_t Core::PrefixEditDistance::MAX_BIT_PARALLEL_LENGTH;
+const uint32_t Core::PrefixEditDistance::MAX_STACK_BAND_DELTA;
+
+namespace {
+
+/** ***************************************************************************/
+uint32_t bandedDistance(const Core::Term &word, const Core::Term &candidate, uint32_t delta,
+                        uint32_t *previous, uint32_t *current) {
+    /*
+     * Row i holds the distances of the first i code units of the word to the
+     * prefixes of the candidate ending at j, for |i-j| <= δ. Cell k of a row
+     * is column j = i+k-δ. Cells outside of the band exceed δ and are δ+1.
+     */
+    const uint32_t n = word.size();
+    const uint32_t limit = std::min(candidate.size(), n + delta);
+    const uint32_t infinity = delta + 1;
+    const uint32_t width = 2 * delta + 1;
+    for ( uint32_t k = 0; k < width; ++k )
+        previous[k] = (k >= delta) ? std::min(k - delta, infinity) : infinity;
+
+    for ( uint32_t i = 1; i <= n; ++i ) {
+        uint32_t rowMinimum = infinity;
+        for ( uint32_t k = 0; k < width; ++k ) {
+            const int64_t j = static_cast<int64_t>(i) + k - delta;
+            uint32_t value = infinity;
+            if ( j == 0 )
+                value = std::min(i, infinity);
+            else if ( j > 0 && j <= static_cast<int64_t>(limit) ) {
+                value = previous[k] + (word.at(i-1) == candidate.at(static_cast<uint32_t>(j-1)) ? 0 : 1);
+                if ( k + 1 < width )
+                    value = std::min(value, previous[k+1] + 1);
+                if ( k > 0 )
+                    value = std::min(value, current[k-1] + 1);
+                value = std::min(value, infinity);
+            }
+            current[k] = value;
+            rowMinimum = std::min(rowMinimum, value);
+        }
+        // Distances never decrease along a diagonal
+        if ( rowMinimum == infinity )
+            return infinity;
+        std::swap(previous, current);
+    }
+
+    // The prefix edit distance is the minimum of the last row
+    uint32_t result = infinity;
+    for ( uint32_t k = 0; k < width; ++k )
+        result = std::min(result, previous[k]);
+    return result;
+}
+
+}
+
+
+
+/** ***************************************************************************/
+Core::PrefixEditDistance::PrefixEditDistance(const Term &word, uint32_t delta)
+    : word_(word), delta_(delta) {
+    std::memset(latinMasks_, 0, sizeof(latinMasks_));
+    std::memset(otherCodes_, 0, sizeof(otherCodes_));
+    std::memset(otherMasks_, 0, sizeof(otherMasks_));
+    if ( word_.size() > MAX_BIT_PARALLEL_LENGTH )
+        return;
+    for ( uint32_t i = 0; i < word_.size(); ++i ) {
+        const ushort c = word_.at(i);
+        if ( c < 256 ) {
+            latinMasks_[c] |= uint64_t(1) << i;
+            continue;
+        }
+        uint32_t slot = c & 127;
+        while ( otherCodes_[slot] != 0 && otherCodes_[slot] != c )
+            slot = (slot + 1) & 127;
+        otherCodes_[slot] = c;
+        otherMasks_[slot] |= uint64_t(1) << i;
+    }
+}
+
+
+
+/** ***************************************************************************/
+uint32_t Core::PrefixEditDistance::operator()(const Term &candidate) const {
+    if ( word_.size() <= MAX_BIT_PARALLEL_LENGTH )
+        return candidate.isLatin1() ? bitParallel(candidate.latin1(), candidate.size())
+                                    : bitParallel(candidate.utf16(), candidate.size());
+    return banded(candidate);
+}
+
+
+
+/** ***************************************************************************/
+template<typename Char>
+uint32_t Core::PrefixEditDistance::bitParallel(const Char *candidate, uint32_t size) const {
+
+    const uint32_t m = word_.size();
+    if ( m == 0 )
+        return 0;
+
+    /*
+     * Bit i of pv (mv) is set if the distance in row i+1 of the current
+     * column is one greater (less) than in row i. The first column is 0..m,
+     * the first row 0..n, hence the carry into the columns is +1. score
+     * tracks the last row, the distance of the whole word.
+     */
+    const uint64_t last = uint64_t(1) << (m - 1);
+    const uint32_t limit = std::min(size, m + delta_);
+    uint64_t pv = ~uint64_t(0);
+    uint64_t mv = 0;
+    uint32_t score = m;
+    uint32_t best = m;
+    for ( uint32_t j = 0; j < limit; ++j ) {
+        const uint64_t eq = matchMask(candidate[j]);
+        const uint64_t xv = eq | mv;
+        const uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+        uint64_t ph = mv | ~(xh | pv);
+        uint64_t mh = pv & xh;
+        if ( ph & last )
+            ++score;
+        else if ( mh & last )
+            --score;
+        ph = (ph << 1) | 1;
+        mh <<= 1;
+        pv = mh | ~(xv | ph);
+        mv = ph & xv;
+        best = std::min(best, score);
+
+        // The score decreases by at most one per column
+        if ( best == 0 || score > delta_ + (limit - j - 1) )
+            break;
+    }
+    return std::min(best, delta_ + 1);
+}
+
+
+
+/** ***************************************************************************/
+uint32_t Core::PrefixEditDistance::banded(const Term &candidate) const {
+    if ( delta_ <= MAX_STACK_BAND_DELTA ) {
+        uint32_t rows[2][2 * MAX_STACK_BAND_DELTA + 1];
+        return bandedDistance(word_, candidate, delta_, rows[0], rows[1]);
+    }
+    std::vector<uint32_t> rows(2 * (2 * delta_ + 1));
+    return bandedDistance(word_, candidate, delta_, rows.data(), rows.data() + 2 * delta_ + 1);
+}
@@ -0,0 +1,91 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cstdint>
+#include "term.h"
+
+namespace Core {
+
+/**
+ * @brief The PrefixEditDistance class
+ * Computes the prefix edit distance of a word to candidate terms, i.e. the
+ * smallest edit distance of the word to any prefix of a candidate. The
+ * computation is bounded by a maximal distance δ, greater distances are
+ * reported as δ+1.
+ *
+ * Words of up to 64 code units use the bit-parallel algorithm of Myers in
+ * the formulation of Hyyrö: a machine word holds a column of the dynamic
+ * programming matrix, a column costs a few bit operations. The match masks
+ * of the word are built once on construction. Longer words fall back to the
+ * dynamic programming restricted to the diagonal band of width 2δ+1
+ * (Ukkonen), which fits on the stack for δ <= 3.
+ */
+class PrefixEditDistance final
+{
+public:
+
+    /**
+     * @param word The word to compare. Has to outlive the object.
+     * @param delta The maximal distance of interest
+     */
+    PrefixEditDistance(const Term &word, uint32_t delta);
+
+    /**
+     * @brief The bounded prefix edit distance of the word to candidate
+     */
+    uint32_t operator()(const Term &candidate) const;
+
+    /** The longest word handled bit-parallel */
+    static const uint32_t MAX_BIT_PARALLEL_LENGTH = 64;
+
+    /** The greatest δ the banded algorithm handles without heap allocation */
+    static const uint32_t MAX_STACK_BAND_DELTA = 3;
+
+private:
+
+    template<typename Char>
+    uint32_t bitParallel(const Char *candidate, uint32_t size) const;
+    uint32_t banded(const Term &candidate) const;
+    inline uint64_t matchMask(ushort c) const;
+    inline uint64_t matchMask(uchar c) const { return latinMasks_[c]; }
+
+    const Term word_;
+    const uint32_t delta_;
+
+    // Bit i of the mask of a code unit is set if the word has it at i.
+    // Latin-1 code units are looked up directly, others in a hash table.
+    uint64_t latinMasks_[256];
+    ushort otherCodes_[128];
+    uint64_t otherMasks_[128];
+};
+
+
+
+/** ***************************************************************************/
+inline uint64_t PrefixEditDistance::matchMask(ushort c) const {
+    if ( c < 256 )
+        return latinMasks_[c];
+    // Linear probing, the table is at most half full
+    for ( uint32_t i = c & 127; ; i = (i + 1) & 127 ) {
+        if ( otherCodes_[i] == c )
+            return otherMasks_[i];
+        if ( otherCodes_[i] == 0 )
+            return 0;
+    }
+}
+
+}
@@ -0,0 +1,156 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "facetindex.h"
+#include "termdictionary.h"
+using std::map;
+using std::shared_ptr;
+using std::vector;
+
+
+
+/** ***************************************************************************/
+void Core::FacetIndex::add(const vector<Indexable::Facet> &facets, uint32_t id) {
+    for (const Indexable::Facet &facet : facets) {
+        if (facet.name.isEmpty() || facet.value.isEmpty())
+            continue;
+        const QString name = facet.name.toLower();
+        writable(facets_[name][facet.value.toLower()]).add(id);
+        matches_[name] = facet.match;
+    }
+}
+
+
+
+/** ***************************************************************************/
+void Core::FacetIndex::append(const FacetIndex &other) {
+    for (const auto &match : other.matches_)
+        matches_[match.first] = match.second;
+    for (const auto &facet : other.facets_) {
+        map<QString,shared_ptr<Bitmap>> &values = facets_[facet.first];
+        for (const auto &value : facet.second) {
+            shared_ptr<Bitmap> &bitmap = values[value.first];
+            if (bitmap)
+                writable(bitmap).unite(*value.second);
+            else
+                bitmap = value.second;
+        }
+    }
+}
+
+
+
+/** ***************************************************************************/
+void Core::FacetIndex::remap(const vector<uint32_t> &ids) {
+    for (auto facet = facets_.begin(); facet != facets_.end();) {
+        for (auto value = facet->second.begin(); value != facet->second.end();) {
+            shared_ptr<Bitmap> bitmap = std::make_shared<Bitmap>();
+            value->second->visit([&bitmap, &ids](uint32_t id){
+                if (ids[id] != TermDictionary::REMOVED)
+                    bitmap->add(ids[id]);
+            });
+            if (bitmap->empty())
+                value = facet->second.erase(value);
+            else {
+                value->second = std::move(bitmap);
+                ++value;
+            }
+        }
+        if (facet->second.empty())
+            facet = facets_.erase(facet);
+        else
+            ++facet;
+    }
+}
+
+
+
+/** ***************************************************************************/
+void Core::FacetIndex::clear() {
+    facets_.clear();
+    matches_.clear();
+}
+
+
+
+/** ***************************************************************************/
+bool Core::FacetIndex::contains(const QString &name) const {
+    return facets_.find(name) != facets_.end();
+}
+
+
+
+/** ***************************************************************************/
+Core::Bitmap Core::FacetIndex::match(const QString &name, const QString &operand) const {
+    Bitmap ids;
+    auto facet = facets_.find(name);
+    if (facet == facets_.end())
+        return ids;
+
+    // The values beginning with a prefix form a contiguous range
+    auto unitePrefix = [&ids, &facet](const QString &prefix){
+        for (auto value = facet->second.lower_bound(prefix);
+             value != facet->second.end() && value->first.startsWith(prefix); ++value)
+            ids.unite(*value->second);
+    };
+    auto uniteExact = [&ids, &facet](const QString &operand){
+        auto value = facet->second.find(operand);
+        if (value != facet->second.end())
+            ids.unite(*value->second);
+    };
+
+    switch (matches_.at(name)) {
+    case Indexable::Facet::Match::Exact:
+        uniteExact(operand);
+        break;
+    case Indexable::Facet::Match::Path: {
+        // The directory itself and the paths below it, "in:/tmp" does not
+        // match "/tmpfiles". Trailing slashes are optional.
+        QString path = operand;
+        while (path.endsWith('/'))
+            path.chop(1);
+        uniteExact(path);
+        unitePrefix(path + '/');
+        break;
+    }
+    default:
+        unitePrefix(operand);
+    }
+    return ids;
+}
+
+
+
+/** ***************************************************************************/
+size_t Core::FacetIndex::heapSize() const {
+    size_t size = 0;
+    for (const auto &facet : facets_)
+        for (const auto &value : facet.second)
+            size += sizeof(Bitmap) + value.second->heapSize();
+    return size;
+}
+
+
+
+/** ***************************************************************************/
+Core::Bitmap &Core::FacetIndex::writable(shared_ptr<Bitmap> &bitmap) {
+    // Bitmaps still referenced by other copies are immutable
+    if (!bitmap)
+        bitmap = std::make_shared<Bitmap>();
+    else if (bitmap.use_count() > 1)
+        bitmap = std::make_shared<Bitmap>(*bitmap);
+    return *bitmap;
+}
@@ -0,0 +1,84 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QString>
+#include <map>
+#include <memory>
+#include <vector>
+#include "bitmap.h"
+#include "indexable.h"
+
+namespace Core {
+
+/**
+ * @brief The FacetIndex class
+ * Maps the lowercase values of the facets of the items to the bitmaps of
+ * their ids. The bitmaps are shared between copies and copied on write,
+ * hence cloning the index of a snapshot does not copy them.
+ */
+class FacetIndex final
+{
+public:
+
+    /**
+     * @brief Adds the facets of an item
+     * Ids have to be added in ascending order to be amortized constant.
+     */
+    void add(const std::vector<Indexable::Facet> &facets, uint32_t id);
+
+    /**
+     * @brief Adds the facets of other, whose ids are greater
+     */
+    void append(const FacetIndex &other);
+
+    /**
+     * @brief Renumbers the ids
+     * Maps the id i to ids[i]. The mapping has to preserve the order. Ids
+     * mapped to TermDictionary::REMOVED are dropped.
+     */
+    void remap(const std::vector<uint32_t> &ids);
+
+    void clear();
+
+    /**
+     * @brief Checks if some item has a facet of the lowercase name
+     */
+    bool contains(const QString &name) const;
+
+    /**
+     * @brief The ids of the items having a facet value matching the operand
+     * The values match as the facets of the name say, see Indexable::Facet.
+     */
+    Bitmap match(const QString &name, const QString &operand) const;
+
+    /**
+     * @brief The bytes allocated on the heap by the bitmaps
+     */
+    size_t heapSize() const;
+
+private:
+
+    static Bitmap &writable(std::shared_ptr<Bitmap> &bitmap);
+
+    // Name, lowercase value, ids
+    std::map<QString,std::map<QString,std::shared_ptr<Bitmap>>> facets_;
+
+    // Name, how its values match operands
+    std::map<QString,Indexable::Facet::Match> matches_;
+};
+
+}
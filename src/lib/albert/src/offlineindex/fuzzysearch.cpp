@@ -14,242 +14,349 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
-#include <QRegularExpression>
+#include <algorithm>
+#include "editdistance.h"
 #include "fuzzysearch.h"
 #include "indexable.h"
+#include "intersection.h"
 #include "prefixsearch.h"
-using std::map;
-using std::set;
+#include "scoring.h"
+#include "termdictionary.h"
 using std::pair;
 using std::shared_ptr;
 using std::vector;
 
 namespace {
 
-bool checkPrefixEditDistance(const QString &prefix, const QString &str, uint delta) {
-    uint n = prefix.size() + 1;
-    uint m = std::min(prefix.size() + delta + 1, static_cast<uint>(str.size()) + 1);
+// Code units per qGram fitting into an uint64_t
+const uint MAX_Q = 4;
 
-    uint* matrix = new uint[n*m];
+}
 
-    // Initialize left and top row.
-    for (uint i = 0; i < n; ++i) { matrix[i*m+0] = i; }
-    for (uint i = 0; i < m; ++i) { matrix[0*m+i] = i; }
 
-    // Now fill the whole matrix.
-    for (uint i = 1; i < n; ++i) {
-        for (uint j = 1; j < m; ++j) {
-            uint dia = matrix[(i-1)*m+j-1] + (prefix[i-1] == str[j-1] ? 0 : 1);
-            matrix[i*m+j] = std::min(std::min(
-                                         dia,
-                                         matrix[i*m+j-1] + 1),
-                    matrix[(i-1)*m+j] + 1);
-        }
-    }
 
-    // Check the last row if there is an entry <= delta.
-    bool result = false;
-    for (uint j = 0; j < m; ++j) {
-        if (matrix[(n-1)*m+j] <= delta) {
-            result = true;
-            break;
-        }
-    }
-    delete[] matrix;
-    return result;
+/** ***************************************************************************/
+Core::FuzzySearch::FuzzySearch(uint q, double d) : q_(std::min(q, MAX_Q)), delta_(d) {
+
 }
 
+
+
+/** ***************************************************************************/
+Core::FuzzySearch::FuzzySearch(const Core::PrefixSearch &rhs, uint q, double d)
+    : PrefixSearch(rhs), q_(std::min(q, MAX_Q)), delta_(d) {
+    buildQGramIndex();
 }
 
 
 
 /** ***************************************************************************/
-Core::FuzzySearch::FuzzySearch(uint q, double d) : q_(q), delta_(d) {
+Core::FuzzySearch::~FuzzySearch() {
 
 }
 
 
 
 /** ***************************************************************************/
-Core::FuzzySearch::FuzzySearch(const Core::PrefixSearch &rhs, uint q, double d)
-    : PrefixSearch(rhs), q_(q), delta_(d) {
-    // Iterate over the inverted index and build the qGramindex
-    for ( const std::pair<QString,std::set<uint>> &invertedIndexEntry : invertedIndex_ ) {
-        QString spaced = QString(q_-1,' ').append(invertedIndexEntry.first);
-        for (uint i = 0 ; i < static_cast<uint>(invertedIndexEntry.first.size()); ++i)
-            ++qGramIndex_[spaced.mid(i,q_)][invertedIndexEntry.first];
-    }
+Core::FuzzySearch *Core::FuzzySearch::clone() const {
+    return new FuzzySearch(*this);
 }
 
 
 
 /** ***************************************************************************/
-Core::FuzzySearch::~FuzzySearch() {
-
+Core::FuzzySearch *Core::FuzzySearch::cloneEmpty() const {
+    FuzzySearch *fuzzySearch = new FuzzySearch(q_, delta_);
+    fuzzySearch->tokenizer_ = tokenizer_;
+    fuzzySearch->subwords_ = subwords_;
+    fuzzySearch->infix_ = infix_;
+    fuzzySearch->fuzzyFallback_ = fuzzyFallback_;
+    fuzzySearch->positions_ = positions_;
+    fuzzySearch->invertedIndex_ = TermDictionary(positions_, diacritics());
+    return fuzzySearch;
 }
 
 
 
 /** ***************************************************************************/
 void Core::FuzzySearch::add(shared_ptr<Core::Indexable> indexable) {
+    // Build a qGram index of the new words (map substring to word)
+    for (const auto &wkw : indexable->indexKeywords())
+        tokenizer_.tokenize(wkw.keyword, [this](const QString &w){ addWord(w); });
+    PrefixSearch::add(std::move(indexable));
+}
 
-    // Add indexable to the index
-    index_.push_back(indexable);
-    uint id = static_cast<uint>(index_.size()-1);
 
-    // Add a mappings to the inverted index which maps on t.
-    vector<Indexable::WeightedKeyword> indexKeywords = indexable->indexKeywords();
-    for (const auto &wkw : indexKeywords) {
-        QStringList words = wkw.keyword.split(QRegularExpression(SEPARATOR_REGEX), QString::SkipEmptyParts);
-        for (QString &w : words) {
 
-            // Make this search case insensitive
-            w=w.toLower();
+/** ***************************************************************************/
+void Core::FuzzySearch::build(vector<shared_ptr<Core::Indexable>> items) {
+    PrefixSearch::build(std::move(items));
+    buildQGramIndex();
+}
+
+
+
+/** ***************************************************************************/
+void Core::FuzzySearch::clear() {
+    qGramIndex_.clear();
+    words_.clear();
+    table_.clear();
+    PrefixSearch::clear();
+}
+
 
-            // Add word to inverted index (map word to item)
-            this->invertedIndex_[w].insert(id);
 
-            // Build a qGram index (map substring to word)
-            QString spaced = QString(q_-1,' ').append(w);
-            for (uint i = 0 ; i < static_cast<uint>(w.size()); ++i)
-                ++qGramIndex_[spaced.mid(i,q_)][w]; //FIXME Currently occurences are not uses
+/** ***************************************************************************/
+bool Core::FuzzySearch::save(const QString &path, const vector<shared_ptr<Indexable>> &items,
+                              uint64_t generation) const {
+    if (!PrefixSearch::save(path, items, generation))
+        return false;
+
+    // The qGrams of the saved words, numbered like the words of the file
+    TermDictionary saved(positions_, diacritics());
+    if (!saved.load(path, static_cast<uint32_t>(items.size())))
+        return false;
+    vector<Term> words;
+    vector<pair<uint64_t,QGramPosting>> entries;
+    vector<uint64_t> grams;
+    saved.visitAll([&](const Term &word, PostingList::const_iterator, PostingList::const_iterator){
+        const uint32_t id = static_cast<uint32_t>(words.size());
+        words.push_back(word);
+        qGrams(word, grams);
+        for ( size_t i = 0; i < grams.size(); ) {
+            size_t j = i + 1;
+            while ( j < grams.size() && grams[j] == grams[i] )
+                ++j;
+            entries.emplace_back(grams[i], QGramPosting{id, static_cast<uint32_t>(j - i)});
+            i = j;
         }
-    }
+    });
+
+    // Stable, the words of a qGram stay in ascending order
+    std::stable_sort(entries.begin(), entries.end(),
+                     [](const pair<uint64_t,QGramPosting> &lhs, const pair<uint64_t,QGramPosting> &rhs){
+        return lhs.first < rhs.first;
+    });
+    return WordTable::save(path + ".fuzzy", saved.checksum(), q_, words, entries);
 }
 
 
 
 /** ***************************************************************************/
-void Core::FuzzySearch::clear() {
+bool Core::FuzzySearch::load(const QString &path, vector<shared_ptr<Indexable>> items) {
+    if (!PrefixSearch::load(path, std::move(items)))
+        return false;
+
+    // Map the qGrams saved along, rebuild them if they are missing or stale
     qGramIndex_.clear();
-    invertedIndex_.clear();
-    index_.clear();
+    words_.clear();
+    if (!table_.load(path + ".fuzzy", invertedIndex_.checksum(), q_, sizeof(QGramPosting)))
+        buildQGramIndex();
+    return true;
 }
 
 
 
 /** ***************************************************************************/
-vector<shared_ptr<Core::Indexable> > Core::FuzzySearch::search(const QString &req) const {
-    vector<QString> words;
-    for (QString &word : req.split(QRegularExpression(SEPARATOR_REGEX), QString::SkipEmptyParts))
-        words.push_back(word.toLower());
-    vector<map<uint,uint>> resultsPerWord; // id, count
+void Core::FuzzySearch::stats(OfflineIndex::Stats &stats) const {
+    PrefixSearch::stats(stats);
+    // A hash node holds the entry and the pointer to the next node
+    stats.fuzzyBytes = table_.bytes() + words_.heapSize() + qGramIndex_.bucket_count() * sizeof(void*)
+            + qGramIndex_.size() * (sizeof(void*) + sizeof(QGramIndex::value_type));
+    for (const QGramIndex::value_type &entry : qGramIndex_)
+        stats.fuzzyBytes += entry.second.capacity() * sizeof(QGramPosting);
+}
 
-    // Quit if there are no words in query
-    if (words.empty())
-        return vector<shared_ptr<Indexable>>();
 
-    // Split the query into words
-    for (QString &word : words) {
 
-        uint delta = static_cast<uint>((delta_ < 1)? word.size()*delta_ : delta_);
+/** ***************************************************************************/
+void Core::FuzzySearch::compact() {
+    // Words of removed items vanished from the dictionary
+    PrefixSearch::compact();
+    buildQGramIndex();
+}
 
-        // Generate the qGrams of this word
-        map<QString,uint> qGrams;
-        QString spaced(q_-1,' ');
-        spaced.append(word.toLower());
-        for ( uint i = 0; i < static_cast<uint>(word.size()); ++i )
-            ++qGrams[spaced.mid(i,q_)];
 
-        // Get the words referenced by each qGram and count the references
-        map<QString,uint> wordMatches;
-        for ( const pair<QString,uint> &qGram : qGrams) {
 
-            // Find the qGram in the index, skip if nothing found
-            decltype(qGramIndex_)::const_iterator qGramIndexIt = qGramIndex_.find(qGram.first);
-            if ( qGramIndexIt == qGramIndex_.end() )
-                continue;
+/** ***************************************************************************/
+void Core::FuzzySearch::buildQGramIndex() {
+    qGramIndex_.clear();
+    words_.clear();
+    table_.clear();
 
-            // Iterate over the set of words referenced by this qGram
-            for (const pair<QString,uint> &indexEntry : qGramIndexIt->second) {
-                // CRUCIAL: The match can contain only the commom amount of qGrams
-                wordMatches[indexEntry.first] += std::min(qGram.second, indexEntry.second);
-            }
-        }
+    // Terms of several segments are visited once per segment
+    invertedIndex_.visitAll([this](const Term &word, PostingList::const_iterator, PostingList::const_iterator){
+        addWord(word);
+    });
+}
+
+
+
+/** ***************************************************************************/
+void Core::FuzzySearch::addWord(const Term &word) {
+    if ( table_.find(word) != table_.size() )
+        return;
+    const pair<uint32_t,bool> inserted = words_.insert(word);
+    if ( !inserted.second )
+        return;
+    const uint32_t id = table_.size() + inserted.first;
+
+    // Ids are assigned incrementally, the lists stay sorted by appending
+    vector<uint64_t> grams;
+    qGrams(word, grams);
+    for ( size_t i = 0; i < grams.size(); ) {
+        size_t j = i + 1;
+        while ( j < grams.size() && grams[j] == grams[i] )
+            ++j;
+        qGramIndex_[grams[i]].push_back({id, static_cast<uint32_t>(j - i)});
+        i = j;
+    }
+}
 
-        // Unite the items referenced by the words accumulating their #matches
-        map<uint,uint> results; // id, count
-        for (const pair<QString,uint> &wordMatch : wordMatches) {
-
-            /*
-             * Do some kind of (cheap) preselection by mathematical bound
-             * If the matched word has less than |word|-δ*q matching qGrams
-             * it cannot be a match.
-             * This is because a single error can reduce the common qGram by
-             * maximum q. δ errors can therefore reduce the common qGrams by
-             * maximum δ*q. If the common qGrams are less than |word|-δ*q this
-             * implies that there are more errors than δ.
-             */
-            if (wordMatch.second < (word.size()-delta*q_) )
-                continue;
-
-            // Now check the (expensive) prefix edit distance
-            if (!checkPrefixEditDistance(word, wordMatch.first, delta))
-                continue;
-
-            // Checks should not be neccessary since this builds on the index
-            for(uint id : invertedIndex_.at(wordMatch.first)) {
-                results[id] += wordMatch.second;
-            }
-        }
 
-        resultsPerWord.push_back(std::move(results));
+
+/** ***************************************************************************/
+void Core::FuzzySearch::qGrams(const Term &word, vector<uint64_t> &qGrams) const {
+    // The qGrams of the word padded by q-1 leading spaces, sorted
+    qGrams.clear();
+    uint64_t qGram = 0;
+    for ( uint i = 1; i < q_; ++i )
+        qGram = (qGram << 16) | ' ';
+    const uint64_t mask = (q_ < MAX_Q) ? (uint64_t(1) << (16 * q_)) - 1 : ~uint64_t(0);
+    for ( uint32_t i = 0; i < word.size(); ++i ) {
+        qGram = ((qGram << 16) | word.at(i)) & mask;
+        qGrams.push_back(qGram);
     }
+    std::sort(qGrams.begin(), qGrams.end());
+}
 
-    // Intersect the set of items references by the (referenced) words
-    // This assusmes that there is at least one word (the query would not have
-    // been started elsewise)
-    vector<pair<uint,uint>> finalResult;
-    if (resultsPerWord.size() > 1) {
-        // Get the smallest list for intersection (performance)
-        uint smallest=0;
-        for (uint i = 1; i < static_cast<uint>(resultsPerWord.size()); ++i)
-            if (resultsPerWord[i].size() < resultsPerWord[smallest].size())
-                smallest = i;
-
-        bool allResultsContainEntry;
-        for (map<uint,uint>::const_iterator r = resultsPerWord[smallest].begin();
-             r != resultsPerWord[smallest].cend(); ++r) {
-            // Check if all results contain this entry
-            allResultsContainEntry=true;
-            uint accMatches = resultsPerWord[smallest][r->first];
-            for (uint i = 0; i < static_cast<uint>(resultsPerWord.size()); ++i) {
-                // Ignore itself
-                if (i==smallest)
-                    continue;
-
-                // If it is in: check next relutlist
-                if (resultsPerWord[i].find(r->first) != resultsPerWord[i].end() ) {
-                    // Accumulate matches
-                    accMatches += resultsPerWord[i][r->first];
-                    continue;
-                }
-
-                allResultsContainEntry = false;
-                break;
-            }
-
-            // If this is not common, check the next entry
-            if (!allResultsContainEntry)
-                continue;
-
-            // Finally this match is common an can be put into the results
-            finalResult.push_back(std::make_pair(r->first, accMatches));
-        }
-    } else {// Else do it without intersction
-        for ( const pair<uint,uint> &result : resultsPerWord[0] )
-            finalResult.push_back(std::make_pair(result.first, result.second));
+
+
+/** ***************************************************************************/
+void Core::FuzzySearch::wordPostings(const QString &word, const vector<ScoredId> *candidates,
+                                     vector<ScoredId> &postings) const {
+
+    /*
+     * The qGrams shared with the words of the index, indexed by word id.
+     * Reused by the queries of a thread and reset at the matched words only,
+     * clearing it per query would cost the size of the vocabulary.
+     */
+    static thread_local vector<uint32_t> counts;
+    if ( counts.size() < table_.size() + words_.size() )
+        counts.resize(table_.size() + words_.size(), 0);
+    vector<uint32_t> matchedWords;
+    vector<uint64_t> grams;
+
+    uint delta = maxErrors(word);
+
+    // Generate the qGrams of this word
+    qGrams(word, grams);
+
+    // Get the words referenced by each qGram and count the references
+    for ( size_t i = 0; i < grams.size(); ) {
+        size_t j = i + 1;
+        while ( j < grams.size() && grams[j] == grams[i] )
+            ++j;
+        const uint32_t occurences = static_cast<uint32_t>(j - i);
+
+        // Iterate over the set of words referenced by this qGram
+        auto count = [&](const QGramPosting &posting){
+            if ( counts[posting.word] == 0 )
+                matchedWords.push_back(posting.word);
+            // CRUCIAL: The match can contain only the commom amount of qGrams
+            counts[posting.word] += std::min(occurences, posting.count);
+        };
+
+        // The records of the file are not checked on load, skip foreign ids
+        const pair<const QGramPosting*,const QGramPosting*> records = table_.records<QGramPosting>(grams[i]);
+        for ( const QGramPosting *it = records.first; it != records.second; ++it )
+            if ( it->word < table_.size() )
+                count(*it);
+
+        // Find the qGram in the index, skip if nothing found
+        QGramIndex::const_iterator qGramIndexIt = qGramIndex_.find(grams[i]);
+        i = j;
+        if ( qGramIndexIt == qGramIndex_.end() )
+            continue;
+        for (const QGramPosting &posting : qGramIndexIt->second)
+            count(posting);
     }
 
-    // Sort em by relevance // TODO INTRODUCE RELEVANCE TO ITEMS
-    //        std::sort(finalResult.begin(), finalResult.end(),
-    //                  [](QPair<T, uint> x, QPair<T, uint> y)
-    //                    {return x.second > y.second;});
-    vector<shared_ptr<Indexable>> result;
-    for (const pair<uint,uint> &pair : finalResult) {
-        result.push_back(index_.at(pair.first));
+    // Unite the items referenced by the words keeping their best scores
+    vector<ScoredId> results;
+    const uint wordLength = static_cast<uint>(word.size());
+    const PrefixEditDistance prefixEditDistance(Term(word), delta);
+    for (uint32_t wordId : matchedWords) {
+        const Term matchedWord = term(wordId);
+        const uint matchedQGrams = counts[wordId];
+        counts[wordId] = 0;
+
+        /*
+         * Do some kind of (cheap) preselection by mathematical bound
+         * If the matched word has less than |word|-δ*q matching qGrams
+         * it cannot be a match.
+         * This is because a single error can reduce the common qGram by
+         * maximum q. δ errors can therefore reduce the common qGrams by
+         * maximum δ*q. If the common qGrams are less than |word|-δ*q this
+         * implies that there are more errors than δ.
+         */
+        if (delta*q_ < wordLength && matchedQGrams < wordLength-delta*q_)
+            continue;
+
+        // Now check the prefix edit distance
+        uint distance = prefixEditDistance(matchedWord);
+        if (distance > delta)
+            continue;
+
+        // Exact and prefix matches rank before fuzzy matches
+        uint quality = (distance == 0)
+                ? Scoring::prefixQuality(wordLength, static_cast<uint>(matchedWord.size()))
+                : Scoring::fuzzyQuality(wordLength, distance, matchedQGrams, wordLength);
+
+        // Checks should not be neccessary since this builds on the index
+        invertedIndex_.visitTerm(matchedWord, [&results, quality](const Term &,
+                                 PostingList::const_iterator begin, PostingList::const_iterator end){
+            for ( ; begin != end; ++begin )
+                results.emplace_back(*begin, Scoring::wordScore(begin.weight(), quality, begin.position()));
+        });
     }
-    return result;
+    sortUnique(results);
+
+    // Sub-words and infixes are matched like in the prefix search
+    postings.insert(postings.end(), results.begin(), results.end());
+    if (candidates)
+        retain(postings, *candidates);
+    subwordPostings(word, candidates, postings);
+    infixPostings(word, candidates, postings);
+}
+
+
+
+/** ***************************************************************************/
+bool Core::FuzzySearch::narrows(const QString &word, const QString &previous) const {
+    /*
+     * A longer word may be allowed more errors. Also the matches of short
+     * words, which may not share a qGram with the terms they match, are
+     * incomplete. Only if |previous| > δ*q the bound below is exact.
+     */
+    const uint delta = maxErrors(previous);
+    return PrefixSearch::narrows(word, previous) && maxErrors(word) <= delta
+            && static_cast<uint>(previous.size()) > delta*q_;
 }
 
 
+
+/** ***************************************************************************/
+uint Core::FuzzySearch::maxErrors(const QString &word) const {
+    return static_cast<uint>((delta_ < 1)? word.size()*delta_ : delta_);
+}
+
+
+
+/** ***************************************************************************/
+vector<Core::ScoredId> Core::FuzzySearch::topMatches(const QStringList &words, size_t k) const {
+    // The fuzzy matches of a word are not bounded by the prefix order, rank all
+    vector<ScoredId> matches = match(words);
+    selectTop(matches, k);
+    return matches;
+}
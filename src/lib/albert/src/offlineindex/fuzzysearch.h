@@ -16,10 +16,13 @@
 
 #pragma once
 #include <QString>
-#include <map>
+#include <cstdint>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 #include "prefixsearch.h"
+#include "termarena.h"
+#include "wordtable.h"
 
 namespace Core {
 
@@ -31,19 +34,53 @@ public:
     explicit FuzzySearch(const PrefixSearch& rhs, uint q = 3, double d = 1.0/3);
     ~FuzzySearch();
 
+    FuzzySearch *clone() const override;
+    FuzzySearch *cloneEmpty() const override;
+
     void add(std::shared_ptr<Indexable> idxble) override;
+    void build(std::vector<std::shared_ptr<Indexable>> items) override;
     void clear() override;
-    std::vector<std::shared_ptr<Indexable>> search(const QString &req) const override;
+    bool save(const QString &path, const std::vector<std::shared_ptr<Indexable>> &items,
+              uint64_t generation) const override;
+    bool load(const QString &path, std::vector<std::shared_ptr<Indexable>> items) override;
+    void stats(OfflineIndex::Stats &stats) const override;
     inline double delta() const {return delta_;}
     inline void setDelta(double d){delta_=d;}
 
 private:
 
-    // Map of qGrams, containing their word references and #occurences
-    typedef std::map<QString,std::map<QString,uint>> QGramIndex;
+    void wordPostings(const QString &word, const std::vector<ScoredId> *candidates,
+                      std::vector<ScoredId> &postings) const override;
+    bool narrows(const QString &word, const QString &previous) const override;
+    std::vector<ScoredId> topMatches(const QStringList &words, size_t k) const override;
+    inline bool fuzzy() const override { return true; }
+    uint maxErrors(const QString &word) const;
+    void compact() override;
+    void buildQGramIndex();
+    void addWord(const Term &word);
+    void qGrams(const Term &word, std::vector<uint64_t> &qGrams) const;
+    inline Term term(uint32_t id) const {
+        return id < table_.size() ? table_.word(id) : words_[id - table_.size()];
+    }
+
+    // A word referenced by a qGram and the #occurences of the qGram in it
+    struct QGramPosting {
+        uint32_t word;
+        uint32_t count;
+    };
+
+    // Map of qGrams packed into integers (16 bit per code unit), containing
+    // the ids of the words referencing them in ascending order
+    typedef std::unordered_map<uint64_t,std::vector<QGramPosting>> QGramIndex;
     QGramIndex qGramIndex_;
 
-    // Size of the slices
+    // The words of the loaded file and their qGrams, mapped from the file
+    WordTable table_;
+
+    // The distinct words added since, their ids follow the ones of the table
+    TermArena words_;
+
+    // Size of the slices, at most 4 to fit into the packed qGrams
     uint q_;
 
     // Maximum error
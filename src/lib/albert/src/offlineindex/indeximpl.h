@@ -16,23 +16,64 @@
 
 #pragma once
 #include <QString>
+#include <utility>
 #include <vector>
 #include <memory>
+#include "offlineindex.h"
+#include "tokenizer.h"
 
 namespace Core {
 
 class Indexable;
+class IndexImpl;
+
+/**
+ * @brief The state an index keeps between the searches of a session
+ */
+struct SearchContext
+{
+    virtual ~SearchContext() {}
+
+    // The snapshot the state refers to
+    std::weak_ptr<const IndexImpl> snapshot;
+};
 
 class IndexImpl
 {
 public:
     virtual ~IndexImpl() {}
+    virtual IndexImpl *clone() const = 0;
+    virtual IndexImpl *cloneEmpty() const = 0;
     virtual void add(std::shared_ptr<Indexable> idxble) = 0;
+    virtual void build(std::vector<std::shared_ptr<Indexable>> items) = 0;
+    virtual bool remove(const std::shared_ptr<Indexable> &idxble) = 0;
+    virtual void update(std::shared_ptr<Indexable> idxble) = 0;
+    virtual bool contains(const Indexable *idxble) const = 0;
     virtual void clear() = 0;
-    virtual std::vector<std::shared_ptr<Indexable>> search(const QString &req) const = 0;
+    virtual void setSubwords(bool subwords) = 0;
+    virtual bool subwords() const = 0;
+    virtual void setInfix(bool infix) = 0;
+    virtual bool infix() const = 0;
+    virtual void setFuzzyFallback(size_t minMatches) = 0;
+    virtual size_t fuzzyFallback() const = 0;
+    virtual void setPositions(bool positions) = 0;
+    virtual bool positions() const = 0;
+    virtual void setDiacritics(bool diacritics) = 0;
+    virtual bool diacritics() const = 0;
+    virtual bool save(const QString &path, const std::vector<std::shared_ptr<Indexable>> &items,
+                      uint64_t generation) const = 0;
+    virtual bool load(const QString &path, std::vector<std::shared_ptr<Indexable>> items) = 0;
+    // The generation passed to save of the file loaded last, 0 if none
+    virtual uint64_t generation() const = 0;
+    virtual std::vector<OfflineIndex::Match> search(const QString &req) const = 0;
+    virtual std::vector<OfflineIndex::Match> search(const QString &req, size_t k) const = 0;
+    virtual std::vector<OfflineIndex::Match> search(const QString &req, size_t k,
+                                                    std::shared_ptr<SearchContext> &context) const = 0;
+    virtual void stats(OfflineIndex::Stats &stats) const = 0;
 
 protected:
-    static constexpr const char* SEPARATOR_REGEX  = "[!?<>\"'=+*.:,;\\\\\\/ _\\-]+";
+    // Splits keywords and queries into normalized words, see setDiacritics
+    Tokenizer tokenizer_;
 
 };
 
@@ -0,0 +1,110 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "infixindex.h"
+using std::shared_ptr;
+using std::vector;
+
+namespace {
+
+// Pending terms are scanned linearly up to this many
+const size_t MIN_PENDING = 1024;
+
+}
+
+const uint32_t Core::InfixIndex::MIN_LENGTH;
+
+
+
+/** ***************************************************************************/
+Core::InfixIndex::InfixIndex() : suffixArray_(std::make_shared<SuffixArray>()) {
+
+}
+
+
+
+/** ***************************************************************************/
+void Core::InfixIndex::add(const QString &term) {
+    pending_.push_back(term);
+    if ( pending_.size() > std::max(MIN_PENDING, suffixArray_->termOffsets.size() / 8) )
+        rebuild();
+}
+
+
+
+/** ***************************************************************************/
+void Core::InfixIndex::assign(vector<QString> terms) {
+    suffixArray_ = std::make_shared<SuffixArray>();
+    pending_ = std::move(terms);
+    rebuild();
+}
+
+
+
+/** ***************************************************************************/
+void Core::InfixIndex::clear() {
+    suffixArray_ = std::make_shared<SuffixArray>();
+    pending_.clear();
+}
+
+
+
+/** ***************************************************************************/
+size_t Core::InfixIndex::heapSize() const {
+    size_t size = suffixArray_->text.capacity() * sizeof(ushort)
+            + suffixArray_->termOffsets.capacity() * sizeof(uint32_t)
+            + suffixArray_->suffixes.capacity() * sizeof(Suffix)
+            + pending_.capacity() * sizeof(QString);
+    for ( const QString &term : pending_ )
+        size += static_cast<size_t>(term.size()) * sizeof(QChar);
+    return size;
+}
+
+
+
+/** ***************************************************************************/
+void Core::InfixIndex::rebuild() {
+
+    // Collect the distinct terms
+    vector<QString> terms;
+    terms.reserve(suffixArray_->termOffsets.size() + pending_.size());
+    for ( uint32_t i = 0; i + 1 < suffixArray_->termOffsets.size(); ++i )
+        terms.push_back(suffixArray_->term(i).toString());
+    terms.insert(terms.end(), pending_.begin(), pending_.end());
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+
+    shared_ptr<SuffixArray> suffixArray = std::make_shared<SuffixArray>();
+    suffixArray->termOffsets.reserve(terms.size() + 1);
+    suffixArray->termOffsets.push_back(0);
+    for ( uint32_t i = 0; i < static_cast<uint32_t>(terms.size()); ++i ) {
+        const ushort *begin = terms[i].utf16();
+        suffixArray->text.insert(suffixArray->text.end(), begin, begin + terms[i].size());
+        suffixArray->termOffsets.push_back(static_cast<uint32_t>(suffixArray->text.size()));
+        for ( uint32_t position = suffixArray->termOffsets[i] + 1; position < suffixArray->termOffsets[i+1]; ++position )
+            suffixArray->suffixes.push_back({position, i});
+    }
+
+    // Terms are short, comparing suffixes directly beats a linear time construction
+    const SuffixArray &sorted = *suffixArray;
+    std::sort(suffixArray->suffixes.begin(), suffixArray->suffixes.end(),
+              [&sorted](const Suffix &lhs, const Suffix &rhs){
+        return sorted.suffix(lhs) < sorted.suffix(rhs);
+    });
+
+    suffixArray_ = suffixArray;
+    pending_.clear();
+}
@@ -0,0 +1,144 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QString>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "term.h"
+
+namespace Core {
+
+/**
+ * @brief The InfixIndex class
+ * Finds the terms containing a string, e.g. "notebook" for "book".
+ *
+ * The terms are stored back to back in a text. A suffix array holds the
+ * suffixes of the terms sorted lexicographically, where a suffix ends with
+ * its term. All suffixes starting with a string form a contiguous range,
+ * found by two binary searches. Suffixes starting at the beginning of a term
+ * are left out, those matches are prefix matches of the dictionary.
+ *
+ * Terms added later are collected in a small list scanned linearly. The
+ * suffix array is rebuilt once the list grows beyond a fraction of the
+ * indexed terms, which keeps the amortized cost of an addition logarithmic.
+ * The suffix array is immutable and shared by copies of the index.
+ */
+class InfixIndex final
+{
+public:
+
+    InfixIndex();
+
+    /**
+     * @brief Adds a term
+     * @param term The term. Has to be not yet in the index.
+     */
+    void add(const QString &term);
+
+    /**
+     * @brief Replaces the terms of the index
+     * @param terms The terms, may contain duplicates
+     */
+    void assign(std::vector<QString> terms);
+
+    /**
+     * @brief Removes all terms
+     */
+    void clear();
+
+    /**
+     * @brief The bytes allocated on the heap by the index
+     */
+    size_t heapSize() const;
+
+    /**
+     * @brief Calls visit(term) once for every term containing infix behind
+     * its first code unit
+     * The term refers to the text of the index, no string is built. Infixes
+     * shorter than MIN_LENGTH match nothing, they are contained in most terms.
+     */
+    template<typename Visitor>
+    void visitInfix(const QString &infix, Visitor visit) const;
+
+    /**
+     * @brief The length of the shortest infix matched
+     */
+    static const uint32_t MIN_LENGTH = 3;
+
+private:
+
+    struct Suffix {
+        uint32_t position; // In text
+        uint32_t term;
+    };
+
+    struct SuffixArray {
+        std::vector<ushort> text;         // The terms back to back
+        std::vector<uint32_t> termOffsets; // Begin of a term in text, size+1
+        std::vector<Suffix> suffixes;     // Sorted
+        inline Term term(uint32_t i) const {
+            return Term(text.data() + termOffsets[i], termOffsets[i+1] - termOffsets[i]);
+        }
+        inline Term suffix(const Suffix &suffix) const {
+            return Term(text.data() + suffix.position, termOffsets[suffix.term+1] - suffix.position);
+        }
+    };
+
+    void rebuild();
+
+    std::shared_ptr<const SuffixArray> suffixArray_;
+    std::vector<QString> pending_;
+
+};
+
+
+
+/** ***************************************************************************/
+template<typename Visitor>
+void InfixIndex::visitInfix(const QString &infix, Visitor visit) const {
+
+    const Term key(infix);
+    if ( key.size() < MIN_LENGTH )
+        return;
+
+    // The range of suffixes starting with infix
+    const SuffixArray &suffixArray = *suffixArray_;
+    std::vector<Suffix>::const_iterator first = std::lower_bound(
+                suffixArray.suffixes.begin(), suffixArray.suffixes.end(), key,
+                [&suffixArray](const Suffix &lhs, const Term &rhs){ return suffixArray.suffix(lhs) < rhs; });
+    std::vector<Suffix>::const_iterator last = first;
+    while ( last != suffixArray.suffixes.end() && suffixArray.suffix(*last).startsWith(key) )
+        ++last;
+
+    // A term can contain infix several times
+    std::vector<uint32_t> terms;
+    terms.reserve(static_cast<size_t>(last - first));
+    for ( ; first != last; ++first )
+        terms.push_back(first->term);
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+    for ( uint32_t term : terms )
+        visit(suffixArray.term(term));
+
+    for ( const QString &term : pending_ )
+        if ( term.indexOf(infix, 1) != -1 )
+            visit(Term(term));
+}
+
+}
@@ -0,0 +1,180 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include "intersection.h"
+using std::vector;
+
+namespace {
+
+// Gallop if the longer list is this many times longer than the shorter one
+const size_t GALLOP_RATIO = 16;
+
+/** ***************************************************************************/
+// Intersects in place, the score of a common id is combine(lhs, rhs)
+template<typename Combine>
+void intersectWith(vector<Core::ScoredId> &results, const vector<Core::ScoredId> &other, Combine combine) {
+
+    vector<Core::ScoredId>::iterator out = results.begin();
+
+    if ( results.size() * GALLOP_RATIO < other.size() ) {
+        // Look up the few results in the long list
+        vector<Core::ScoredId>::const_iterator rhs = other.begin();
+        for ( vector<Core::ScoredId>::const_iterator lhs = results.begin(); lhs != results.end(); ++lhs ) {
+            rhs = Core::gallop(rhs, other.end(), lhs->id);
+            if ( rhs == other.end() )
+                break;
+            if ( rhs->id == lhs->id )
+                *out++ = Core::ScoredId(lhs->id, combine(lhs->score, rhs->score));
+        }
+    } else if ( other.size() * GALLOP_RATIO < results.size() ) {
+        // Look up the few others in the long list of results
+        vector<Core::ScoredId>::const_iterator lhs = results.begin();
+        for ( vector<Core::ScoredId>::const_iterator rhs = other.begin(); rhs != other.end(); ++rhs ) {
+            lhs = Core::gallop(lhs, results.end(), rhs->id);
+            if ( lhs == results.end() )
+                break;
+            if ( lhs->id == rhs->id )
+                *out++ = Core::ScoredId(lhs->id, combine(lhs->score, rhs->score));
+        }
+    } else {
+        // Merge lists of similar length
+        vector<Core::ScoredId>::const_iterator lhs = results.begin();
+        vector<Core::ScoredId>::const_iterator rhs = other.begin();
+        while ( lhs != results.end() && rhs != other.end() ) {
+            if ( lhs->id < rhs->id )
+                ++lhs;
+            else if ( rhs->id < lhs->id )
+                ++rhs;
+            else {
+                *out++ = Core::ScoredId(lhs->id, combine(lhs->score, rhs->score));
+                ++lhs; ++rhs;
+            }
+        }
+    }
+
+    results.erase(out, results.end());
+}
+
+}
+
+
+
+/** ***************************************************************************/
+vector<Core::ScoredId>::const_iterator Core::gallop(vector<ScoredId>::const_iterator first,
+                                                    vector<ScoredId>::const_iterator last,
+                                                    uint32_t id) {
+    size_t step = 1;
+    vector<Core::ScoredId>::const_iterator begin = first;
+    while ( static_cast<size_t>(last - first) > step && first[static_cast<long>(step)].id < id ) {
+        begin = first + static_cast<long>(step);
+        step *= 2;
+    }
+    vector<Core::ScoredId>::const_iterator end = first + static_cast<long>(std::min(step + 1, static_cast<size_t>(last - first)));
+    return std::lower_bound(begin, end, id, [](const Core::ScoredId &lhs, uint32_t rhs){ return lhs.id < rhs; });
+}
+
+
+
+/** ***************************************************************************/
+void Core::intersect(vector<ScoredId> &results, const vector<ScoredId> &other) {
+    intersectWith(results, other, [](uint32_t lhs, uint32_t rhs){ return lhs + rhs; });
+}
+
+
+
+/** ***************************************************************************/
+void Core::retain(vector<ScoredId> &results, const vector<ScoredId> &other) {
+    intersectWith(results, other, [](uint32_t lhs, uint32_t){ return lhs; });
+}
+
+
+
+/** ***************************************************************************/
+vector<Core::ScoredId> Core::intersect(vector<vector<ScoredId>> lists) {
+
+    if ( lists.empty() )
+        return vector<ScoredId>();
+
+    // The intersection is at most as long as the shortest list
+    std::sort(lists.begin(), lists.end(), [](const vector<ScoredId> &lhs, const vector<ScoredId> &rhs){
+        return lhs.size() < rhs.size();
+    });
+    vector<ScoredId> results = std::move(lists.front());
+    for ( size_t i = 1; i < lists.size() && !results.empty(); ++i )
+        intersect(results, lists[i]);
+    return results;
+}
+
+
+
+/** ***************************************************************************/
+void Core::unite(vector<ScoredId> &results, const vector<ScoredId> &other) {
+
+    if ( other.empty() )
+        return;
+
+    vector<ScoredId> united;
+    united.reserve(results.size() + other.size());
+    vector<ScoredId>::const_iterator lhs = results.begin();
+    vector<ScoredId>::const_iterator rhs = other.begin();
+    while ( lhs != results.end() && rhs != other.end() ) {
+        if ( lhs->id < rhs->id )
+            united.push_back(*lhs++);
+        else if ( rhs->id < lhs->id )
+            united.push_back(*rhs++);
+        else {
+            united.emplace_back(lhs->id, std::max(lhs->score, rhs->score));
+            ++lhs; ++rhs;
+        }
+    }
+    united.insert(united.end(), lhs, results.cend());
+    united.insert(united.end(), rhs, other.cend());
+    results.swap(united);
+}
+
+
+
+/** ***************************************************************************/
+void Core::subtract(vector<ScoredId> &results, const vector<ScoredId> &other) {
+    results.erase(std::remove_if(results.begin(), results.end(), [&other](const ScoredId &result){
+        vector<ScoredId>::const_iterator it = std::lower_bound(other.begin(), other.end(), result.id,
+                                                               [](const ScoredId &lhs, uint32_t id){
+            return lhs.id < id;
+        });
+        return it != other.end() && it->id == result.id;
+    }), results.end());
+}
+
+
+
+/** ***************************************************************************/
+void Core::sortUnique(vector<ScoredId> &results) {
+
+    if ( results.empty() )
+        return;
+
+    std::sort(results.begin(), results.end(), [](const ScoredId &lhs, const ScoredId &rhs){
+        return lhs.id < rhs.id;
+    });
+    vector<ScoredId>::iterator out = results.begin();
+    for ( vector<ScoredId>::const_iterator it = results.begin() + 1; it != results.end(); ++it )
+        if ( it->id == out->id )
+            out->score = std::max(out->score, it->score);
+        else
+            *++out = *it;
+    results.erase(out + 1, results.end());
+}
@@ -0,0 +1,83 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <vector>
+#include "scoring.h"
+
+namespace Core {
+
+/**
+ * @brief Finds the first scored id not less than id by galloping
+ * Doubles the step from first until passing id, then binary searches the
+ * last step. Costs O(log d) for a distance d to the result.
+ */
+std::vector<ScoredId>::const_iterator gallop(std::vector<ScoredId>::const_iterator first,
+                                             std::vector<ScoredId>::const_iterator last,
+                                             uint32_t id);
+
+/**
+ * @brief Intersects two lists of scored ids sorted by id in place
+ * The scores of the common ids are summed up. Lists of similar length are
+ * merged linearly. If one list is a lot shorter, the position of each of its
+ * ids in the longer one is found by galloping (exponential search) from the
+ * last position, which costs O(n log(m/n)) instead of O(n+m).
+ * @param results The list to intersect, receives the intersection
+ * @param other The list to intersect with
+ */
+void intersect(std::vector<ScoredId> &results, const std::vector<ScoredId> &other);
+
+/**
+ * @brief Intersects lists of scored ids sorted by id
+ * Starts with the shortest lists and stops as soon as the intersection is
+ * empty.
+ * @param lists The lists to intersect, consumed
+ * @return The common ids and the sums of their scores
+ */
+std::vector<ScoredId> intersect(std::vector<std::vector<ScoredId>> lists);
+
+/**
+ * @brief Keeps the scored ids whose ids are contained in other
+ * Like intersect, but the scores of results are kept as they are.
+ * @param results The list to filter, receives the common ids
+ * @param other The list of ids to keep
+ */
+void retain(std::vector<ScoredId> &results, const std::vector<ScoredId> &other);
+
+/**
+ * @brief Drops the scored ids whose ids are contained in other
+ * The order of results is kept, it does not have to be sorted.
+ * @param results The list to filter
+ * @param other The list of ids to drop, sorted by id
+ */
+void subtract(std::vector<ScoredId> &results, const std::vector<ScoredId> &other);
+
+/**
+ * @brief Unites two lists of scored ids sorted by id in place
+ * Ids contained in both lists keep the better score.
+ * @param results The list to unite, receives the union
+ * @param other The list to unite with
+ */
+void unite(std::vector<ScoredId> &results, const std::vector<ScoredId> &other);
+
+/**
+ * @brief Sorts scored ids by id and merges the duplicates in place
+ * Duplicates keep the better score.
+ * @param results The list to sort, receives the distinct ids
+ */
+void sortUnique(std::vector<ScoredId> &results);
+
+}
@@ -14,88 +14,598 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
-
+#include <QStringList>
+#include <QThread>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <random>
 #include "offlineindex.h"
 #include "indeximpl.h"
 #include "indexable.h"
 #include "prefixsearch.h"
 #include "fuzzysearch.h"
+#include "shardedsearch.h"
+#include "symspellsearch.h"
+using std::pair;
+using std::shared_ptr;
+using std::vector;
+
+namespace {
+
+/** ***************************************************************************/
+QString kibibytes(size_t bytes) {
+    return QString("%1 KiB").arg(static_cast<double>(bytes) / 1024, 0, 'f', 1);
+}
+
+/** ***************************************************************************/
+int64_t millisecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/** ***************************************************************************/
+shared_ptr<Core::IndexImpl> converted(const Core::IndexImpl &index, bool fuzzy,
+                                      Core::OfflineIndex::FuzzyEngine engine, double tolerance) {
+    const Core::PrefixSearch &prefixSearch = static_cast<const Core::PrefixSearch&>(index);
+    if (!fuzzy)
+        return std::make_shared<Core::PrefixSearch>(prefixSearch);
+    if (engine == Core::OfflineIndex::FuzzyEngine::SymSpell) {
+        shared_ptr<Core::SymSpellSearch> symSpellSearch = std::make_shared<Core::SymSpellSearch>(prefixSearch);
+        if (tolerance != 0)
+            symSpellSearch->setDelta(tolerance);
+        return symSpellSearch;
+    }
+    shared_ptr<Core::FuzzySearch> fuzzySearch = std::make_shared<Core::FuzzySearch>(prefixSearch);
+    if (tolerance != 0)
+        fuzzySearch->setDelta(tolerance);
+    return fuzzySearch;
+}
+
+}
+
+
+class Core::OfflineIndexPrivate {
+public:
+    IndexImpl &writable();
+    void publish();
+    void convert(bool fuzzy, OfflineIndex::FuzzyEngine engine);
+    bool fuzzy() const;
+    double delta() const;
+    IndexImpl *emptyIndex(size_t items) const;
+    const IndexImpl &firstShard() const;
+    void forEachShard(std::function<void(IndexImpl&)> change);
+
+    // The index searches run on, loaded and stored atomically
+    shared_ptr<const IndexImpl> snapshot;
+    // The index changes are made to, guarded by mutex
+    shared_ptr<IndexImpl> impl;
+    // impl is the snapshot and has to be copied before it is changed
+    bool published;
+    // The algorithm of fuzzy searches
+    OfflineIndex::FuzzyEngine fuzzyEngine;
+    // The duration of the last build or load in ms, -1 if none
+    int64_t buildTime;
+    // Indexes of more items are built sharded
+    size_t shardThreshold;
+    std::mutex mutex;
+};
+
+
+
+/** ***************************************************************************/
+Core::IndexImpl &Core::OfflineIndexPrivate::writable() {
+    // Copy on write. The immutable segments of the dictionary are shared.
+    if (published) {
+        impl.reset(impl->clone());
+        published = false;
+    }
+    return *impl;
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndexPrivate::publish() {
+    // Searches in flight keep the old snapshot alive
+    if (!published) {
+        std::atomic_store(&snapshot, shared_ptr<const IndexImpl>(impl));
+        published = true;
+    }
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndexPrivate::convert(bool fuzzy, OfflineIndex::FuzzyEngine engine) {
+    // The items and dictionaries are shared, the fuzzy indexes are rebuilt.
+    // Switching the engine keeps the error tolerance.
+    const double tolerance = delta();
+    if (const ShardedSearch *sharded = dynamic_cast<const ShardedSearch*>(impl.get()))
+        impl.reset(sharded->transformed([fuzzy, engine, tolerance](const IndexImpl &shard){
+            return converted(shard, fuzzy, engine, tolerance);
+        }));
+    else
+        impl = converted(*impl, fuzzy, engine, tolerance);
+    fuzzyEngine = engine;
+    published = false;
+    publish();
+}
+
+
+
+/** ***************************************************************************/
+bool Core::OfflineIndexPrivate::fuzzy() const {
+    return dynamic_cast<const FuzzySearch*>(&firstShard()) || dynamic_cast<const SymSpellSearch*>(&firstShard());
+}
+
+
+
+/** ***************************************************************************/
+double Core::OfflineIndexPrivate::delta() const {
+    if (const FuzzySearch *f = dynamic_cast<const FuzzySearch*>(&firstShard()))
+        return f->delta();
+    if (const SymSpellSearch *s = dynamic_cast<const SymSpellSearch*>(&firstShard()))
+        return s->delta();
+    return 0;
+}
+
+
+
+/** ***************************************************************************/
+Core::IndexImpl *Core::OfflineIndexPrivate::emptyIndex(size_t items) const {
+    // One shard per core, shards of a few items do not pay off
+    const int cores = QThread::idealThreadCount();
+    if (items > shardThreshold && cores > 1)
+        return new ShardedSearch(firstShard(), static_cast<uint32_t>(cores));
+    return firstShard().cloneEmpty();
+}
+
+
+
+/** ***************************************************************************/
+const Core::IndexImpl &Core::OfflineIndexPrivate::firstShard() const {
+    // The shards share the type and the settings of the index
+    if (const ShardedSearch *sharded = dynamic_cast<const ShardedSearch*>(impl.get()))
+        return sharded->shard(0);
+    return *impl;
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndexPrivate::forEachShard(std::function<void(IndexImpl&)> change) {
+    IndexImpl &index = writable();
+    if (ShardedSearch *sharded = dynamic_cast<ShardedSearch*>(&index))
+        for (size_t i = 0; i < sharded->shardCount(); ++i)
+            change(sharded->writableShard(i));
+    else
+        change(index);
+}
+
 
 
 /** ***************************************************************************/
-Core::OfflineIndex::OfflineIndex(bool fuzzy) {
-    (fuzzy) ? impl_ = new FuzzySearch() : impl_ = new PrefixSearch();
+Core::OfflineIndex::OfflineIndex(bool fuzzy) : d(new OfflineIndexPrivate) {
+    if (fuzzy)
+        d->impl = std::make_shared<FuzzySearch>();
+    else
+        d->impl = std::make_shared<PrefixSearch>();
+    d->snapshot = d->impl;
+    d->published = true;
+    d->fuzzyEngine = FuzzyEngine::QGram;
+    d->buildTime = -1;
+    d->shardThreshold = 500000;
 }
 
 
 
 /** ***************************************************************************/
 Core::OfflineIndex::~OfflineIndex() {
-    delete impl_;
+
 }
 
 
 
 /** ***************************************************************************/
 void Core::OfflineIndex::setFuzzy(bool fuzzy) {
-    if (dynamic_cast<FuzzySearch*>(impl_)) {
-        if (fuzzy) return;
-        FuzzySearch *old = dynamic_cast<FuzzySearch*>(impl_);
-        impl_ = new PrefixSearch(*old);
-        delete old;
-    } else if (dynamic_cast<PrefixSearch*>(impl_)) {
-        if (!fuzzy) return;
-        PrefixSearch *old = dynamic_cast<PrefixSearch*>(impl_);
-        impl_ = new FuzzySearch(*old);
-        delete old;
-    } else {
-        throw; //should not happen
-    }
+    std::lock_guard<std::mutex> lock(d->mutex);
+    if (d->fuzzy() == fuzzy)
+        return;
+    d->convert(fuzzy, d->fuzzyEngine);
 }
 
 
 
 /** ***************************************************************************/
 bool Core::OfflineIndex::fuzzy() {
-    return dynamic_cast<FuzzySearch*>(impl_) != nullptr;
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->fuzzy();
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::setFuzzyEngine(FuzzyEngine engine) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    if (d->fuzzyEngine == engine)
+        return;
+    if (d->fuzzy())
+        d->convert(true, engine);
+    else
+        d->fuzzyEngine = engine;
 }
 
 
 
 /** ***************************************************************************/
-void Core::OfflineIndex::setDelta(double d) {
-    FuzzySearch* f = dynamic_cast<FuzzySearch*>(impl_);
-    if (f)
-        f->setDelta(d);
+Core::OfflineIndex::FuzzyEngine Core::OfflineIndex::fuzzyEngine() {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->fuzzyEngine;
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::setDelta(double delta) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    if (!d->fuzzy())
+        return;
+    d->forEachShard([delta](IndexImpl &index){
+        if (FuzzySearch *fuzzySearch = dynamic_cast<FuzzySearch*>(&index))
+            fuzzySearch->setDelta(delta);
+        else
+            static_cast<SymSpellSearch&>(index).setDelta(delta);
+    });
+    d->publish();
 }
 
 
 
 /** ***************************************************************************/
 double Core::OfflineIndex::delta() {
-    FuzzySearch* f = dynamic_cast<FuzzySearch*>(impl_);
-    if (f)
-        return f->delta();
-    return 0;
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->delta();
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::setFuzzyFallback(size_t minMatches) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    if (d->impl->fuzzyFallback() == minMatches)
+        return;
+    d->writable().setFuzzyFallback(minMatches);
+    d->publish();
+}
+
+
+
+/** ***************************************************************************/
+size_t Core::OfflineIndex::fuzzyFallback() {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->impl->fuzzyFallback();
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::setSubwords(bool subwords) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    if (d->impl->subwords() == subwords)
+        return;
+    d->writable().setSubwords(subwords);
+    d->publish();
+}
+
+
+
+/** ***************************************************************************/
+bool Core::OfflineIndex::subwords() {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->impl->subwords();
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::setInfix(bool infix) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    if (d->impl->infix() == infix)
+        return;
+    d->writable().setInfix(infix);
+    d->publish();
+}
+
+
+
+/** ***************************************************************************/
+bool Core::OfflineIndex::infix() {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->impl->infix();
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::setPositions(bool positions) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    if (d->impl->positions() == positions)
+        return;
+    d->writable().setPositions(positions);
+    d->publish();
+}
+
+
+
+/** ***************************************************************************/
+bool Core::OfflineIndex::positions() {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->impl->positions();
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::setDiacritics(bool diacritics) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    if (d->impl->diacritics() == diacritics)
+        return;
+    d->writable().setDiacritics(diacritics);
+    d->publish();
+}
+
+
+
+/** ***************************************************************************/
+bool Core::OfflineIndex::diacritics() {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->impl->diacritics();
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::setShardThreshold(size_t threshold) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->shardThreshold = threshold;
+}
+
+
+
+/** ***************************************************************************/
+size_t Core::OfflineIndex::shardThreshold() {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->shardThreshold;
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::add(shared_ptr<Core::Indexable> idxble) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->writable().add(std::move(idxble));
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::build(vector<shared_ptr<Core::Indexable>> items) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    shared_ptr<IndexImpl> impl(d->emptyIndex(items.size()));
+    impl->build(std::move(items));
+    d->impl = impl;
+    d->published = false;
+    d->buildTime = millisecondsSince(start);
+}
+
+
+
+/** ***************************************************************************/
+bool Core::OfflineIndex::remove(const shared_ptr<Core::Indexable> &idxble) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    return d->writable().remove(idxble);
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::update(shared_ptr<Core::Indexable> idxble) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->writable().update(std::move(idxble));
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::commit() {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    d->publish();
+}
+
+
+
+/** ***************************************************************************/
+bool Core::OfflineIndex::save(const QString &path, const vector<shared_ptr<Core::Indexable>> &items) const {
+    shared_ptr<const IndexImpl> snapshot = std::atomic_load(&d->snapshot);
+    // Tags the files of this save, the shards of a save failing midway do not load
+    std::random_device random;
+    const uint64_t generation = static_cast<uint64_t>(random()) << 32 | random();
+    return snapshot->save(path, items, generation);
 }
 
 
 
 /** ***************************************************************************/
-void Core::OfflineIndex::add(std::shared_ptr<Core::Indexable> idxble) {
-    impl_->add(idxble);
+bool Core::OfflineIndex::load(const QString &path, vector<shared_ptr<Core::Indexable>> items) {
+    std::lock_guard<std::mutex> lock(d->mutex);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    // Sharded like the file, the item count or the cores may have changed since
+    shared_ptr<IndexImpl> impl(ShardedSearch::isSharded(path)
+                               ? new ShardedSearch(d->firstShard(), 1)
+                               : d->firstShard().cloneEmpty());
+    if (!impl->load(path, std::move(items)))
+        return false;
+    d->impl = impl;
+    d->published = false;
+    d->buildTime = millisecondsSince(start);
+    return true;
+}
+
+
+
+/** ***************************************************************************/
+void Core::OfflineIndex::removeFiles(const QString &path) {
+    ShardedSearch::removeFiles(path);
 }
 
 
 
 /** ***************************************************************************/
 void Core::OfflineIndex::clear() {
-    impl_->clear();
+    std::lock_guard<std::mutex> lock(d->mutex);
+    // Start over instead of copying what is about to be dropped
+    d->impl.reset(d->emptyIndex(0));
+    d->published = false;
+    d->buildTime = -1;
+}
+
+
+
+/** ***************************************************************************/
+vector<shared_ptr<Core::Indexable>> Core::OfflineIndex::search(const QString &req) const {
+    shared_ptr<const IndexImpl> snapshot = std::atomic_load(&d->snapshot);
+    vector<Match> matches = snapshot->search(req);
+    vector<shared_ptr<Indexable>> result;
+    result.reserve(matches.size());
+    for (const Match &match : matches)
+        result.push_back(*match.item);
+    return result;
+}
+
+
+
+/** ***************************************************************************/
+vector<pair<shared_ptr<Core::Indexable>,short>>
+Core::OfflineIndex::scoredSearch(const QString &req) const {
+    vector<pair<shared_ptr<Indexable>,short>> result;
+    Results results = matches(req);
+    result.reserve(results.size());
+    for (const Match &match : results)
+        result.emplace_back(*match.item, match.score);
+    return result;
+}
+
+
+
+/** ***************************************************************************/
+vector<pair<shared_ptr<Core::Indexable>,short>>
+Core::OfflineIndex::scoredSearch(const QString &req, size_t k) const {
+    vector<pair<shared_ptr<Indexable>,short>> result;
+    Results results = matches(req, k);
+    result.reserve(results.size());
+    for (const Match &match : results)
+        result.emplace_back(*match.item, match.score);
+    return result;
+}
+
+
+
+/** ***************************************************************************/
+Core::OfflineIndex::Results Core::OfflineIndex::matches(const QString &req) const {
+    shared_ptr<const IndexImpl> snapshot = std::atomic_load(&d->snapshot);
+    Results results;
+    results.matches_ = snapshot->search(req);
+    std::stable_sort(results.matches_.begin(), results.matches_.end(),
+                     [](const Match &lhs, const Match &rhs){
+        return lhs.tier < rhs.tier || (lhs.tier == rhs.tier && lhs.score > rhs.score);
+    });
+    results.snapshot_ = std::move(snapshot);
+    return results;
+}
+
+
+
+/** ***************************************************************************/
+Core::OfflineIndex::Results Core::OfflineIndex::matches(const QString &req, size_t k) const {
+    shared_ptr<const IndexImpl> snapshot = std::atomic_load(&d->snapshot);
+    Results results;
+    results.matches_ = snapshot->search(req, k);
+    results.snapshot_ = std::move(snapshot);
+    return results;
+}
+
+
+
+/** ***************************************************************************/
+Core::OfflineIndex::Results Core::OfflineIndex::matches(const QString &req, Session &session) const {
+    return matches(req, std::numeric_limits<size_t>::max(), session);
+}
+
+
+
+/** ***************************************************************************/
+Core::OfflineIndex::Results Core::OfflineIndex::matches(const QString &req, size_t k, Session &session) const {
+    shared_ptr<const IndexImpl> snapshot = std::atomic_load(&d->snapshot);
+
+    // Take the state of the session. It is only valid for the same snapshot.
+    shared_ptr<SearchContext> context = std::atomic_exchange(&session.context_, shared_ptr<SearchContext>());
+    if (context && context->snapshot.lock() != snapshot)
+        context.reset();
+
+    Results results;
+    results.matches_ = snapshot->search(req, k, context);
+    if (context) {
+        context->snapshot = snapshot;
+        std::atomic_store(&session.context_, context);
+    }
+    results.snapshot_ = std::move(snapshot);
+    return results;
+}
+
+
+
+/** ***************************************************************************/
+Core::OfflineIndex::Stats Core::OfflineIndex::stats() const {
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(d->mutex);
+        stats.buildTime = d->buildTime;
+    }
+    shared_ptr<const IndexImpl> snapshot = std::atomic_load(&d->snapshot);
+    snapshot->stats(stats);
+    return stats;
+}
+
+
+
+/** ***************************************************************************/
+size_t Core::OfflineIndex::Stats::bytes() const {
+    return dictionaryBytes + postingsBytes + subwordBytes + infixBytes + fuzzyBytes + facetBytes + itemBytes;
 }
 
 
 
 /** ***************************************************************************/
-std::vector<std::shared_ptr<Core::Indexable> > Core::OfflineIndex::search(const QString &req) const {
-    return impl_->search(req);
+QString Core::OfflineIndex::Stats::toString() const {
+    QStringList lines;
+    lines << QString("Items: %1").arg(items) + QString(" (%1 removed)").arg(removedItems);
+    if (shards > 1)
+        lines << QString("Shards: %1").arg(shards);
+    lines << QString("Terms: %1").arg(terms);
+    lines << QString("Postings: %1").arg(postings)
+             + QString(", longest %1").arg(longestPostings) + QString(" (\"%1\")").arg(longestTerm);
+    lines << QString("Dictionary: %1").arg(kibibytes(dictionaryBytes));
+    lines << QString("Posting lists: %1").arg(kibibytes(postingsBytes));
+    lines << QString("Sub-words: %1").arg(kibibytes(subwordBytes));
+    lines << QString("Infixes: %1").arg(kibibytes(infixBytes));
+    lines << QString("Fuzzy index: %1").arg(kibibytes(fuzzyBytes));
+    lines << QString("Facets: %1").arg(kibibytes(facetBytes));
+    lines << QString("Item vector: %1").arg(kibibytes(itemBytes));
+    lines << QString("Total: %1").arg(kibibytes(bytes()));
+    if (buildTime >= 0)
+        lines << QString("Build time: %1 ms").arg(buildTime);
+    return lines.join("\n");
 }
@@ -0,0 +1,229 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "postinglist.h"
+
+namespace {
+
+// Worst case size of a posting, a varint encoded 32 bit integer and the weight.
+// Positional postings take another byte.
+const uint32_t MAX_POSTING_SIZE = 6;
+
+}
+
+
+
+/** ***************************************************************************/
+void Core::PostingList::const_iterator::next() {
+    if ( pos_ >= end_ ) {
+        pos_ = nullptr;
+        return;
+    }
+    uint32_t delta = 0;
+    for ( uint32_t shift = 0; shift < 32; shift += 7 ) {
+        const uint8_t byte = *pos_++;
+        delta |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ( !(byte & 0x80) )
+            break;
+    }
+    current_ += delta;
+    if ( current_ >= limit_ ) {
+        pos_ = nullptr;
+        return;
+    }
+    weight_ = *pos_++;
+    if ( positional_ )
+        position_ = *pos_++;
+}
+
+
+
+/** ***************************************************************************/
+Core::PostingList::PostingList(bool positional)
+    : size_(0), last_(0), length_(0), capacity_(0), positional_(positional) {
+
+}
+
+
+
+/** ***************************************************************************/
+Core::PostingList::PostingList(const Core::PostingList &rhs)
+    : size_(rhs.size_), last_(rhs.last_), length_(0), capacity_(0), positional_(rhs.positional_) {
+    if ( rhs.capacity_ ) {
+        reserve(rhs.length_);
+        std::memcpy(heap_, rhs.heap_, rhs.length_);
+    } else
+        std::memcpy(inline_, rhs.inline_, sizeof(inline_));
+    length_ = rhs.length_;
+}
+
+
+
+/** ***************************************************************************/
+Core::PostingList::PostingList(Core::PostingList &&rhs) : PostingList() {
+    swap(*this, rhs);
+}
+
+
+
+/** ***************************************************************************/
+Core::PostingList::~PostingList() {
+    if ( capacity_ )
+        std::free(heap_);
+}
+
+
+
+/** ***************************************************************************/
+Core::PostingList &Core::PostingList::operator=(Core::PostingList rhs) {
+    swap(*this, rhs);
+    return *this;
+}
+
+
+
+/** ***************************************************************************/
+void Core::swap(Core::PostingList &lhs, Core::PostingList &rhs) {
+    std::swap(lhs.size_, rhs.size_);
+    std::swap(lhs.last_, rhs.last_);
+    std::swap(lhs.length_, rhs.length_);
+    std::swap(lhs.capacity_, rhs.capacity_);
+    std::swap(lhs.positional_, rhs.positional_);
+    uint8_t tmp[sizeof(lhs.inline_)];
+    std::memcpy(tmp, lhs.inline_, sizeof(tmp));
+    std::memcpy(lhs.inline_, rhs.inline_, sizeof(tmp));
+    std::memcpy(rhs.inline_, tmp, sizeof(tmp));
+}
+
+
+
+/** ***************************************************************************/
+void Core::PostingList::append(uint32_t id, uint8_t weight, uint8_t position) {
+
+    uint8_t *begin = capacity_ ? heap_ : inline_;
+
+    // Ids are appended in ascending order, duplicates keep the greater weight
+    // and the smaller position
+    if ( size_ != 0 && id <= last_ ) {
+        if ( id == last_ ) {
+            uint8_t *posting = begin + length_ - (positional_ ? 2 : 1);
+            if ( positional_ && (weight > posting[0] || (weight == posting[0] && position < posting[1])) )
+                posting[1] = position;
+            posting[0] = std::max(posting[0], weight);
+        }
+        return;
+    }
+
+    // Make sure the posting fits
+    const uint32_t available = capacity_ ? capacity_ : static_cast<uint32_t>(sizeof(inline_));
+    const uint32_t postingSize = MAX_POSTING_SIZE + (positional_ ? 1 : 0);
+    if ( available - length_ < postingSize ) {
+        reserve(std::max(2 * available, length_ + postingSize));
+        begin = heap_;
+    }
+
+    // Encode the delta to the last id
+    uint8_t *end = positional_ ? encode(id - last_, weight, position, begin + length_)
+                               : encode(id - last_, weight, begin + length_);
+    length_ = static_cast<uint32_t>(end - begin);
+    last_ = id;
+    ++size_;
+}
+
+
+
+/** ***************************************************************************/
+uint8_t *Core::PostingList::encode(uint32_t delta, uint8_t weight, uint8_t *out) {
+    while ( delta >= 0x80 ) {
+        *out++ = static_cast<uint8_t>(delta | 0x80);
+        delta >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(delta);
+    *out++ = weight;
+    return out;
+}
+
+
+
+/** ***************************************************************************/
+uint8_t *Core::PostingList::encode(uint32_t delta, uint8_t weight, uint8_t position, uint8_t *out) {
+    out = encode(delta, weight, out);
+    *out++ = position;
+    return out;
+}
+
+
+
+/** ***************************************************************************/
+uint32_t Core::PostingList::count(const uint8_t *begin, const uint8_t *end, bool positional) {
+    // Skip the varint, the weight and the position
+    const uint32_t skip = positional ? 2 : 1;
+    uint32_t count = 0;
+    while ( begin < end ) {
+        while ( begin < end && (*begin++ & 0x80) ) {}
+        begin += skip;
+        ++count;
+    }
+    return count;
+}
+
+
+
+/** ***************************************************************************/
+void Core::PostingList::squeeze() {
+    if ( capacity_ == 0 || capacity_ == length_ )
+        return;
+    if ( length_ <= sizeof(inline_) ) {
+        uint8_t *heap = heap_;
+        std::memcpy(inline_, heap, length_);
+        std::free(heap);
+        capacity_ = 0;
+    } else {
+        heap_ = static_cast<uint8_t*>(std::realloc(heap_, length_));
+        capacity_ = length_;
+    }
+}
+
+
+
+/** ***************************************************************************/
+Core::PostingList::const_iterator Core::PostingList::begin() const {
+    return const_iterator(data(), data() + length_, positional_);
+}
+
+
+
+/** ***************************************************************************/
+Core::PostingList::const_iterator Core::PostingList::end() const {
+    return const_iterator();
+}
+
+
+
+/** ***************************************************************************/
+void Core::PostingList::reserve(uint32_t capacity) {
+    if ( capacity_ ) {
+        heap_ = static_cast<uint8_t*>(std::realloc(heap_, capacity));
+    } else {
+        uint8_t *heap = static_cast<uint8_t*>(std::malloc(capacity));
+        std::memcpy(heap, inline_, length_);
+        heap_ = heap;
+    }
+    capacity_ = capacity;
+}
@@ -0,0 +1,162 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cstdint>
+#include <iterator>
+
+namespace Core {
+
+/**
+ * @brief The PostingList class
+ * A sorted list of item ids stored as delta encoded varints, each followed by
+ * a byte holding the weight of the posting. Ids have to be appended in
+ * ascending order, which is naturally the case since the index assigns them
+ * incrementally. Short lists (the vast majority of terms map to one or two
+ * items) are stored inline without a heap allocation.
+ *
+ * Positional lists store a third byte per posting, the position of the term
+ * in the keywords of the item (see Scoring::position).
+ */
+class PostingList final
+{
+public:
+
+    class const_iterator : public std::iterator<std::forward_iterator_tag, uint32_t>
+    {
+    public:
+        const_iterator()
+            : pos_(nullptr), end_(nullptr), limit_(UINT32_MAX), current_(0), weight_(0), position_(0),
+              positional_(false) {}
+        /**
+         * @param limit Ids have to be less, the list ends before a greater
+         * one. Bounds the ids of lists read from a file.
+         */
+        const_iterator(const uint8_t *pos, const uint8_t *end, bool positional = false, uint32_t limit = UINT32_MAX)
+            : pos_(pos), end_(end), limit_(limit), current_(0), weight_(0), position_(0),
+              positional_(positional) { next(); }
+
+        inline uint32_t operator*() const { return current_; }
+        inline uint8_t weight() const { return weight_; }
+        inline uint8_t position() const { return position_; } // 0 if the list is not positional
+        inline const_iterator &operator++() { next(); return *this; }
+        inline const_iterator operator++(int) { const_iterator tmp(*this); next(); return tmp; }
+        inline bool operator==(const const_iterator &rhs) const { return pos_ == rhs.pos_; }
+        inline bool operator!=(const const_iterator &rhs) const { return pos_ != rhs.pos_; }
+
+    private:
+        void next();
+        const uint8_t *pos_; // Behind the current value, null if past the end
+        const uint8_t *end_;
+        uint32_t limit_;
+        uint32_t current_;
+        uint8_t weight_;
+        uint8_t position_;
+        bool positional_;
+    };
+
+    explicit PostingList(bool positional = false);
+    PostingList(const PostingList &rhs);
+    PostingList(PostingList &&rhs);
+    ~PostingList();
+    PostingList &operator=(PostingList rhs);
+
+    /**
+     * @brief Appends an id to the list
+     * Ids smaller than the last id are ignored. If id equals the last id the
+     * greater weight is kept, on equal weights the smaller position.
+     * @param id The id to append
+     * @param weight The weight of the posting
+     * @param position The position of the posting, ignored if the list is not
+     * positional
+     */
+    void append(uint32_t id, uint8_t weight, uint8_t position = 0);
+
+    /**
+     * @brief The number of ids in the list
+     */
+    inline uint32_t size() const { return size_; }
+
+    /**
+     * @brief Checks if the list is empty
+     */
+    inline bool empty() const { return size_ == 0; }
+
+    /**
+     * @brief The last (greatest) id in the list
+     */
+    inline uint32_t back() const { return last_; }
+
+    /**
+     * @brief Whether the postings store their position
+     */
+    inline bool positional() const { return positional_; }
+
+    /**
+     * @brief The bytes allocated on the heap by this list
+     */
+    inline uint32_t heapSize() const { return capacity_; }
+
+    /**
+     * @brief Releases unused capacity
+     */
+    void squeeze();
+
+    /**
+     * @brief Encodes a posting
+     * @param delta The difference to the previous id
+     * @param weight The weight of the posting
+     * @param out The buffer to write to. Has to provide at least 6 bytes.
+     * @return The position behind the encoded posting
+     */
+    static uint8_t *encode(uint32_t delta, uint8_t weight, uint8_t *out);
+
+    /**
+     * @brief Encodes a positional posting
+     * @param out The buffer to write to. Has to provide at least 7 bytes.
+     * @see encode
+     */
+    static uint8_t *encode(uint32_t delta, uint8_t weight, uint8_t position, uint8_t *out);
+
+    /**
+     * @brief Counts the postings of an encoded list without decoding them
+     */
+    static uint32_t count(const uint8_t *begin, const uint8_t *end, bool positional);
+
+    const_iterator begin() const;
+    const_iterator end() const;
+
+    friend void swap(PostingList &lhs, PostingList &rhs);
+
+private:
+
+    inline const uint8_t *data() const { return capacity_ ? heap_ : inline_; }
+    void reserve(uint32_t capacity);
+
+    uint32_t size_;
+    uint32_t last_;
+    uint32_t length_;   // Encoded bytes
+    uint32_t capacity_; // Heap capacity, 0 if stored inline
+    bool positional_;
+    union {
+        uint8_t *heap_;
+        uint8_t inline_[sizeof(uint8_t*)];
+    };
+};
+
+void swap(PostingList &lhs, PostingList &rhs);
+
+}
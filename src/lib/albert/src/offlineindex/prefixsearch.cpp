@@ -14,20 +14,36 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
-#include <QRegularExpression>
+#include <QFile>
+#include <QtConcurrent>
 #include <algorithm>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <queue>
+#include <unordered_map>
 #include "indeximpl.h"
 #include "indexable.h"
+#include "intersection.h"
 #include "prefixsearch.h"
-using std::map;
-using std::set;
+#include "scoring.h"
+using std::pair;
 using std::shared_ptr;
 using std::vector;
 
+namespace {
+
+// Number of items tokenized by a task of a bulk build
+const uint32_t BUILD_SHARD_SIZE = 4096;
+
+}
+
 
 
 /** ***************************************************************************/
-Core::PrefixSearch::PrefixSearch(){
+Core::PrefixSearch::PrefixSearch()
+    : removedCount_(0), subwords_(false), infix_(false), infixBuilt_(false), facetsBuilt_(true),
+      fuzzyFallback_(0), positions_(false) {
 
 }
 
@@ -35,8 +51,24 @@ Core::PrefixSearch::PrefixSearch(){
 
 /** ***************************************************************************/
 Core::PrefixSearch::PrefixSearch(const Core::PrefixSearch &rhs) {
+    tokenizer_ = rhs.tokenizer_;
     index_ = rhs.index_;
+    ids_ = rhs.ids_;
+    removedCount_ = rhs.removedCount_;
     invertedIndex_ = rhs.invertedIndex_;
+    subwords_ = rhs.subwords_;
+    subwordIndex_ = rhs.subwordIndex_;
+    infix_ = rhs.infix_;
+    {
+        // Searches may be building the indexes of rhs meanwhile
+        std::lock_guard<std::mutex> lock(rhs.lazyMutex_);
+        infixIndex_ = rhs.infixIndex_;
+        infixBuilt_ = rhs.infixBuilt_.load();
+        facetIndex_ = rhs.facetIndex_;
+        facetsBuilt_ = rhs.facetsBuilt_.load();
+    }
+    fuzzyFallback_ = rhs.fuzzyFallback_;
+    positions_ = rhs.positions_;
 }
 
 
@@ -46,21 +78,154 @@ Core::PrefixSearch::~PrefixSearch(){}
 
 
 
+/** ***************************************************************************/
+Core::PrefixSearch *Core::PrefixSearch::clone() const {
+    return new PrefixSearch(*this);
+}
+
+
+
+/** ***************************************************************************/
+Core::PrefixSearch *Core::PrefixSearch::cloneEmpty() const {
+    PrefixSearch *prefixSearch = new PrefixSearch();
+    prefixSearch->tokenizer_ = tokenizer_;
+    prefixSearch->subwords_ = subwords_;
+    prefixSearch->infix_ = infix_;
+    prefixSearch->fuzzyFallback_ = fuzzyFallback_;
+    prefixSearch->positions_ = positions_;
+    prefixSearch->invertedIndex_ = TermDictionary(positions_, diacritics());
+    return prefixSearch;
+}
+
+
+
 /** ***************************************************************************/
 void Core::PrefixSearch::add(shared_ptr<Core::Indexable> indexable) {
 
     // Add indexable to the index
     index_.push_back(indexable);
     uint id = static_cast<uint>(index_.size()-1);
+    ids_[indexable.get()] = id;
 
     vector<Indexable::WeightedKeyword> indexKeywords = indexable->indexKeywords();
+    uint32_t keywordIndex = 0;
     for (const auto &wkw : indexKeywords) {
         // Build an inverted index
-        QStringList words = wkw.keyword.split(QRegularExpression(SEPARATOR_REGEX), QString::SkipEmptyParts);
-        for (const QString &w : words) {
-            invertedIndex_[w.toLower()].insert(id);
+        uint8_t weight = Scoring::weight(wkw.relevance);
+        uint32_t wordIndex = 0;
+        tokenizer_.tokenize(wkw.keyword, [this, id, weight, keywordIndex, &wordIndex](const QString &w){
+            if (infix_)
+                addInfixTerm(w);
+            invertedIndex_.add(w, id, weight, Scoring::position(keywordIndex, wordIndex++));
+        });
+        if (subwords_)
+            addSubwords(wkw.keyword, id, weight);
+        ++keywordIndex;
+    }
+    // A facet index not built yet will get the facets from the items
+    if (facetsBuilt_)
+        facetIndex_.add(indexable->indexFacets(), id);
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::build(vector<shared_ptr<Core::Indexable>> items) {
+
+    clear();
+    index_ = std::move(items);
+    for (uint32_t i = 0; i < static_cast<uint32_t>(index_.size()); ++i)
+        ids_[index_[i].get()] = i;
+
+    // Tokenize and sort consecutive ranges of items concurrently
+    struct Shard {
+        uint32_t begin;
+        uint32_t end;
+        TermDictionary dictionary;
+        TermDictionary subwordDictionary;
+        FacetIndex facets;
+    };
+    vector<Shard> shards;
+    for (uint32_t begin = 0; begin < static_cast<uint32_t>(index_.size()); begin += BUILD_SHARD_SIZE)
+        shards.push_back({begin, std::min(begin + BUILD_SHARD_SIZE, static_cast<uint32_t>(index_.size())),
+                          TermDictionary(positions_, diacritics()), TermDictionary(), FacetIndex()});
+    QtConcurrent::blockingMap(shards, [this](Shard &shard){
+        vector<TermDictionary::Posting> postings, subwordPostings;
+        for (uint32_t id = shard.begin; id < shard.end; ++id) {
+            uint32_t keywordIndex = 0;
+            for (const auto &wkw : index_[id]->indexKeywords()) {
+                uint8_t weight = Scoring::weight(wkw.relevance);
+                uint32_t wordIndex = 0;
+                tokenizer_.tokenize(wkw.keyword, [&postings, id, weight, keywordIndex, &wordIndex](const QString &w){
+                    postings.push_back({w, id, weight, Scoring::position(keywordIndex, wordIndex++)});
+                });
+                if (subwords_)
+                    for (const QString &w : tokenizer_.subwords(wkw.keyword))
+                        subwordPostings.push_back({w, id, weight, 0});
+                ++keywordIndex;
+            }
+            shard.facets.add(index_[id]->indexFacets(), id);
         }
+        shard.dictionary.add(postings);
+        shard.subwordDictionary.add(subwordPostings);
+    });
+
+    // Merge neighbouring shards pairwise, the ids of the right one are greater
+    while (shards.size() > 1) {
+        vector<size_t> lefts;
+        for (size_t i = 0; i + 1 < shards.size(); i += 2)
+            lefts.push_back(i);
+        QtConcurrent::blockingMap(lefts, [&shards](size_t i){
+            shards[i].dictionary.append(shards[i+1].dictionary);
+            shards[i].subwordDictionary.append(shards[i+1].subwordDictionary);
+            shards[i].facets.append(shards[i+1].facets);
+        });
+        for (size_t i = 2; i < shards.size(); i += 2) {
+            shards[i/2].dictionary = std::move(shards[i].dictionary);
+            shards[i/2].subwordDictionary = std::move(shards[i].subwordDictionary);
+            shards[i/2].facets = std::move(shards[i].facets);
+        }
+        shards.resize((shards.size() + 1) / 2);
+    }
+
+    if (!shards.empty()) {
+        invertedIndex_ = std::move(shards.front().dictionary);
+        subwordIndex_ = std::move(shards.front().subwordDictionary);
+        facetIndex_ = std::move(shards.front().facets);
     }
+    facetsBuilt_ = true;
+    invalidateInfixIndex();
+}
+
+
+
+/** ***************************************************************************/
+bool Core::PrefixSearch::remove(const shared_ptr<Core::Indexable> &indexable) {
+
+    std::unordered_map<const Indexable*,uint32_t>::iterator it = ids_.find(indexable.get());
+    if (it == ids_.end())
+        return false;
+
+    // Leave a tombstone, the postings are dropped when compacting
+    index_[it->second].reset();
+    ids_.erase(it);
+    ++removedCount_;
+
+    // Compacting is linear in the size of the index. Doing it once half of
+    // the items are dead keeps the amortized cost of a removal constant.
+    if (removedCount_ > index_.size() / 2)
+        compact();
+
+    return true;
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::update(shared_ptr<Core::Indexable> indexable) {
+    // Ids have to be ascending in the posting lists, reindex as a new item
+    remove(indexable);
+    add(std::move(indexable));
 }
 
 
@@ -68,61 +233,930 @@ void Core::PrefixSearch::add(shared_ptr<Core::Indexable> indexable) {
 /** ***************************************************************************/
 void Core::PrefixSearch::clear() {
     invertedIndex_.clear();
+    subwordIndex_.clear();
+    invalidateInfixIndex();
+    facetIndex_.clear();
+    facetsBuilt_ = true;
     index_.clear();
+    ids_.clear();
+    removedCount_ = 0;
+}
+
+
+
+/** ***************************************************************************/
+bool Core::PrefixSearch::save(const QString &path, const vector<shared_ptr<Indexable>> &items,
+                              uint64_t generation) const {
+
+    // Store the positions in items as ids
+    if (items.size() != ids_.size())
+        return false;
+    vector<uint32_t> ids(index_.size(), TermDictionary::REMOVED);
+    for (uint32_t i = 0; i < static_cast<uint32_t>(items.size()); ++i) {
+        std::unordered_map<const Indexable*,uint32_t>::const_iterator it = ids_.find(items[i].get());
+        if (it == ids_.end() || ids[it->second] != TermDictionary::REMOVED)
+            return false;
+        ids[it->second] = i;
+    }
+    if (!invertedIndex_.save(path, ids, static_cast<uint32_t>(items.size()), generation))
+        return false;
+
+    // The sub-words are saved along, see load
+    return !subwords_ || subwordIndex_.save(path + ".subwords", ids, static_cast<uint32_t>(items.size()),
+                                            generation);
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::removeFiles(const QString &path) {
+    // Sub-words and the tables of fuzzy searches are saved along
+    QFile::remove(path);
+    QFile::remove(path + ".subwords");
+    QFile::remove(path + ".fuzzy");
+}
+
+
+
+/** ***************************************************************************/
+bool Core::PrefixSearch::load(const QString &path, vector<shared_ptr<Indexable>> items) {
+
+    if (!invertedIndex_.load(path, static_cast<uint32_t>(items.size())))
+        return false;
+
+    index_ = std::move(items);
+    ids_.clear();
+    for (uint32_t i = 0; i < static_cast<uint32_t>(index_.size()); ++i)
+        ids_[index_[i].get()] = i;
+    removedCount_ = 0;
+
+    // Map the sub-words saved along, rebuild them if they are missing or
+    // stale. The infix and facet indexes are built when first queried.
+    if (subwords_ && !(subwordIndex_.load(path + ".subwords", static_cast<uint32_t>(index_.size()))
+                       && subwordIndex_.generation() == invertedIndex_.generation()))
+        buildSubwordIndex();
+    invalidateInfixIndex();
+    invalidateFacetIndex();
+    return true;
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::compact() {
+
+    // Renumber the remaining items keeping their order
+    vector<uint32_t> ids(index_.size(), TermDictionary::REMOVED);
+    uint32_t id = 0;
+    for (uint32_t i = 0; i < static_cast<uint32_t>(index_.size()); ++i) {
+        if (removed(i))
+            continue;
+        ids[i] = id;
+        if (id != i) {
+            index_[id] = std::move(index_[i]);
+            ids_[index_[id].get()] = id;
+        }
+        ++id;
+    }
+    index_.erase(index_.begin() + id, index_.end());
+    invertedIndex_.remap(ids);
+    subwordIndex_.remap(ids);
+    facetIndex_.remap(ids);
+    removedCount_ = 0;
+
+    // Drops the terms left without postings
+    invalidateInfixIndex();
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::stats(OfflineIndex::Stats &stats) const {
+
+    TermDictionary::Shape shape = invertedIndex_.shape();
+    stats.shards = 1;
+    stats.items = index_.size();
+    stats.removedItems = removedCount_;
+    stats.terms = shape.terms;
+    stats.postings = shape.postings;
+    stats.longestPostings = shape.longestPostings;
+    stats.longestTerm = shape.longestTerm;
+    stats.dictionaryBytes = shape.termBytes;
+    stats.postingsBytes = shape.postingBytes;
+
+    shape = subwordIndex_.shape();
+    stats.subwordBytes = shape.termBytes + shape.postingBytes;
+    {
+        std::lock_guard<std::mutex> lock(lazyMutex_);
+        stats.infixBytes = infixIndex_.heapSize();
+        stats.facetBytes = facetIndex_.heapSize();
+    }
+    stats.fuzzyBytes = 0;
+
+    // The items are owned by the extensions. A hash node holds the entry and
+    // the pointer to the next node.
+    stats.itemBytes = index_.capacity() * sizeof(shared_ptr<Indexable>)
+            + ids_.bucket_count() * sizeof(void*)
+            + ids_.size() * (sizeof(void*) + sizeof(std::unordered_map<const Indexable*,uint32_t>::value_type));
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::setSubwords(bool subwords) {
+    if (subwords_ == subwords)
+        return;
+    subwords_ = subwords;
+    buildSubwordIndex();
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::addSubwords(const QString &keyword, uint32_t id, uint8_t weight) {
+    for (const QString &w : tokenizer_.subwords(keyword))
+        subwordIndex_.add(w, id, weight);
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::buildSubwordIndex() {
+    subwordIndex_.clear();
+    if (!subwords_)
+        return;
+    vector<TermDictionary::Posting> postings;
+    for (uint32_t id = 0; id < static_cast<uint32_t>(index_.size()); ++id) {
+        if (removed(id))
+            continue;
+        for (const auto &wkw : index_[id]->indexKeywords()) {
+            uint8_t weight = Scoring::weight(wkw.relevance);
+            for (const QString &w : tokenizer_.subwords(wkw.keyword))
+                postings.push_back({w, id, weight, 0});
+        }
+    }
+    subwordIndex_.add(postings);
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::subwordPostings(const QString &word, const vector<ScoredId> *candidates,
+                                        vector<ScoredId> &postings) const {
+    // Sub-word matches are worse than any prefix match of a whole word
+    if (!subwords_)
+        return;
+    auto quality = [&word](const Term &term){
+        return Scoring::subwordQuality(static_cast<uint32_t>(word.size()), term.size());
+    };
+    vector<ScoredId> subwordMatches;
+    if (candidates)
+        subwordIndex_.prefixPostings(word, quality, *candidates, subwordMatches);
+    else
+        subwordIndex_.prefixPostings(word, quality, subwordMatches);
+    unite(postings, subwordMatches);
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::setPositions(bool positions) {
+    if (positions_ == positions)
+        return;
+    positions_ = positions;
+
+    // Every posting changes
+    rebuild();
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::setDiacritics(bool diacritics) {
+    if (this->diacritics() == diacritics)
+        return;
+    tokenizer_ = Tokenizer(!diacritics);
+
+    // Every term changes
+    rebuild();
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::rebuild() {
+    // Builds the index of the remaining items from scratch
+    vector<shared_ptr<Indexable>> items;
+    items.reserve(ids_.size());
+    for (const shared_ptr<Indexable> &item : index_)
+        if (item)
+            items.push_back(item);
+    invertedIndex_ = TermDictionary(positions_, diacritics());
+    build(std::move(items));
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::setInfix(bool infix) {
+    if (infix_ == infix)
+        return;
+    infix_ = infix;
+    invalidateInfixIndex();
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::addInfixTerm(const QString &term) {
+    // An infix index not built yet will get the term from the dictionary
+    if (!infixBuilt_)
+        return;
+    bool known = false;
+    invertedIndex_.visitTerm(term, [&known](const Term &, PostingList::const_iterator,
+                                            PostingList::const_iterator){ known = true; });
+    if (!known)
+        infixIndex_.add(term);
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::invalidateInfixIndex() {
+    infixIndex_.clear();
+    infixBuilt_ = false;
+}
+
+
+
+/** ***************************************************************************/
+const Core::InfixIndex &Core::PrefixSearch::infixIndex() const {
+    // Concurrent searches of a snapshot build it once
+    if (infixBuilt_.load(std::memory_order_acquire))
+        return infixIndex_;
+    std::lock_guard<std::mutex> lock(lazyMutex_);
+    if (!infixBuilt_.load(std::memory_order_relaxed)) {
+        vector<QString> terms;
+        invertedIndex_.visitAll([&terms](const Term &term, PostingList::const_iterator begin,
+                                         PostingList::const_iterator end){
+            if (begin != end)
+                terms.push_back(term.toString());
+        });
+        infixIndex_.assign(std::move(terms));
+        infixBuilt_.store(true, std::memory_order_release);
+    }
+    return infixIndex_;
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::infixPostings(const QString &word, const vector<ScoredId> *candidates,
+                                      vector<ScoredId> &postings) const {
+    // Infix matches are worse than any prefix match of a whole word
+    if (!infix_)
+        return;
+    vector<ScoredId> infixMatches;
+    infixIndex().visitInfix(word, [this, &word, candidates, &infixMatches](const Term &term){
+        uint32_t quality = Scoring::infixQuality(static_cast<uint32_t>(word.size()), term.size());
+        invertedIndex_.visitTerm(term, [candidates, &infixMatches, quality](const Term &,
+                                 PostingList::const_iterator begin, PostingList::const_iterator end){
+            // Both are sorted by id, keep the postings of candidates only
+            vector<ScoredId>::const_iterator candidate;
+            if (candidates)
+                candidate = candidates->begin();
+            for ( ; begin != end; ++begin ) {
+                if (candidates) {
+                    candidate = std::lower_bound(candidate, candidates->end(), *begin,
+                                                 [](const ScoredId &lhs, uint32_t rhs){ return lhs.id < rhs; });
+                    if (candidate == candidates->end())
+                        break;
+                    if (candidate->id != *begin)
+                        continue;
+                }
+                infixMatches.emplace_back(*begin, Scoring::wordScore(begin.weight(), quality, begin.position()));
+            }
+        });
+    });
+    sortUnique(infixMatches);
+    unite(postings, infixMatches);
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::invalidateFacetIndex() {
+    facetIndex_.clear();
+    facetsBuilt_ = false;
+}
+
+
+
+/** ***************************************************************************/
+const Core::FacetIndex &Core::PrefixSearch::facetIndex() const {
+    // Concurrent searches of a snapshot build it once
+    if (facetsBuilt_.load(std::memory_order_acquire))
+        return facetIndex_;
+    std::lock_guard<std::mutex> lock(lazyMutex_);
+    if (!facetsBuilt_.load(std::memory_order_relaxed)) {
+        for (uint32_t id = 0; id < static_cast<uint32_t>(index_.size()); ++id)
+            if (!removed(id))
+                facetIndex_.add(index_[id]->indexFacets(), id);
+        facetsBuilt_.store(true, std::memory_order_release);
+    }
+    return facetIndex_;
+}
+
+
+
+/** ***************************************************************************/
+QStringList Core::PrefixSearch::parse(const QString &req, vector<QueryParser::Operator> &operators) const {
+    // Only the names of facets of the items are operators
+    QString text = QueryParser::parse(req, [this](const QString &name){ return facetIndex().contains(name); },
+                                      operators);
+    return tokenizer_.tokenize(text);
 }
 
 
 
 /** ***************************************************************************/
-vector<shared_ptr<Core::Indexable> > Core::PrefixSearch::search(const QString &req) const {
+vector<Core::ScoredId> Core::PrefixSearch::filter(const vector<QueryParser::Operator> &operators) const {
 
+    // Unite the ids per facet, subtract the excluded ones from the intersection
+    std::map<QString,Bitmap> included;
+    Bitmap excluded;
+    for (const QueryParser::Operator &op : operators) {
+        if (op.negated)
+            excluded.unite(facetIndex().match(op.name, op.value));
+        else
+            included[op.name].unite(facetIndex().match(op.name, op.value));
+    }
+
+    vector<ScoredId> candidates;
+    if (included.empty()) {
+        for (uint32_t id = 0; id < static_cast<uint32_t>(index_.size()); ++id)
+            if (!removed(id) && !excluded.contains(id))
+                candidates.emplace_back(id, 0);
+        return candidates;
+    }
+
+    Bitmap ids = std::move(included.begin()->second);
+    for (auto it = std::next(included.begin()); it != included.end() && !ids.empty(); ++it)
+        ids.intersect(it->second);
+    ids.subtract(excluded);
+    candidates.reserve(ids.size());
+    ids.visit([&candidates](uint32_t id){ candidates.emplace_back(id, 0); });
+    dropRemoved(candidates);
+    return candidates;
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::dropRemoved(vector<ScoredId> &matches) const {
+    if (removedCount_ == 0)
+        return;
+    matches.erase(std::remove_if(matches.begin(), matches.end(),
+                                 [this](const ScoredId &match){ return removed(match.id); }),
+                  matches.end());
+}
+
+
+
+/** ***************************************************************************/
+vector<Core::OfflineIndex::Match> Core::PrefixSearch::search(const QString &req) const {
 
-    // Split the query into words W
-    QStringList words = req.split(QRegularExpression(SEPARATOR_REGEX), QString::SkipEmptyParts);
+    // Split the query into facet operators and words W, normalized like the keywords
+    vector<QueryParser::Operator> operators;
+    QStringList words = parse(req, operators);
 
     // Skip if there arent any // CONSTRAINT (2): |W| > 0
-    if (words.empty())
-        return vector<shared_ptr<Indexable>>();
+    if (words.empty() && operators.empty())
+        return vector<OfflineIndex::Match>();
+
+    // Facets restrict the postings before any item is touched
+    vector<ScoredId> candidates;
+    if (!operators.empty())
+        candidates = filter(operators);
+    const vector<ScoredId> *restriction = operators.empty() ? nullptr : &candidates;
+
+    if (!fuzzy() || fuzzyFallback_ == 0) {
+        vector<ScoredId> matches = match(words, restriction);
+        return toMatches(matches, fuzzy() ? 0 : matches.size());
+    }
+
+    // The fuzzy stage adds its other matches if the exact stage falls short
+    vector<ScoredId> matches = match(words, restriction, true);
+    const size_t exactMatches = matches.size();
+    if (exactMatches < fuzzyFallback_ && !words.empty()) {
+        vector<ScoredId> fuzzyMatches = match(words, restriction);
+        subtract(fuzzyMatches, matches);
+        matches.insert(matches.end(), fuzzyMatches.begin(), fuzzyMatches.end());
+    }
+    return toMatches(matches, exactMatches);
+}
+
+
+
+/** ***************************************************************************/
+vector<Core::OfflineIndex::Match> Core::PrefixSearch::search(const QString &req, size_t k) const {
+
+    // Split the query into facet operators and words W, normalized like the keywords
+    vector<QueryParser::Operator> operators;
+    QStringList words = parse(req, operators);
+
+    // Skip if there arent any // CONSTRAINT (2): |W| > 0
+    if ((words.empty() && operators.empty()) || k == 0)
+        return vector<OfflineIndex::Match>();
+
+    // Only the items of the best matches are touched
+    vector<ScoredId> candidates;
+    if (!operators.empty())
+        candidates = filter(operators);
+    const bool cascade = fuzzy() && fuzzyFallback_ != 0;
+    vector<ScoredId> matches;
+    if (operators.empty())
+        matches = cascade ? PrefixSearch::topMatches(words, k) : topMatches(words, k);
+    else {
+        matches = match(words, &candidates, cascade);
+        selectTop(matches, k);
+    }
+    if (!cascade)
+        return toMatches(matches, fuzzy() ? 0 : matches.size());
+
+    // The fuzzy stage fills up the list if the exact stage falls short
+    const size_t exactMatches = matches.size();
+    if (exactMatches < std::min(fuzzyFallback_, k) && !words.empty())
+        fillUp(words, operators.empty() ? nullptr : &candidates, k, matches);
+    return toMatches(matches, exactMatches);
+}
+
+
+
+/** ***************************************************************************/
+struct Core::PrefixSearch::Stage
+{
+    // The words of the last query
+    QStringList words;
+    // The sets U_w of all but the last word, restricted to the results
+    vector<vector<ScoredId>> wordMappingsUnions;
+    // The intersection of the sets, scored by the sums of the word scores
+    vector<ScoredId> results;
+};
 
-    set<uint> resultsSet;
-    QStringList::iterator wordIterator = words.begin();
 
-    // Make lower for case insensitivity
-    QString word = wordIterator++->toLower();
 
-    // Get a word mapping once before going to handle intersections
-    for (std::map<QString,std::set<uint>>::const_iterator lb = invertedIndex_.lower_bound(word);
-         lb != invertedIndex_.cend() && lb->first.startsWith(word); ++lb)
-        resultsSet.insert(lb->second.begin(), lb->second.end());
+/** ***************************************************************************/
+struct Core::PrefixSearch::Context : public SearchContext
+{
+    // The facet operators of the last query and the items passing them
+    vector<QueryParser::Operator> operators;
+    vector<ScoredId> candidates;
+    // The search, its exact stage if there is a fuzzy fallback
+    Stage stage;
+    // The fuzzy stage of a fallback, last run for the words it holds
+    Stage fallback;
+};
+
 
 
-    for (;wordIterator != words.end(); ++wordIterator) {
+/** ***************************************************************************/
+vector<Core::OfflineIndex::Match> Core::PrefixSearch::search(const QString &req, size_t k,
+                                                             shared_ptr<SearchContext> &context) const {
 
-        // Make lower for case insensitivity
-        word = wordIterator->toLower();
+    // Split the query into facet operators and words W, normalized like the keywords
+    vector<QueryParser::Operator> operators;
+    QStringList words = parse(req, operators);
 
-        // Unite the sets that are mapped by words that begin with word
-        // w ∈ W. This set is called U_w
-        set<uint> wordMappingsUnion;
-        for (std::map<QString,std::set<uint>>::const_iterator lb = invertedIndex_.lower_bound(word);
-             lb != invertedIndex_.cend() && lb->first.startsWith(word); ++lb)
-            wordMappingsUnion.insert(lb->second.begin(), lb->second.end());
+    // Skip if there arent any // CONSTRAINT (2): |W| > 0
+    if ((words.empty() && operators.empty()) || k == 0) {
+        context.reset();
+        return vector<OfflineIndex::Match>();
+    }
 
+    // Sorted by id, a stable sort keeps the order of ties
+    auto rank = [](vector<ScoredId> &matches, size_t k){
+        if (k < matches.size())
+            selectTop(matches, k);
+        else
+            std::stable_sort(matches.begin(), matches.end(), [](const ScoredId &lhs, const ScoredId &rhs){
+                return lhs.score > rhs.score;
+            });
+    };
 
-        // Intersect all sets U_w with the results
-        set<uint> intersection;
-        std::set_intersection(resultsSet.begin(), resultsSet.end(),
-                              wordMappingsUnion.begin(), wordMappingsUnion.end(),
-                              std::inserter(intersection, intersection.begin()));
-        resultsSet = std::move(intersection);
+    const bool cascade = fuzzy() && fuzzyFallback_ != 0;
+    vector<ScoredId> matches;
+    size_t exactMatches;
+    if (operators.empty() && words.size() == 1 && words.front().size() == 1 && k < index_.size()) {
+        // A single code unit matches most of the index, too many to remember.
+        // Rank it like a plain search, the session starts with the next one.
+        context.reset();
+        matches = cascade ? PrefixSearch::topMatches(words, k) : topMatches(words, k);
+        exactMatches = matches.size();
+        if (cascade && exactMatches < std::min(fuzzyFallback_, k))
+            fillUp(words, nullptr, k, matches);
+    } else {
+        // Contexts are only passed back to the snapshot that created them
+        if (!context)
+            context = std::make_shared<Context>();
+        Context &ctx = static_cast<Context&>(*context);
+        // The items passing the operators are kept as long as they are unchanged
+        if (ctx.operators != operators) {
+            ctx.operators = std::move(operators);
+            ctx.candidates = ctx.operators.empty() ? vector<ScoredId>() : filter(ctx.operators);
+            ctx.stage.words.clear();
+            ctx.fallback.words.clear();
+        }
+        const vector<ScoredId> *candidates = ctx.operators.empty() ? nullptr : &ctx.candidates;
+        matches = match(words, candidates, ctx.stage, cascade);
+        exactMatches = matches.size();
+        if (cascade && exactMatches < std::min(fuzzyFallback_, k) && !words.empty()) {
+            // The fuzzy stage narrows its own matches while the user types
+            vector<ScoredId> fuzzyMatches = match(words, candidates, ctx.fallback, false);
+            subtract(fuzzyMatches, matches);
+            rank(matches, k);
+            rank(fuzzyMatches, k - exactMatches);
+            matches.insert(matches.end(), fuzzyMatches.begin(), fuzzyMatches.end());
+        } else
+            rank(matches, k);
+        exactMatches = std::min(exactMatches, k);
     }
+    if (!cascade)
+        exactMatches = fuzzy() ? 0 : matches.size();
+    return toMatches(matches, exactMatches);
+}
+
+
 
-    // Convert to a std::vector
+/** ***************************************************************************/
+void Core::PrefixSearch::fillUp(const QStringList &words, const vector<ScoredId> *candidates,
+                                size_t k, vector<ScoredId> &matches) const {
+    /*
+     * The exact matches are less than k, hence all there are. Fuzzy matches
+     * usually include them, rank enough to fill the list without them.
+     */
+    const size_t exactMatches = matches.size();
+    vector<ScoredId> fuzzyMatches;
+    if (candidates) {
+        fuzzyMatches = match(words, candidates);
+        selectTop(fuzzyMatches, k + exactMatches);
+    } else
+        fuzzyMatches = topMatches(words, k + exactMatches);
+
+    vector<ScoredId> exactIds = matches;
+    std::sort(exactIds.begin(), exactIds.end(), [](const ScoredId &lhs, const ScoredId &rhs){
+        return lhs.id < rhs.id;
+    });
+    subtract(fuzzyMatches, exactIds);
+    if (fuzzyMatches.size() > k - exactMatches)
+        fuzzyMatches.erase(fuzzyMatches.begin() + static_cast<long>(k - exactMatches), fuzzyMatches.end());
+    matches.insert(matches.end(), fuzzyMatches.begin(), fuzzyMatches.end());
+}
 
 
 
-    vector<shared_ptr<Indexable>> resultsVector;
-    for (uint id : resultsSet)
-        resultsVector.emplace_back(index_.at(id));
+/** ***************************************************************************/
+vector<Core::OfflineIndex::Match> Core::PrefixSearch::toMatches(const vector<ScoredId> &matches,
+                                                                size_t exactMatches) const {
+    // The exact matches lead, the ones of the fuzzy stage follow
+    vector<OfflineIndex::Match> resultsVector;
+    resultsVector.reserve(matches.size());
+    for (size_t i = 0; i < matches.size(); ++i)
+        resultsVector.push_back({&index_[matches[i].id], static_cast<short>(matches[i].score),
+                                 (i < exactMatches) ? OfflineIndex::Tier::Exact : OfflineIndex::Tier::Fuzzy});
     return resultsVector;
 }
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::wordPostings(const QString &word, const vector<ScoredId> *candidates,
+                                      vector<ScoredId> &postings) const {
+
+    // The match quality of a term only depends on the length of the word
+    auto quality = [&word](const Term &term){
+        return Scoring::prefixQuality(static_cast<uint32_t>(word.size()), term.size());
+    };
+
+    if (candidates)
+        invertedIndex_.prefixPostings(word, quality, *candidates, postings);
+    else
+        invertedIndex_.prefixPostings(word, quality, postings);
+    subwordPostings(word, candidates, postings);
+    infixPostings(word, candidates, postings);
+}
+
+
+
+/** ***************************************************************************/
+bool Core::PrefixSearch::narrows(const QString &word, const QString &previous) const {
+    // Words shorter than InfixIndex::MIN_LENGTH do not match infixes
+    return word.startsWith(previous)
+            && (!infix_ || static_cast<uint32_t>(previous.size()) >= InfixIndex::MIN_LENGTH
+                || static_cast<uint32_t>(word.size()) < InfixIndex::MIN_LENGTH);
+}
+
+
+
+/** ***************************************************************************/
+vector<Core::ScoredId> Core::PrefixSearch::match(const QStringList &words,
+                                                 const vector<ScoredId> *candidates, bool exact) const {
+
+    if (words.empty())
+        return candidates ? *candidates : vector<ScoredId>();
+
+    // Unite the posting lists of the terms that begin with the word w ∈ W.
+    // This set is called U_w. Stop if some U_w is empty.
+    vector<vector<ScoredId>> wordMappingsUnions;
+    for (const QString &word : words) {
+        vector<ScoredId> wordMappingsUnion;
+        if (exact)
+            PrefixSearch::wordPostings(word, candidates, wordMappingsUnion);
+        else
+            wordPostings(word, candidates, wordMappingsUnion);
+        if (wordMappingsUnion.empty())
+            return vector<ScoredId>();
+        wordMappingsUnions.push_back(std::move(wordMappingsUnion));
+    }
+
+    // Intersect all sets U_w
+    vector<ScoredId> results = intersect(std::move(wordMappingsUnions));
+    dropRemoved(results);
+
+    for (ScoredId &result : results)
+        result.score = Scoring::itemScore(result.score, static_cast<uint32_t>(words.size()));
+    order(words, results);
+    return results;
+}
+
+
+
+/** ***************************************************************************/
+vector<Core::ScoredId> Core::PrefixSearch::match(const QStringList &words, const vector<ScoredId> *candidates,
+                                                 Stage &stage, bool exact) const {
+
+    /*
+     * If the query extends the last one, i.e. the leading words are the same,
+     * the last word of the last query is extended and words may have been
+     * appended, the results are a subset of the last results. Keep the sets
+     * U_w of the unchanged words and match the others against the last
+     * results only. Otherwise start over, restricted to the items passing
+     * the facet operators if any.
+     */
+    if (words.empty()) {
+        stage.words.clear();
+        stage.wordMappingsUnions.clear();
+        stage.results.clear();
+        return candidates ? *candidates : vector<ScoredId>();
+    }
+
+    int kept = 0;
+    bool narrowed = false;
+    if (!stage.words.empty() && words.size() >= stage.words.size()) {
+        const int last = static_cast<int>(stage.words.size()) - 1;
+        while (kept < last && words[kept] == stage.words[kept])
+            ++kept;
+        narrowed = kept == last && (exact ? PrefixSearch::narrows(words[last], stage.words[last])
+                                           : narrows(words[last], stage.words[last]));
+        if (narrowed && words[last] == stage.words[last]) {
+            // The sets are aligned with the results, U_w of the last word is the rest of the sum
+            vector<ScoredId> lastWordMappingsUnion = stage.results;
+            for (const vector<ScoredId> &wordMappingsUnion : stage.wordMappingsUnions)
+                for (size_t i = 0; i < lastWordMappingsUnion.size(); ++i)
+                    lastWordMappingsUnion[i].score -= wordMappingsUnion[i].score;
+            stage.wordMappingsUnions.push_back(std::move(lastWordMappingsUnion));
+            ++kept;
+        }
+    }
+    if (!narrowed) {
+        kept = 0;
+        stage.results.clear();
+    }
+    stage.words = words;
+    stage.wordMappingsUnions.resize(static_cast<size_t>(kept));
+
+    if (!narrowed || !stage.results.empty()) {
+        for (int i = kept; i < static_cast<int>(words.size()); ++i) {
+            vector<ScoredId> wordMappingsUnion;
+            const vector<ScoredId> *restriction = narrowed ? &stage.results : candidates;
+            if (exact)
+                PrefixSearch::wordPostings(words[i], restriction, wordMappingsUnion);
+            else
+                wordPostings(words[i], restriction, wordMappingsUnion);
+            stage.wordMappingsUnions.push_back(std::move(wordMappingsUnion));
+        }
+
+        // Intersect all sets U_w, shortest first, keeping the sets
+        vector<const vector<ScoredId>*> lists;
+        for (const vector<ScoredId> &wordMappingsUnion : stage.wordMappingsUnions)
+            lists.push_back(&wordMappingsUnion);
+        std::sort(lists.begin(), lists.end(), [](const vector<ScoredId> *lhs, const vector<ScoredId> *rhs){
+            return lhs->size() < rhs->size();
+        });
+        stage.results = *lists.front();
+        for (size_t i = 1; i < lists.size() && !stage.results.empty(); ++i)
+            intersect(stage.results, *lists[i]);
+        dropRemoved(stage.results);
+    }
+
+    // Keep the sets of the leading words for the next query
+    stage.wordMappingsUnions.resize(static_cast<size_t>(words.size()) - 1);
+    for (vector<ScoredId> &wordMappingsUnion : stage.wordMappingsUnions)
+        retain(wordMappingsUnion, stage.results);
+
+    vector<ScoredId> results = stage.results;
+    for (ScoredId &result : results)
+        result.score = Scoring::itemScore(result.score, static_cast<uint32_t>(words.size()));
+    order(words, results);
+    return results;
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::order(const QStringList &words, vector<ScoredId> &results) const {
+
+    if (!positions_ || words.size() < 2 || results.empty())
+        return;
+
+    /*
+     * Look up the position of the best prefix match of every word in the
+     * results. Words matching only sub-words, infixes or fuzzily have no
+     * position and count like words out of order.
+     */
+    const uint16_t unknown = 0x100;
+    vector<vector<uint16_t>> positions;
+    vector<ScoredId> postings;
+    vector<uint8_t> wordPositions;
+    for (const QString &word : words) {
+        auto quality = [&word](const Term &term){
+            return Scoring::prefixQuality(static_cast<uint32_t>(word.size()), term.size());
+        };
+        postings.clear();
+        wordPositions.clear();
+        invertedIndex_.prefixPostings(word, quality, results, postings, wordPositions);
+
+        // The postings are a subset of the results, both sorted by id
+        positions.emplace_back(results.size(), unknown);
+        size_t i = 0;
+        for (size_t j = 0; j < postings.size(); ++j) {
+            while (results[i].id != postings[j].id)
+                ++i;
+            positions.back()[i] = wordPositions[j];
+        }
+    }
+
+    const uint32_t pairCount = static_cast<uint32_t>(words.size()) - 1;
+    for (size_t i = 0; i < results.size(); ++i) {
+        uint32_t penalty = 0;
+        for (size_t w = 1; w < positions.size(); ++w) {
+            const uint16_t lhs = positions[w-1][i], rhs = positions[w][i];
+            penalty += (lhs == unknown || rhs == unknown)
+                    ? 2 : Scoring::orderPenalty(static_cast<uint8_t>(lhs), static_cast<uint8_t>(rhs));
+        }
+        results[i].score = Scoring::orderedScore(results[i].score, penalty, pairCount);
+    }
+}
+
+
+
+/** ***************************************************************************/
+vector<Core::ScoredId> Core::PrefixSearch::topMatches(const QStringList &words, size_t k) const {
+
+    /*
+     * Queries of several words are selective, the intersection is cheap
+     * compared to the union of a single short prefix. Rank them fully.
+     */
+    if (words.size() > 1) {
+        vector<ScoredId> matches = match(words, nullptr, true);
+        selectTop(matches, k);
+        return matches;
+    }
+
+    /*
+     * A single word is the union of the posting lists of all terms it is a
+     * prefix of, which can cover most of the index for the first letters
+     * typed. The score of a posting is bounded by the best weight of its list
+     * times the quality of the term. Process the lists by descending bound
+     * and stop as soon as the k-th best score found can not be beaten by the
+     * remaining lists (MaxScore).
+     */
+    const QString &word = words.front();
+    struct Cursor {
+        Cursor(PostingList::const_iterator it, uint32_t quality, uint32_t bound)
+            : it(it), quality(quality), bound(bound) {}
+        PostingList::const_iterator it;
+        uint32_t quality;
+        uint32_t bound;
+    };
+    vector<Cursor> cursors;
+    invertedIndex_.visitPrefix(word, [&cursors, &word](const Term &term, PostingList::const_iterator begin,
+                                                       PostingList::const_iterator end, uint8_t maxWeight){
+        if ( begin == end )
+            return;
+        uint32_t quality = Scoring::prefixQuality(static_cast<uint32_t>(word.size()), term.size());
+        cursors.emplace_back(begin, quality, Scoring::wordScore(maxWeight, quality));
+    });
+    if (subwords_)
+        subwordIndex_.visitPrefix(word, [&cursors, &word](const Term &term, PostingList::const_iterator begin,
+                                                          PostingList::const_iterator end, uint8_t maxWeight){
+            if ( begin == end )
+                return;
+            uint32_t quality = Scoring::subwordQuality(static_cast<uint32_t>(word.size()), term.size());
+            cursors.emplace_back(begin, quality, Scoring::wordScore(maxWeight, quality));
+        });
+    if (infix_)
+        infixIndex().visitInfix(word, [this, &cursors, &word](const Term &term){
+            uint32_t quality = Scoring::infixQuality(static_cast<uint32_t>(word.size()), term.size());
+            invertedIndex_.visitTerm(term, [&cursors, quality](const Term &, PostingList::const_iterator begin,
+                                                               PostingList::const_iterator end){
+                // The best weight of the list is unknown here, bound by the maximum
+                if ( begin != end )
+                    cursors.emplace_back(begin, quality, Scoring::wordScore(UINT8_MAX, quality));
+            });
+        });
+    std::stable_sort(cursors.begin(), cursors.end(), [](const Cursor &lhs, const Cursor &rhs){
+        return lhs.bound > rhs.bound;
+    });
+
+    // The best score of every item found and whether it is among the top
+    struct Best {
+        uint32_t score;
+        bool top;
+    };
+    std::unordered_map<uint32_t,Best> best;
+
+    /*
+     * The k best items found by the score they had when they entered, the
+     * worst on top. Scores only improve, an entry is a lower bound of the
+     * score of its item. The top is brought up to date when compared.
+     */
+    typedef pair<uint32_t,uint32_t> Entry; // score, id
+    std::priority_queue<Entry, vector<Entry>, std::greater<Entry>> top;
+    auto settle = [&best, &top](){
+        while (!top.empty() && best[top.top().second].score != top.top().first) {
+            const uint32_t id = top.top().second;
+            top.pop();
+            top.emplace(best[id].score, id);
+        }
+    };
+
+    for (size_t i = 0; i < cursors.size();) {
+
+        // Process all lists having the same bound
+        const uint32_t bound = cursors[i].bound;
+        for (; i < cursors.size() && cursors[i].bound == bound; ++i) {
+            for (PostingList::const_iterator it = cursors[i].it; it != PostingList::const_iterator(); ++it) {
+                if (removedCount_ != 0 && removed(*it))
+                    continue;
+                const uint32_t score = Scoring::wordScore(it.weight(), cursors[i].quality, it.position());
+                pair<std::unordered_map<uint32_t,Best>::iterator,bool> found = best.emplace(*it, Best{score, false});
+                Best &entry = found.first->second;
+                if (!found.second) {
+                    if (score <= entry.score)
+                        continue;
+                    entry.score = score;
+                }
+                if (entry.top)
+                    continue;
+                if (top.size() == k) {
+                    settle();
+                    if (score <= top.top().first)
+                        continue;
+                    best[top.top().second].top = false;
+                    top.pop();
+                }
+                top.emplace(score, *it);
+                entry.top = true;
+            }
+        }
+
+        // Stop if no remaining posting can displace the k-th best match
+        if (i < cursors.size() && top.size() == k) {
+            settle();
+            if (Scoring::itemScore(top.top().first, 1) > Scoring::itemScore(cursors[i].bound, 1))
+                break;
+        }
+    }
+
+    vector<ScoredId> matches;
+    matches.reserve(best.size());
+    for (const pair<const uint32_t,Best> &entry : best)
+        matches.emplace_back(entry.first, Scoring::itemScore(entry.second.score, 1));
+    selectTop(matches, k);
+    return matches;
+}
+
+
+
+/** ***************************************************************************/
+void Core::PrefixSearch::selectTop(vector<ScoredId> &matches, size_t k) {
+    auto better = [](const ScoredId &lhs, const ScoredId &rhs){
+        return lhs.score > rhs.score || (lhs.score == rhs.score && lhs.id < rhs.id);
+    };
+    if (k < matches.size()) {
+        std::partial_sort(matches.begin(), matches.begin() + static_cast<long>(k), matches.end(), better);
+        matches.erase(matches.begin() + static_cast<long>(k), matches.end());
+    } else
+        std::sort(matches.begin(), matches.end(), better);
+}
@@ -15,11 +15,18 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
-#include <map>
+#include <QStringList>
+#include <atomic>
 #include <memory>
-#include <set>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
+#include "facetindex.h"
 #include "indeximpl.h"
+#include "infixindex.h"
+#include "queryparser.h"
+#include "scoring.h"
+#include "termdictionary.h"
 
 namespace Core {
 
@@ -33,14 +40,168 @@ public:
     PrefixSearch(const PrefixSearch &rhs);
     virtual ~PrefixSearch();
 
+    PrefixSearch *clone() const override;
+    PrefixSearch *cloneEmpty() const override;
+
     void add(std::shared_ptr<Indexable> idxble) override;
+    void build(std::vector<std::shared_ptr<Indexable>> items) override;
+    bool remove(const std::shared_ptr<Indexable> &idxble) override;
+    void update(std::shared_ptr<Indexable> idxble) override;
+    inline bool contains(const Indexable *idxble) const override { return ids_.count(idxble) != 0; }
     void clear() override;
-    std::vector<std::shared_ptr<Indexable>> search(const QString &req) const override;
+    void setSubwords(bool subwords) override;
+    inline bool subwords() const override { return subwords_; }
+    void setInfix(bool infix) override;
+    inline bool infix() const override { return infix_; }
+    inline void setFuzzyFallback(size_t minMatches) override { fuzzyFallback_ = minMatches; }
+    inline size_t fuzzyFallback() const override { return fuzzyFallback_; }
+    void setPositions(bool positions) override;
+    inline bool positions() const override { return positions_; }
+    void setDiacritics(bool diacritics) override;
+    inline bool diacritics() const override { return !tokenizer_.stripsDiacritics(); }
+    bool save(const QString &path, const std::vector<std::shared_ptr<Indexable>> &items,
+              uint64_t generation) const override;
+    bool load(const QString &path, std::vector<std::shared_ptr<Indexable>> items) override;
+    inline uint64_t generation() const override { return invertedIndex_.generation(); }
+    std::vector<OfflineIndex::Match> search(const QString &req) const override;
+    std::vector<OfflineIndex::Match> search(const QString &req, size_t k) const override;
+    std::vector<OfflineIndex::Match> search(const QString &req, size_t k,
+                                            std::shared_ptr<SearchContext> &context) const override;
+    void stats(OfflineIndex::Stats &stats) const override;
+
+    /**
+     * @brief Removes the files saved to path, the fuzzy tables included
+     */
+    static void removeFiles(const QString &path);
 
 protected:
 
+    /**
+     * @brief All items matching the lowercase words, sorted by id
+     * The score of a match is its item score.
+     * @param candidates If not null, the ids to restrict the matches to. If
+     * there are no words these are the matches.
+     * @param exact If true the words are matched by the prefix search of this
+     * class, i.e. the exact stage of a fuzzy search.
+     */
+    std::vector<ScoredId> match(const QStringList &words,
+                                const std::vector<ScoredId> *candidates = nullptr,
+                                bool exact = false) const;
+
+    /**
+     * @brief The items matching a lowercase word, sorted by id
+     * The score of a match is the best word score of the item.
+     * @param candidates If not null, the ids to restrict the matches to
+     */
+    virtual void wordPostings(const QString &word, const std::vector<ScoredId> *candidates,
+                              std::vector<ScoredId> &postings) const;
+
+    /**
+     * @brief Checks if the matches of word are a subset of those of previous
+     * This is the case if word extends previous.
+     */
+    virtual bool narrows(const QString &word, const QString &previous) const;
+
+    /**
+     * @brief The k best items matching the lowercase words, best first
+     * Ties are ordered by id. The implementation of this class matches
+     * prefixes only, also in fuzzy searches.
+     */
+    virtual std::vector<ScoredId> topMatches(const QStringList &words, size_t k) const;
+
+    /**
+     * @brief Lowers the scores of matches of several words by how far the
+     * words are apart or out of order in the keywords of the items
+     * Does nothing unless positions are stored.
+     * @param results The item scores of the matches, sorted by id
+     */
+    void order(const QStringList &words, std::vector<ScoredId> &results) const;
+
+    /**
+     * @brief Whether wordPostings matches fuzzily
+     * Fuzzy searches run their exact stage first if a fallback is set.
+     */
+    virtual bool fuzzy() const { return false; }
+
+    static void selectTop(std::vector<ScoredId> &matches, size_t k);
+
+    /**
+     * @brief Splits a query into its facet operators and lowercase words
+     */
+    QStringList parse(const QString &req, std::vector<QueryParser::Operator> &operators) const;
+
+    /**
+     * @brief The items passing the facet operators, sorted by id, scored 0
+     * Operators on the same facet are alternatives, operators on different
+     * facets have to hold all. Negated operators exclude their items.
+     */
+    std::vector<ScoredId> filter(const std::vector<QueryParser::Operator> &operators) const;
+
+    /**
+     * @brief Drops the postings of removed items and renumbers the others
+     */
+    virtual void compact();
+
+    inline bool removed(uint32_t id) const { return !index_[id]; }
+    void dropRemoved(std::vector<ScoredId> &matches) const;
+
+    void addSubwords(const QString &keyword, uint32_t id, uint8_t weight);
+    void buildSubwordIndex();
+    void subwordPostings(const QString &word, const std::vector<ScoredId> *candidates,
+                         std::vector<ScoredId> &postings) const;
+
+    void addInfixTerm(const QString &term);
+    void invalidateInfixIndex();
+    const InfixIndex &infixIndex() const;
+    void infixPostings(const QString &word, const std::vector<ScoredId> *candidates,
+                       std::vector<ScoredId> &postings) const;
+
+    void invalidateFacetIndex();
+    const FacetIndex &facetIndex() const;
+
+    // Removed items leave a null tombstone until the next compaction
     std::vector<std::shared_ptr<Indexable>> index_;
-    std::map<QString,std::set<uint>> invertedIndex_;
+    std::unordered_map<const Indexable*,uint32_t> ids_;
+    uint32_t removedCount_;
+    TermDictionary invertedIndex_;
+
+    // The sub-words of the keywords if enabled, see Tokenizer::subwords
+    bool subwords_;
+    TermDictionary subwordIndex_;
+
+    // The terms of the inverted index by substring if enabled. Built on the
+    // first infix query, see infixIndex, sorting the suffixes of all terms
+    // would dominate loading a saved index.
+    bool infix_;
+    mutable InfixIndex infixIndex_;
+    mutable std::atomic<bool> infixBuilt_;
+
+    // The items by the values of their facets. Built on the first query
+    // naming a facet after a load, see facetIndex, since it asks every item
+    // for its facets.
+    mutable FacetIndex facetIndex_;
+    mutable std::atomic<bool> facetsBuilt_;
+
+    // Guards the indexes built on first use
+    mutable std::mutex lazyMutex_;
+
+    // Fuzzy searches only run if the exact stage finds less items, 0 if disabled
+    size_t fuzzyFallback_;
+
+    // The postings of the inverted index store the positions of the words if enabled
+    bool positions_;
+
+private:
+
+    struct Stage;
+    struct Context;
+    void rebuild();
+    std::vector<ScoredId> match(const QStringList &words, const std::vector<ScoredId> *candidates,
+                                Stage &stage, bool exact) const;
+    void fillUp(const QStringList &words, const std::vector<ScoredId> *candidates,
+                size_t k, std::vector<ScoredId> &matches) const;
+    std::vector<OfflineIndex::Match> toMatches(const std::vector<ScoredId> &matches,
+                                               size_t exactMatches) const;
 };
 
 
@@ -0,0 +1,99 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QStringList>
+#include <vector>
+
+namespace Core {
+
+/**
+ * @brief The QueryParser class
+ * Splits the facet operators off a query. An operator is a whitespace
+ * separated token name:value, optionally negated by a leading minus. Values
+ * containing whitespace can be quoted, e.g. in:"/home/user/my files".
+ */
+class QueryParser final
+{
+public:
+
+    struct Operator {
+        QString name;   // Lowercase
+        QString value;  // Lowercase, without quotes
+        bool negated;
+    };
+
+    /**
+     * @brief Parses the operators of a query
+     * Tokens that look like operators but whose name is not a facet, e.g.
+     * "http://...", are kept as text. So are operators with an empty value.
+     * @param query The query to parse
+     * @param isFacet Called with a lowercase name, returns if it is a facet
+     * @param operators The operators found are appended to this
+     * @return The remaining text of the query
+     */
+    template<typename IsFacet>
+    static QString parse(const QString &query, IsFacet isFacet, std::vector<Operator> &operators);
+
+};
+
+inline bool operator==(const QueryParser::Operator &lhs, const QueryParser::Operator &rhs) {
+    return lhs.negated == rhs.negated && lhs.name == rhs.name && lhs.value == rhs.value;
+}
+
+inline bool operator!=(const QueryParser::Operator &lhs, const QueryParser::Operator &rhs) {
+    return !(lhs == rhs);
+}
+
+
+
+/** ***************************************************************************/
+template<typename IsFacet>
+QString QueryParser::parse(const QString &query, IsFacet isFacet, std::vector<Operator> &operators) {
+    QStringList text;
+    int i = 0;
+    while (i < query.size()) {
+
+        // Skip the whitespace, a token ends at whitespace outside of quotes
+        if (query.at(i).isSpace()) {
+            ++i;
+            continue;
+        }
+        int begin = i;
+        bool quoted = false;
+        for (; i < query.size() && (quoted || !query.at(i).isSpace()); ++i)
+            if (query.at(i) == QChar('"'))
+                quoted = !quoted;
+        QString token = query.mid(begin, i - begin);
+
+        bool negated = token.startsWith(QChar('-'));
+        int colon = token.indexOf(QChar(':'));
+        if (colon > (negated ? 1 : 0)) {
+            QString name = token.mid(negated ? 1 : 0, colon - (negated ? 1 : 0)).toLower();
+            QString value = token.mid(colon + 1);
+            if (value.size() > 1 && value.startsWith(QChar('"')) && value.endsWith(QChar('"')))
+                value = value.mid(1, value.size() - 2);
+            if (!value.isEmpty() && isFacet(name)) {
+                operators.push_back({name, value.toLower(), negated});
+                continue;
+            }
+        }
+        text.push_back(token);
+    }
+    return text.join(" ");
+}
+
+}
@@ -0,0 +1,156 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <algorithm>
+#include <cstdint>
+
+namespace Core {
+
+/**
+ * @brief An item id and the score of the item with respect to a query
+ */
+struct ScoredId {
+    ScoredId(uint32_t id, uint32_t score) : id(id), score(score) {}
+    uint32_t id;
+    uint32_t score;
+};
+
+/**
+ * @brief The scoring model of the offline index
+ *
+ * Every posting carries the relevance of the keyword it stems from,
+ * quantized to 8 bits. The score of a query word matching a term is this
+ * weight times the quality of the match. Exact matches rank before prefix
+ * matches, which rank before fuzzy matches. The score of an item is the mean
+ * of the best scores of all query words, scaled to [0, MAX_SCORE]. If the
+ * postings store positions, matches of the first word of a keyword and words
+ * matching in the order of the query score higher.
+ */
+namespace Scoring {
+
+/** The score of a perfect match. Fits the score of Query::addMatch */
+const uint32_t MAX_SCORE = 32767;
+
+/** The quality of an exact match */
+const uint32_t EXACT_QUALITY = 256;
+
+/** Quantizes a keyword relevance (usually [0, USHRT_MAX]) to a posting weight */
+inline uint8_t weight(uint32_t relevance) {
+    return static_cast<uint8_t>(std::min<uint32_t>(relevance, 0xFFFF) >> 8);
+}
+
+/** The quality of a term starting with the query word, in [128, 256] */
+inline uint32_t prefixQuality(uint32_t wordLength, uint32_t termLength) {
+    if ( wordLength >= termLength )
+        return EXACT_QUALITY;
+    return 128 + 127 * wordLength / termLength;
+}
+
+/**
+ * The quality of a sub-word (initials, camelCase part) starting with the
+ * query word, in [64, 128]. Between prefix and fuzzy matches.
+ */
+inline uint32_t subwordQuality(uint32_t wordLength, uint32_t termLength) {
+    return prefixQuality(wordLength, termLength) / 2;
+}
+
+/**
+ * The quality of a term containing the query word behind its first
+ * character, e.g. "notebook" for "book", in [64, 128]. Ranks like a sub-word
+ * match of the same coverage.
+ */
+inline uint32_t infixQuality(uint32_t wordLength, uint32_t termLength) {
+    return prefixQuality(wordLength, termLength) / 2;
+}
+
+/**
+ * The quality of a term matching the query word with a prefix edit distance
+ * of distance > 0, in [0, 128). Scales with the ratio of common q-grams and
+ * the ratio of correct characters.
+ */
+inline uint32_t fuzzyQuality(uint32_t wordLength, uint32_t distance,
+                             uint32_t commonQGrams, uint32_t wordQGrams) {
+    if ( distance >= wordLength || wordQGrams == 0 )
+        return 0;
+    return 127 * std::min(commonQGrams, wordQGrams) / wordQGrams
+            * (wordLength - distance) / wordLength;
+}
+
+/** The score of a posting for a given match quality */
+inline uint32_t wordScore(uint8_t weight, uint32_t quality) {
+    return (static_cast<uint32_t>(weight) + 1) * quality;
+}
+
+/**
+ * The position of a word in the keywords of an item, stored by positional
+ * postings. The index of the keyword is in the high nibble, the index of the
+ * word in the keyword in the low one. Both saturate at 15.
+ */
+inline uint8_t position(uint32_t keywordIndex, uint32_t wordIndex) {
+    return static_cast<uint8_t>(std::min<uint32_t>(keywordIndex, 15) << 4 | std::min<uint32_t>(wordIndex, 15));
+}
+
+/** The index of the keyword of a position */
+inline uint32_t keywordIndex(uint8_t position) {
+    return position >> 4;
+}
+
+/** The index of the word in the keyword of a position */
+inline uint32_t wordIndex(uint8_t position) {
+    return position & 0x0F;
+}
+
+/**
+ * The score of a posting at a position for a given match quality. Words
+ * behind the first word of a keyword lose an eighth of the quality, so that
+ * "code" ranks "Code - OSS" before "Visual Studio Code". Postings without
+ * position count as first words.
+ */
+inline uint32_t wordScore(uint8_t weight, uint32_t quality, uint8_t position) {
+    return wordScore(weight, wordIndex(position) == 0 ? quality : quality - quality / 8);
+}
+
+/**
+ * The penalty of consecutive query words matching the words at positions lhs
+ * and rhs of an item, in [0, 2]. None if rhs directly follows lhs in the
+ * same keyword, one if it follows at a distance, two if the words are in
+ * different keywords or reversed.
+ */
+inline uint32_t orderPenalty(uint8_t lhs, uint8_t rhs) {
+    if ( keywordIndex(lhs) != keywordIndex(rhs) || wordIndex(rhs) <= wordIndex(lhs) )
+        return 2;
+    return (wordIndex(rhs) == wordIndex(lhs) + 1 && wordIndex(rhs) < 15) ? 0 : 1;
+}
+
+/**
+ * The score of an item matching several query words given the sum of the
+ * order penalties of its pairCount consecutive words. Scattered or reversed
+ * words lose up to an eighth of the score, which sorts phrases first among
+ * matches of similar relevance.
+ */
+inline uint32_t orderedScore(uint32_t score, uint32_t penalty, uint32_t pairCount) {
+    return score - score * penalty / (16 * pairCount);
+}
+
+/** The final score of an item given the sum of its word scores */
+inline uint32_t itemScore(uint32_t wordScoreSum, uint32_t wordCount) {
+    return std::min(MAX_SCORE, wordScoreSum / wordCount / 2);
+}
+
+}
+
+}
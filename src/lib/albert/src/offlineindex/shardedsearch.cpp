@@ -0,0 +1,526 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QFile>
+#include <QSaveFile>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <numeric>
+#include "indexable.h"
+#include "prefixsearch.h"
+#include "shardedsearch.h"
+using std::shared_ptr;
+using std::vector;
+
+namespace {
+
+// The file assigning the items to the shards. Bump the version on any change of the layout.
+const char FILE_MAGIC[8] = {'A','L','B','E','R','T','S','H'};
+const uint32_t FILE_VERSION = 2;
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+/*
+ * The header is followed by a byte per item holding the shard of the item,
+ * in the order of the items passed to save. The shards are written to files
+ * of their own, see shardPath, carrying the generation of this file.
+ */
+struct FileHeader {
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint32_t itemCount;
+    uint32_t shardCount;
+    uint64_t generation;
+};
+
+/** ***************************************************************************/
+QString shardPath(const QString &path, size_t shard) {
+    return QString("%1.%2").arg(path).arg(shard);
+}
+
+/** ***************************************************************************/
+void concurrently(size_t count, std::function<void(size_t)> function) {
+    vector<size_t> indices(count);
+    std::iota(indices.begin(), indices.end(), 0);
+    QtConcurrent::blockingMap(indices, [&function](size_t i){ function(i); });
+}
+
+}
+
+const uint32_t Core::ShardedSearch::MAX_SHARDS;
+
+
+
+/** ***************************************************************************/
+struct Core::ShardedSearch::Context : public SearchContext
+{
+    // The states of the shards
+    vector<shared_ptr<SearchContext>> shards;
+};
+
+
+
+/** ***************************************************************************/
+Core::ShardedSearch::ShardedSearch(const IndexImpl &prototype, uint32_t shardCount) : generation_(0) {
+    for (uint32_t i = 0; i < std::max(1u, std::min(shardCount, MAX_SHARDS)); ++i)
+        shards_.emplace_back(prototype.cloneEmpty());
+}
+
+
+
+/** ***************************************************************************/
+Core::ShardedSearch::ShardedSearch(vector<shared_ptr<IndexImpl>> shards)
+    : shards_(std::move(shards)), generation_(0) {
+
+}
+
+
+
+/** ***************************************************************************/
+Core::ShardedSearch::~ShardedSearch() {
+
+}
+
+
+
+/** ***************************************************************************/
+Core::ShardedSearch *Core::ShardedSearch::clone() const {
+    // Shares the shards, see writableShard
+    ShardedSearch *shardedSearch = new ShardedSearch(shards_);
+    shardedSearch->generation_ = generation_;
+    return shardedSearch;
+}
+
+
+
+/** ***************************************************************************/
+Core::ShardedSearch *Core::ShardedSearch::cloneEmpty() const {
+    return new ShardedSearch(*shards_.front(), static_cast<uint32_t>(shards_.size()));
+}
+
+
+
+/** ***************************************************************************/
+Core::IndexImpl &Core::ShardedSearch::writableShard(size_t i) {
+    // Copies of this index only ever drop their references concurrently
+    if (shards_[i].use_count() > 1)
+        shards_[i].reset(shards_[i]->clone());
+    return *shards_[i];
+}
+
+
+
+/** ***************************************************************************/
+Core::ShardedSearch *
+Core::ShardedSearch::transformed(std::function<shared_ptr<IndexImpl>(const IndexImpl&)> transform) const {
+    vector<shared_ptr<IndexImpl>> shards(shards_.size());
+    concurrently(shards_.size(), [this, &shards, &transform](size_t i){
+        shards[i] = transform(*shards_[i]);
+    });
+    return new ShardedSearch(std::move(shards));
+}
+
+
+
+/** ***************************************************************************/
+void Core::ShardedSearch::add(shared_ptr<Core::Indexable> idxble) {
+    // Ids are ascending, the last shard holds the greatest ones
+    writableShard(shards_.size() - 1).add(std::move(idxble));
+}
+
+
+
+/** ***************************************************************************/
+void Core::ShardedSearch::build(vector<shared_ptr<Core::Indexable>> items) {
+    // Every shard builds concurrently by itself, build them one after the other
+    const size_t count = items.size();
+    for (size_t i = 0; i < shards_.size(); ++i) {
+        vector<shared_ptr<Indexable>> range(
+                    std::make_move_iterator(items.begin() + static_cast<long>(count * i / shards_.size())),
+                    std::make_move_iterator(items.begin() + static_cast<long>(count * (i + 1) / shards_.size())));
+        shards_[i].reset(shards_[i]->cloneEmpty());
+        shards_[i]->build(std::move(range));
+    }
+}
+
+
+
+/** ***************************************************************************/
+bool Core::ShardedSearch::remove(const shared_ptr<Core::Indexable> &idxble) {
+    for (size_t i = 0; i < shards_.size(); ++i)
+        if (shards_[i]->contains(idxble.get()))
+            return writableShard(i).remove(idxble);
+    return false;
+}
+
+
+
+/** ***************************************************************************/
+void Core::ShardedSearch::update(shared_ptr<Core::Indexable> idxble) {
+    // Ids have to be ascending in the posting lists, reindex as a new item
+    remove(idxble);
+    add(std::move(idxble));
+}
+
+
+
+/** ***************************************************************************/
+bool Core::ShardedSearch::contains(const Indexable *idxble) const {
+    return std::any_of(shards_.begin(), shards_.end(), [idxble](const shared_ptr<IndexImpl> &shard){
+        return shard->contains(idxble);
+    });
+}
+
+
+
+/** ***************************************************************************/
+void Core::ShardedSearch::clear() {
+    for (shared_ptr<IndexImpl> &shard : shards_)
+        shard.reset(shard->cloneEmpty());
+}
+
+
+
+/** ***************************************************************************/
+void Core::ShardedSearch::setSubwords(bool subwords) {
+    for (size_t i = 0; i < shards_.size(); ++i)
+        if (shards_[i]->subwords() != subwords)
+            writableShard(i).setSubwords(subwords);
+}
+
+
+
+/** ***************************************************************************/
+bool Core::ShardedSearch::subwords() const {
+    return shards_.front()->subwords();
+}
+
+
+
+/** ***************************************************************************/
+void Core::ShardedSearch::setInfix(bool infix) {
+    for (size_t i = 0; i < shards_.size(); ++i)
+        if (shards_[i]->infix() != infix)
+            writableShard(i).setInfix(infix);
+}
+
+
+
+/** ***************************************************************************/
+bool Core::ShardedSearch::infix() const {
+    return shards_.front()->infix();
+}
+
+
+
+/** ***************************************************************************/
+void Core::ShardedSearch::setPositions(bool positions) {
+    for (size_t i = 0; i < shards_.size(); ++i)
+        if (shards_[i]->positions() != positions)
+            writableShard(i).setPositions(positions);
+}
+
+
+
+/** ***************************************************************************/
+bool Core::ShardedSearch::positions() const {
+    return shards_.front()->positions();
+}
+
+
+
+/** ***************************************************************************/
+void Core::ShardedSearch::setDiacritics(bool diacritics) {
+    for (size_t i = 0; i < shards_.size(); ++i)
+        if (shards_[i]->diacritics() != diacritics)
+            writableShard(i).setDiacritics(diacritics);
+}
+
+
+
+/** ***************************************************************************/
+bool Core::ShardedSearch::diacritics() const {
+    return shards_.front()->diacritics();
+}
+
+
+
+/** ***************************************************************************/
+void Core::ShardedSearch::setFuzzyFallback(size_t minMatches) {
+    for (size_t i = 0; i < shards_.size(); ++i)
+        if (shards_[i]->fuzzyFallback() != minMatches)
+            writableShard(i).setFuzzyFallback(minMatches);
+}
+
+
+
+/** ***************************************************************************/
+size_t Core::ShardedSearch::fuzzyFallback() const {
+    return shards_.front()->fuzzyFallback();
+}
+
+
+
+/** ***************************************************************************/
+bool Core::ShardedSearch::save(const QString &path, const vector<shared_ptr<Indexable>> &items,
+                               uint64_t generation) const {
+
+    // Assign the items to their shards, keeping their order
+    QByteArray assignment(static_cast<int>(items.size()), '\0');
+    vector<vector<shared_ptr<Indexable>>> shardItems(shards_.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        size_t shard = 0;
+        while (shard < shards_.size() && !shards_[shard]->contains(items[i].get()))
+            ++shard;
+        if (shard == shards_.size())
+            return false;
+        assignment[static_cast<int>(i)] = static_cast<char>(shard);
+        shardItems[shard].push_back(items[i]);
+    }
+
+    // Every shard stores the positions in its own items
+    for (size_t shard = 0; shard < shards_.size(); ++shard)
+        if (!shards_[shard]->save(shardPath(path, shard), shardItems[shard], generation))
+            return false;
+
+    FileHeader header;
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(header.magic));
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.version = FILE_VERSION;
+    header.itemCount = static_cast<uint32_t>(items.size());
+    header.shardCount = static_cast<uint32_t>(shards_.size());
+    header.generation = generation;
+
+    // Written last, a shard of another generation fails to load
+    QSaveFile file(path);
+    if ( !file.open(QIODevice::WriteOnly) )
+        return false;
+    if ( file.write(reinterpret_cast<const char*>(&header), sizeof(FileHeader)) != sizeof(FileHeader)
+         || file.write(assignment) != assignment.size() ) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+
+
+/** ***************************************************************************/
+bool Core::ShardedSearch::load(const QString &path, vector<shared_ptr<Indexable>> items) {
+
+    QFile file(path);
+    if ( !file.open(QIODevice::ReadOnly) || file.size() < static_cast<qint64>(sizeof(FileHeader)) )
+        return false;
+    const uint8_t *data = file.map(0, file.size());
+    if ( !data )
+        return false;
+
+    // The number of shards is the one saved, the cores may have changed since
+    FileHeader header;
+    std::memcpy(&header, data, sizeof(FileHeader));
+    if ( std::memcmp(header.magic, FILE_MAGIC, sizeof(header.magic)) != 0
+         || header.byteOrder != BYTE_ORDER_MARK
+         || header.version != FILE_VERSION
+         || header.itemCount != items.size()
+         || header.shardCount == 0 || header.shardCount > MAX_SHARDS
+         || static_cast<uint64_t>(file.size()) != sizeof(FileHeader) + static_cast<uint64_t>(header.itemCount) )
+        return false;
+
+    vector<vector<shared_ptr<Indexable>>> shardItems(header.shardCount);
+    const uint8_t *assignment = data + sizeof(FileHeader);
+    for (size_t i = 0; i < items.size(); ++i) {
+        if ( assignment[i] >= header.shardCount )
+            return false;
+        shardItems[assignment[i]].push_back(std::move(items[i]));
+    }
+
+    // Every shard is mapped and completed by itself, load them concurrently
+    vector<shared_ptr<IndexImpl>> shards(header.shardCount);
+    vector<char> loaded(header.shardCount, false);
+    const IndexImpl &prototype = *shards_.front();
+    concurrently(shards.size(), [&](size_t i){
+        shards[i].reset(prototype.cloneEmpty());
+        loaded[i] = shards[i]->load(shardPath(path, i), std::move(shardItems[i]));
+    });
+    if ( std::find(loaded.begin(), loaded.end(), false) != loaded.end() )
+        return false;
+
+    // A save failing midway leaves shards of different generations behind
+    for (const shared_ptr<IndexImpl> &shard : shards)
+        if ( shard->generation() != header.generation )
+            return false;
+
+    shards_ = std::move(shards);
+    generation_ = header.generation;
+    return true;
+}
+
+
+
+/** ***************************************************************************/
+bool Core::ShardedSearch::isSharded(const QString &path) {
+    QFile file(path);
+    char magic[sizeof(FILE_MAGIC)];
+    return file.open(QIODevice::ReadOnly)
+            && file.read(magic, sizeof(magic)) == static_cast<qint64>(sizeof(magic))
+            && std::memcmp(magic, FILE_MAGIC, sizeof(magic)) == 0;
+}
+
+
+
+/** ***************************************************************************/
+void Core::ShardedSearch::removeFiles(const QString &path) {
+    // The shard count may have differed, remove all there may be
+    PrefixSearch::removeFiles(path);
+    for (uint32_t shard = 0; shard < MAX_SHARDS; ++shard)
+        PrefixSearch::removeFiles(shardPath(path, shard));
+}
+
+
+
+/** ***************************************************************************/
+vector<vector<Core::OfflineIndex::Match>>
+Core::ShardedSearch::searchShards(std::function<vector<OfflineIndex::Match>(const IndexImpl&, size_t)> search) const {
+    vector<vector<OfflineIndex::Match>> matches(shards_.size());
+    concurrently(shards_.size(), [this, &matches, &search](size_t i){
+        matches[i] = search(*shards_[i], i);
+    });
+    return matches;
+}
+
+
+
+/** ***************************************************************************/
+vector<Core::OfflineIndex::Match>
+Core::ShardedSearch::mergeRanked(vector<vector<OfflineIndex::Match>> matches, size_t k) {
+
+    // The matches of a shard are ranked, exact ones first, ties in the order
+    // of the ids. The merge is stable, merging in the order of the shards
+    // keeps ties in the order of the ids, like a single index would.
+    vector<OfflineIndex::Match> merged = std::move(matches.front());
+    for (size_t i = 1; i < matches.size(); ++i) {
+        const long middle = static_cast<long>(merged.size());
+        merged.insert(merged.end(), matches[i].begin(), matches[i].end());
+        std::inplace_merge(merged.begin(), merged.begin() + middle, merged.end(),
+                           [](const OfflineIndex::Match &lhs, const OfflineIndex::Match &rhs){
+            return lhs.tier < rhs.tier || (lhs.tier == rhs.tier && lhs.score > rhs.score);
+        });
+        if (merged.size() > k)
+            merged.erase(merged.begin() + static_cast<long>(k), merged.end());
+    }
+    return merged;
+}
+
+
+
+/** ***************************************************************************/
+void Core::ShardedSearch::dropFallback(vector<OfflineIndex::Match> &matches, size_t minMatches) {
+    /*
+     * Every shard runs the fuzzy stage of a fallback if it finds less exact
+     * matches itself. A single index only does if all shards together do,
+     * in which case each of them did.
+     */
+    if (minMatches == 0)
+        return;
+    auto fuzzy = [](const OfflineIndex::Match &match){ return match.tier == OfflineIndex::Tier::Fuzzy; };
+    if (static_cast<size_t>(std::count_if(matches.begin(), matches.end(), fuzzy)) + minMatches <= matches.size())
+        matches.erase(std::remove_if(matches.begin(), matches.end(), fuzzy), matches.end());
+}
+
+
+
+/** ***************************************************************************/
+vector<Core::OfflineIndex::Match> Core::ShardedSearch::search(const QString &req) const {
+    // Sorted by id within the tiers, concatenating the shards keeps the order
+    vector<vector<OfflineIndex::Match>> matches = searchShards([&req](const IndexImpl &shard, size_t){
+        return shard.search(req);
+    });
+    vector<OfflineIndex::Match> results;
+    for (const vector<OfflineIndex::Match> &shardMatches : matches)
+        results.insert(results.end(), shardMatches.begin(), shardMatches.end());
+    if (fuzzyFallback() != 0) {
+        std::stable_partition(results.begin(), results.end(), [](const OfflineIndex::Match &match){
+            return match.tier == OfflineIndex::Tier::Exact;
+        });
+        dropFallback(results, fuzzyFallback());
+    }
+    return results;
+}
+
+
+
+/** ***************************************************************************/
+vector<Core::OfflineIndex::Match> Core::ShardedSearch::search(const QString &req, size_t k) const {
+    vector<OfflineIndex::Match> results = mergeRanked(searchShards([&req, k](const IndexImpl &shard, size_t){
+        return shard.search(req, k);
+    }), k);
+    dropFallback(results, std::min(fuzzyFallback(), k));
+    return results;
+}
+
+
+
+/** ***************************************************************************/
+vector<Core::OfflineIndex::Match> Core::ShardedSearch::search(const QString &req, size_t k,
+                                                              shared_ptr<SearchContext> &context) const {
+    // Every shard narrows its own matches
+    if (!context)
+        context = std::make_shared<Context>();
+    Context &ctx = static_cast<Context&>(*context);
+    ctx.shards.resize(shards_.size());
+    vector<OfflineIndex::Match> results = mergeRanked(searchShards([&req, k, &ctx](const IndexImpl &shard, size_t i){
+        return shard.search(req, k, ctx.shards[i]);
+    }), k);
+    dropFallback(results, std::min(fuzzyFallback(), k));
+    return results;
+}
+
+
+
+/** ***************************************************************************/
+void Core::ShardedSearch::stats(OfflineIndex::Stats &stats) const {
+
+    // Sum up the shards, the build time is measured by the caller
+    OfflineIndex::Stats total = stats;
+    total.items = total.removedItems = total.terms = total.postings = total.longestPostings = 0;
+    total.longestTerm.clear();
+    total.dictionaryBytes = total.postingsBytes = total.subwordBytes = total.infixBytes = 0;
+    total.fuzzyBytes = total.facetBytes = 0;
+    total.itemBytes = shards_.capacity() * sizeof(shared_ptr<IndexImpl>);
+    for (const shared_ptr<IndexImpl> &shard : shards_) {
+        OfflineIndex::Stats shardStats;
+        shard->stats(shardStats);
+        total.items += shardStats.items;
+        total.removedItems += shardStats.removedItems;
+        total.terms += shardStats.terms;
+        total.postings += shardStats.postings;
+        if (shardStats.longestPostings > total.longestPostings) {
+            total.longestPostings = shardStats.longestPostings;
+            total.longestTerm = shardStats.longestTerm;
+        }
+        total.dictionaryBytes += shardStats.dictionaryBytes;
+        total.postingsBytes += shardStats.postingsBytes;
+        total.subwordBytes += shardStats.subwordBytes;
+        total.infixBytes += shardStats.infixBytes;
+        total.fuzzyBytes += shardStats.fuzzyBytes;
+        total.facetBytes += shardStats.facetBytes;
+        total.itemBytes += shardStats.itemBytes;
+    }
+    total.shards = shards_.size();
+    stats = total;
+}
@@ -0,0 +1,123 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QString>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "indeximpl.h"
+
+namespace Core {
+
+/**
+ * @brief The ShardedSearch class
+ * An index split into shards holding consecutive ranges of items, each an
+ * index of its own. Queries are run on all shards concurrently on the global
+ * thread pool and the matches are merged in the order of the shards, which
+ * is the order of the ids. Scores do not depend on other items, hence the
+ * matches are the same as those of a single index. Whether the fuzzy stage
+ * of a fallback applies is decided on the exact matches of all shards.
+ *
+ * New items go to the last shard. The shards are shared between copies and
+ * copied on write, a change of a snapshot copies the changed shard only. The
+ * shards do not share their terms, which costs some memory.
+ */
+class ShardedSearch final : public IndexImpl
+{
+public:
+
+    /**
+     * @brief Constructs empty shards
+     * @param prototype An empty index of the type of the shards
+     * @param shardCount The number of shards
+     */
+    ShardedSearch(const IndexImpl &prototype, uint32_t shardCount);
+    explicit ShardedSearch(std::vector<std::shared_ptr<IndexImpl>> shards);
+    ~ShardedSearch();
+
+    ShardedSearch *clone() const override;
+    ShardedSearch *cloneEmpty() const override;
+
+    void add(std::shared_ptr<Indexable> idxble) override;
+    void build(std::vector<std::shared_ptr<Indexable>> items) override;
+    bool remove(const std::shared_ptr<Indexable> &idxble) override;
+    void update(std::shared_ptr<Indexable> idxble) override;
+    bool contains(const Indexable *idxble) const override;
+    void clear() override;
+    void setSubwords(bool subwords) override;
+    bool subwords() const override;
+    void setInfix(bool infix) override;
+    bool infix() const override;
+    void setPositions(bool positions) override;
+    bool positions() const override;
+    void setDiacritics(bool diacritics) override;
+    bool diacritics() const override;
+    void setFuzzyFallback(size_t minMatches) override;
+    size_t fuzzyFallback() const override;
+    bool save(const QString &path, const std::vector<std::shared_ptr<Indexable>> &items,
+              uint64_t generation) const override;
+    bool load(const QString &path, std::vector<std::shared_ptr<Indexable>> items) override;
+    inline uint64_t generation() const override { return generation_; }
+    std::vector<OfflineIndex::Match> search(const QString &req) const override;
+    std::vector<OfflineIndex::Match> search(const QString &req, size_t k) const override;
+    std::vector<OfflineIndex::Match> search(const QString &req, size_t k,
+                                            std::shared_ptr<SearchContext> &context) const override;
+    void stats(OfflineIndex::Stats &stats) const override;
+
+    inline size_t shardCount() const { return shards_.size(); }
+    inline const IndexImpl &shard(size_t i) const { return *shards_[i]; }
+
+    /**
+     * @brief A shard to be changed, copied if shared
+     */
+    IndexImpl &writableShard(size_t i);
+
+    /**
+     * @brief The shards transformed concurrently by transform
+     * Used to convert the type of the shards.
+     */
+    ShardedSearch *transformed(std::function<std::shared_ptr<IndexImpl>(const IndexImpl&)> transform) const;
+
+    /**
+     * @brief The maximum number of shards
+     */
+    static const uint32_t MAX_SHARDS = 64;
+
+    /**
+     * @brief Whether the file at path was saved by a sharded index
+     */
+    static bool isSharded(const QString &path);
+
+    /**
+     * @brief Removes the files saved to path along with those of the shards
+     */
+    static void removeFiles(const QString &path);
+
+private:
+
+    struct Context;
+    std::vector<std::vector<OfflineIndex::Match>>
+    searchShards(std::function<std::vector<OfflineIndex::Match>(const IndexImpl&, size_t)> search) const;
+    static std::vector<OfflineIndex::Match> mergeRanked(std::vector<std::vector<OfflineIndex::Match>> matches, size_t k);
+    static void dropFallback(std::vector<OfflineIndex::Match> &matches, size_t minMatches);
+
+    std::vector<std::shared_ptr<IndexImpl>> shards_;
+    uint64_t generation_;
+};
+
+}
@@ -0,0 +1,349 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include "editdistance.h"
+#include "indexable.h"
+#include "intersection.h"
+#include "scoring.h"
+#include "symspellsearch.h"
+#include "termdictionary.h"
+using std::pair;
+using std::shared_ptr;
+using std::vector;
+
+namespace {
+
+// Code units of a word covered by the deletion dictionary
+const uint PREFIX_LENGTH = 7;
+
+// Errors tolerated at most, the dictionary grows with O(PREFIX_LENGTH^δ)
+const uint MAX_DISTANCE = 2;
+
+/** ***************************************************************************/
+uint64_t hash(const ushort *word, uint length) {
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for ( uint i = 0; i < length; ++i ) {
+        hash ^= word[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/** ***************************************************************************/
+void deletions(const ushort *word, uint length, uint start, uint distance, vector<uint64_t> &hashes) {
+    // Deleting ascending positions only visits most deletions once
+    hashes.push_back(hash(word, length));
+    if ( distance == 0 || length == 1 )
+        return;
+    ushort deletion[PREFIX_LENGTH];
+    for ( uint i = start; i < length; ++i ) {
+        std::copy(word, word + i, deletion);
+        std::copy(word + i + 1, word + length, deletion + i);
+        deletions(deletion, length - 1, i, distance - 1, hashes);
+    }
+}
+
+/** ***************************************************************************/
+void prefixDeletions(const Core::Term &word, vector<uint64_t> &hashes) {
+    // The deletions of all prefixes, a query matches a prefix of the word
+    hashes.clear();
+    ushort prefix[PREFIX_LENGTH];
+    const uint length = std::min(word.size(), PREFIX_LENGTH);
+    for ( uint i = 0; i < length; ++i )
+        prefix[i] = word.at(i);
+    for ( uint i = 1; i <= length; ++i )
+        deletions(prefix, i, 0, MAX_DISTANCE, hashes);
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+}
+
+}
+
+
+
+/** ***************************************************************************/
+Core::SymSpellSearch::SymSpellSearch(double d) : delta_(d) {
+
+}
+
+
+
+/** ***************************************************************************/
+Core::SymSpellSearch::SymSpellSearch(const Core::PrefixSearch &rhs, double d)
+    : PrefixSearch(rhs), delta_(d) {
+    buildDeletionIndex();
+}
+
+
+
+/** ***************************************************************************/
+Core::SymSpellSearch::~SymSpellSearch() {
+
+}
+
+
+
+/** ***************************************************************************/
+Core::SymSpellSearch *Core::SymSpellSearch::clone() const {
+    return new SymSpellSearch(*this);
+}
+
+
+
+/** ***************************************************************************/
+Core::SymSpellSearch *Core::SymSpellSearch::cloneEmpty() const {
+    SymSpellSearch *symSpellSearch = new SymSpellSearch(delta_);
+    symSpellSearch->tokenizer_ = tokenizer_;
+    symSpellSearch->subwords_ = subwords_;
+    symSpellSearch->infix_ = infix_;
+    symSpellSearch->fuzzyFallback_ = fuzzyFallback_;
+    symSpellSearch->positions_ = positions_;
+    symSpellSearch->invertedIndex_ = TermDictionary(positions_, diacritics());
+    return symSpellSearch;
+}
+
+
+
+/** ***************************************************************************/
+void Core::SymSpellSearch::add(shared_ptr<Core::Indexable> indexable) {
+    // Index the deletions of the new words
+    for (const auto &wkw : indexable->indexKeywords())
+        tokenizer_.tokenize(wkw.keyword, [this](const QString &w){ addWord(w); });
+    PrefixSearch::add(std::move(indexable));
+}
+
+
+
+/** ***************************************************************************/
+void Core::SymSpellSearch::build(vector<shared_ptr<Core::Indexable>> items) {
+    PrefixSearch::build(std::move(items));
+    buildDeletionIndex();
+}
+
+
+
+/** ***************************************************************************/
+void Core::SymSpellSearch::clear() {
+    deletionIndex_.clear();
+    words_.clear();
+    table_.clear();
+    PrefixSearch::clear();
+}
+
+
+
+/** ***************************************************************************/
+bool Core::SymSpellSearch::save(const QString &path, const vector<shared_ptr<Indexable>> &items,
+                                 uint64_t generation) const {
+    if (!PrefixSearch::save(path, items, generation))
+        return false;
+
+    // The deletions of the saved words, numbered like the words of the file
+    TermDictionary saved(positions_, diacritics());
+    if (!saved.load(path, static_cast<uint32_t>(items.size())))
+        return false;
+    vector<Term> words;
+    vector<pair<uint64_t,uint32_t>> entries;
+    vector<uint64_t> hashes;
+    saved.visitAll([&](const Term &word, PostingList::const_iterator, PostingList::const_iterator){
+        const uint32_t id = static_cast<uint32_t>(words.size());
+        words.push_back(word);
+        prefixDeletions(word, hashes);
+        for ( uint64_t h : hashes )
+            entries.emplace_back(h, id);
+    });
+
+    // The words of a deletion stay in ascending order
+    std::sort(entries.begin(), entries.end());
+    return WordTable::save(path + ".fuzzy", saved.checksum(), PREFIX_LENGTH << 8 | MAX_DISTANCE, words, entries);
+}
+
+
+
+/** ***************************************************************************/
+bool Core::SymSpellSearch::load(const QString &path, vector<shared_ptr<Indexable>> items) {
+    if (!PrefixSearch::load(path, std::move(items)))
+        return false;
+
+    // Map the deletions saved along, rebuild them if they are missing or stale
+    deletionIndex_.clear();
+    words_.clear();
+    if (!table_.load(path + ".fuzzy", invertedIndex_.checksum(), PREFIX_LENGTH << 8 | MAX_DISTANCE, sizeof(uint32_t)))
+        buildDeletionIndex();
+    return true;
+}
+
+
+
+/** ***************************************************************************/
+void Core::SymSpellSearch::stats(OfflineIndex::Stats &stats) const {
+    PrefixSearch::stats(stats);
+    // A hash node holds the entry and the pointer to the next node
+    stats.fuzzyBytes = table_.bytes() + words_.heapSize() + deletionIndex_.bucket_count() * sizeof(void*)
+            + deletionIndex_.size() * (sizeof(void*) + sizeof(DeletionIndex::value_type));
+    for (const DeletionIndex::value_type &entry : deletionIndex_)
+        stats.fuzzyBytes += entry.second.capacity() * sizeof(uint32_t);
+}
+
+
+
+/** ***************************************************************************/
+void Core::SymSpellSearch::compact() {
+    // Words of removed items vanished from the dictionary
+    PrefixSearch::compact();
+    buildDeletionIndex();
+}
+
+
+
+/** ***************************************************************************/
+void Core::SymSpellSearch::buildDeletionIndex() {
+    deletionIndex_.clear();
+    words_.clear();
+    table_.clear();
+
+    // Terms of several segments are visited once per segment
+    invertedIndex_.visitAll([this](const Term &word, PostingList::const_iterator, PostingList::const_iterator){
+        addWord(word);
+    });
+}
+
+
+
+/** ***************************************************************************/
+void Core::SymSpellSearch::addWord(const Term &word) {
+    if ( table_.find(word) != table_.size() )
+        return;
+    const pair<uint32_t,bool> inserted = words_.insert(word);
+    if ( !inserted.second )
+        return;
+    const uint32_t id = table_.size() + inserted.first;
+
+    vector<uint64_t> hashes;
+    prefixDeletions(word, hashes);
+
+    // Ids are assigned incrementally, the lists stay sorted by appending
+    for ( uint64_t h : hashes )
+        deletionIndex_[h].push_back(id);
+}
+
+
+
+/** ***************************************************************************/
+void Core::SymSpellSearch::wordPostings(const QString &word, const vector<ScoredId> *candidates,
+                                        vector<ScoredId> &postings) const {
+
+    // Candidate words, each seen once. Reused by the queries of a thread and
+    // reset at the matched words only, see FuzzySearch::wordPostings.
+    static thread_local vector<bool> seen;
+    if ( seen.size() < table_.size() + words_.size() )
+        seen.resize(table_.size() + words_.size(), false);
+    vector<uint32_t> matchedWords;
+    vector<uint64_t> hashes;
+
+    const uint wordLength = static_cast<uint>(word.size());
+    const uint delta = maxErrors(word);
+
+    /*
+     * If the word is within δ of a prefix of a term, so is its prefix of
+     * length PREFIX_LENGTH-δ, and the prefix of the term it aligns to is
+     * at most PREFIX_LENGTH long. Both share a deletion of at most δ code
+     * units.
+     */
+    deletions(word.utf16(), std::min(wordLength, PREFIX_LENGTH - delta), 0, delta, hashes);
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+    auto see = [&](uint32_t wordId){
+        if ( !seen[wordId] ) {
+            seen[wordId] = true;
+            matchedWords.push_back(wordId);
+        }
+    };
+    for ( uint64_t h : hashes ) {
+        // The records of the file are not checked on load, skip foreign ids
+        const pair<const uint32_t*,const uint32_t*> records = table_.records<uint32_t>(h);
+        for ( const uint32_t *it = records.first; it != records.second; ++it )
+            if ( *it < table_.size() )
+                see(*it);
+
+        DeletionIndex::const_iterator deletionIndexIt = deletionIndex_.find(h);
+        if ( deletionIndexIt == deletionIndex_.end() )
+            continue;
+        for ( uint32_t wordId : deletionIndexIt->second )
+            see(wordId);
+    }
+
+    // Unite the items referenced by the words keeping their best scores
+    vector<ScoredId> results;
+    const PrefixEditDistance prefixEditDistance(Term(word), delta);
+    for (uint32_t wordId : matchedWords) {
+        const Term matchedWord = term(wordId);
+        seen[wordId] = false;
+
+        // Verify the candidate, deletions only bound the distance
+        uint distance = prefixEditDistance(matchedWord);
+        if (distance > delta)
+            continue;
+
+        // Exact and prefix matches rank before fuzzy matches
+        uint quality = (distance == 0)
+                ? Scoring::prefixQuality(wordLength, static_cast<uint>(matchedWord.size()))
+                : Scoring::fuzzyQuality(wordLength, distance, wordLength, wordLength);
+
+        invertedIndex_.visitTerm(matchedWord, [&results, quality](const Term &,
+                                 PostingList::const_iterator begin, PostingList::const_iterator end){
+            for ( ; begin != end; ++begin )
+                results.emplace_back(*begin, Scoring::wordScore(begin.weight(), quality, begin.position()));
+        });
+    }
+    sortUnique(results);
+
+    // Sub-words and infixes are matched like in the prefix search
+    postings.insert(postings.end(), results.begin(), results.end());
+    if (candidates)
+        retain(postings, *candidates);
+    subwordPostings(word, candidates, postings);
+    infixPostings(word, candidates, postings);
+}
+
+
+
+/** ***************************************************************************/
+bool Core::SymSpellSearch::narrows(const QString &word, const QString &previous) const {
+    // A longer word may be allowed more errors
+    return PrefixSearch::narrows(word, previous) && maxErrors(word) <= maxErrors(previous);
+}
+
+
+
+/** ***************************************************************************/
+uint Core::SymSpellSearch::maxErrors(const QString &word) const {
+    // At least one code unit has to match
+    uint delta = static_cast<uint>((delta_ < 1)? word.size()*delta_ : delta_);
+    return std::min(std::min(delta, MAX_DISTANCE), static_cast<uint>(word.size()) - 1);
+}
+
+
+
+/** ***************************************************************************/
+vector<Core::ScoredId> Core::SymSpellSearch::topMatches(const QStringList &words, size_t k) const {
+    // The fuzzy matches of a word are not bounded by the prefix order, rank all
+    vector<ScoredId> matches = match(words);
+    selectTop(matches, k);
+    return matches;
+}
@@ -0,0 +1,92 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QString>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "prefixsearch.h"
+#include "termarena.h"
+#include "wordtable.h"
+
+namespace Core {
+
+/**
+ * @brief The SymSpellSearch class
+ * A fuzzy search based on a precomputed deletion dictionary (symmetric delete
+ * spelling correction). Two strings within edit distance δ share a string
+ * obtained by deleting at most δ code units from each of them. The index
+ * maps the deletions of every prefix of a word to the word, a query looks up
+ * its own deletions and verifies the candidates by prefix edit distance.
+ *
+ * Candidates are exact, there is no filter dropping matches like the q-gram
+ * bound for short words. The price is memory: only the first PREFIX_LENGTH
+ * code units of a word are indexed and errors are capped at MAX_DISTANCE.
+ */
+class SymSpellSearch final : public PrefixSearch
+{
+public:
+
+    explicit SymSpellSearch(double d = 1.0/3);
+    explicit SymSpellSearch(const PrefixSearch& rhs, double d = 1.0/3);
+    ~SymSpellSearch();
+
+    SymSpellSearch *clone() const override;
+    SymSpellSearch *cloneEmpty() const override;
+
+    void add(std::shared_ptr<Indexable> idxble) override;
+    void build(std::vector<std::shared_ptr<Indexable>> items) override;
+    void clear() override;
+    bool save(const QString &path, const std::vector<std::shared_ptr<Indexable>> &items,
+              uint64_t generation) const override;
+    bool load(const QString &path, std::vector<std::shared_ptr<Indexable>> items) override;
+    void stats(OfflineIndex::Stats &stats) const override;
+    inline double delta() const {return delta_;}
+    inline void setDelta(double d){delta_=d;}
+
+private:
+
+    void wordPostings(const QString &word, const std::vector<ScoredId> *candidates,
+                      std::vector<ScoredId> &postings) const override;
+    bool narrows(const QString &word, const QString &previous) const override;
+    std::vector<ScoredId> topMatches(const QStringList &words, size_t k) const override;
+    inline bool fuzzy() const override { return true; }
+    uint maxErrors(const QString &word) const;
+    void compact() override;
+    void buildDeletionIndex();
+    void addWord(const Term &word);
+    inline Term term(uint32_t id) const {
+        return id < table_.size() ? table_.word(id) : words_[id - table_.size()];
+    }
+
+    // Map of hashed deletions to the ids of the words producing them in
+    // ascending order. Collisions are resolved by the verification.
+    typedef std::unordered_map<uint64_t,std::vector<uint32_t>> DeletionIndex;
+    DeletionIndex deletionIndex_;
+
+    // The words of the loaded file and their deletions, mapped from the file
+    WordTable table_;
+
+    // The distinct words added since, their ids follow the ones of the table
+    TermArena words_;
+
+    // Maximum error
+    double delta_;
+};
+
+}
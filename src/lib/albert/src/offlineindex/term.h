@@ -0,0 +1,97 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QString>
+#include <algorithm>
+#include <cstdint>
+
+namespace Core {
+
+/**
+ * @brief A term of the index
+ * A view on the code units of a term, either UTF-16 or Latin-1. Terms are
+ * stored as Latin-1 wherever all code units fit, which halves their memory.
+ * Latin-1 code units equal the Unicode code points, hence terms of both
+ * encodings compare by value. Does not own the code units, terms obtained
+ * from a dictionary are valid as long as the dictionary is not changed.
+ */
+class Term final
+{
+public:
+    Term(const ushort *data, uint32_t size) : data_(data), size_(size), latin1_(false) {}
+    Term(const uchar *data, uint32_t size) : data_(data), size_(size), latin1_(true) {}
+    Term(const QString &str) : data_(str.utf16()), size_(static_cast<uint32_t>(str.size())), latin1_(false) {}
+
+    inline bool isLatin1() const { return latin1_; }
+    inline const ushort *utf16() const { return static_cast<const ushort*>(data_); }
+    inline const uchar *latin1() const { return static_cast<const uchar*>(data_); }
+    inline uint32_t size() const { return size_; }
+    inline ushort at(uint32_t i) const { return latin1_ ? latin1()[i] : utf16()[i]; }
+    inline QString toString() const {
+        return latin1_ ? QString::fromLatin1(reinterpret_cast<const char*>(latin1()), static_cast<int>(size_))
+                       : QString(reinterpret_cast<const QChar*>(utf16()), static_cast<int>(size_));
+    }
+
+    /** Whether all code units fit into Latin-1 */
+    template<typename Char>
+    static bool fitsLatin1(const Char *data, uint32_t size) {
+        return std::all_of(data, data + size, [](Char c){ return c < 256; });
+    }
+
+    // The comparisons, specialized for the encodings at compile time
+    template<typename L, typename R>
+    static inline bool equal(const L *lhs, uint32_t lhsSize, const R *rhs, uint32_t rhsSize) {
+        return lhsSize == rhsSize && std::equal(lhs, lhs + lhsSize, rhs);
+    }
+    template<typename L, typename R>
+    static inline bool less(const L *lhs, uint32_t lhsSize, const R *rhs, uint32_t rhsSize) {
+        return std::lexicographical_compare(lhs, lhs + lhsSize, rhs, rhs + rhsSize);
+    }
+    template<typename L, typename R>
+    static inline bool startsWith(const L *data, uint32_t size, const R *prefix, uint32_t prefixSize) {
+        return prefixSize <= size && std::equal(prefix, prefix + prefixSize, data);
+    }
+
+    inline bool startsWith(const Term &prefix) const {
+        if ( latin1_ )
+            return prefix.latin1_ ? startsWith(latin1(), size_, prefix.latin1(), prefix.size_)
+                                  : startsWith(latin1(), size_, prefix.utf16(), prefix.size_);
+        return prefix.latin1_ ? startsWith(utf16(), size_, prefix.latin1(), prefix.size_)
+                              : startsWith(utf16(), size_, prefix.utf16(), prefix.size_);
+    }
+    inline bool operator==(const Term &rhs) const {
+        if ( latin1_ )
+            return rhs.latin1_ ? equal(latin1(), size_, rhs.latin1(), rhs.size_)
+                               : equal(latin1(), size_, rhs.utf16(), rhs.size_);
+        return rhs.latin1_ ? equal(utf16(), size_, rhs.latin1(), rhs.size_)
+                           : equal(utf16(), size_, rhs.utf16(), rhs.size_);
+    }
+    inline bool operator<(const Term &rhs) const {
+        if ( latin1_ )
+            return rhs.latin1_ ? less(latin1(), size_, rhs.latin1(), rhs.size_)
+                               : less(latin1(), size_, rhs.utf16(), rhs.size_);
+        return rhs.latin1_ ? less(utf16(), size_, rhs.latin1(), rhs.size_)
+                           : less(utf16(), size_, rhs.utf16(), rhs.size_);
+    }
+
+private:
+    const void *data_;
+    uint32_t size_;
+    bool latin1_;
+};
+
+}
@@ -0,0 +1,111 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include "termarena.h"
+using std::pair;
+using std::vector;
+
+namespace {
+
+// Slots allocated for the first terms
+const size_t MIN_SLOTS = 64;
+
+}
+
+
+
+/** ***************************************************************************/
+Core::TermArena::TermArena() : latin1_(true), offsets_(1, 0), slots_(MIN_SLOTS, 0) {
+
+}
+
+
+
+/** ***************************************************************************/
+pair<uint32_t,bool> Core::TermArena::insert(const Term &term) {
+
+    const size_t mask = slots_.size() - 1;
+    size_t slot = static_cast<size_t>(hash(term)) & mask;
+    for ( ; slots_[slot] != 0; slot = (slot + 1) & mask )
+        if ( (*this)[slots_[slot] - 1] == term )
+            return std::make_pair(slots_[slot] - 1, false);
+
+    // Widen all terms once the first one does not fit into Latin-1
+    if ( latin1_ && !term.isLatin1() && !Term::fitsLatin1(term.utf16(), term.size()) ) {
+        utf16Chars_.assign(latin1Chars_.begin(), latin1Chars_.end());
+        vector<uchar>().swap(latin1Chars_);
+        latin1_ = false;
+    }
+    for ( uint32_t i = 0; i < term.size(); ++i ) {
+        if ( latin1_ )
+            latin1Chars_.push_back(static_cast<uchar>(term.at(i)));
+        else
+            utf16Chars_.push_back(term.at(i));
+    }
+    offsets_.push_back(static_cast<uint32_t>(latin1_ ? latin1Chars_.size() : utf16Chars_.size()));
+
+    const uint32_t id = size() - 1;
+    slots_[slot] = id + 1;
+    if ( 2 * size() > slots_.size() )
+        rehash(2 * slots_.size());
+    return std::make_pair(id, true);
+}
+
+
+
+/** ***************************************************************************/
+void Core::TermArena::clear() {
+    latin1_ = true;
+    vector<uchar>().swap(latin1Chars_);
+    vector<ushort>().swap(utf16Chars_);
+    offsets_.assign(1, 0);
+    offsets_.shrink_to_fit();
+    slots_.assign(MIN_SLOTS, 0);
+    slots_.shrink_to_fit();
+}
+
+
+
+/** ***************************************************************************/
+size_t Core::TermArena::heapSize() const {
+    return latin1Chars_.capacity() * sizeof(uchar) + utf16Chars_.capacity() * sizeof(ushort)
+            + offsets_.capacity() * sizeof(uint32_t) + slots_.capacity() * sizeof(uint32_t);
+}
+
+
+
+/** ***************************************************************************/
+uint64_t Core::TermArena::hash(const Term &term) {
+    // FNV-1a of the code points, equal for both encodings
+    uint64_t hash = 0xcbf29ce484222325;
+    for ( uint32_t i = 0; i < term.size(); ++i )
+        hash = (hash ^ term.at(i)) * 0x100000001b3;
+    return hash;
+}
+
+
+
+/** ***************************************************************************/
+void Core::TermArena::rehash(size_t slotCount) {
+    slots_.assign(slotCount, 0);
+    const size_t mask = slotCount - 1;
+    for ( uint32_t id = 0; id < size(); ++id ) {
+        size_t slot = static_cast<size_t>(hash((*this)[id])) & mask;
+        while ( slots_[slot] != 0 )
+            slot = (slot + 1) & mask;
+        slots_[slot] = id + 1;
+    }
+}
@@ -0,0 +1,84 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "term.h"
+
+namespace Core {
+
+/**
+ * @brief The TermArena class
+ * A set of distinct terms numbered in the order of insertion. The terms are
+ * stored back to back in a single buffer, as Latin-1 until the first term
+ * that does not fit, then all of them are widened to UTF-16. A term costs its
+ * code units, an offset and a hash slot instead of a QString and a map node.
+ */
+class TermArena final
+{
+public:
+
+    TermArena();
+
+    /**
+     * @brief Adds a term unless it is contained already
+     * @return The id of the term and whether it was added
+     */
+    std::pair<uint32_t,bool> insert(const Term &term);
+
+    /**
+     * @brief The term of an id
+     * Valid until the next insertion.
+     */
+    inline Term operator[](uint32_t id) const {
+        return latin1_ ? Term(latin1Chars_.data() + offsets_[id], offsets_[id+1] - offsets_[id])
+                       : Term(utf16Chars_.data() + offsets_[id], offsets_[id+1] - offsets_[id]);
+    }
+
+    /**
+     * @brief The number of terms
+     */
+    inline uint32_t size() const { return static_cast<uint32_t>(offsets_.size() - 1); }
+
+    /**
+     * @brief Removes all terms
+     */
+    void clear();
+
+    /**
+     * @brief The bytes allocated on the heap by the arena
+     */
+    size_t heapSize() const;
+
+private:
+
+    static uint64_t hash(const Term &term);
+    void rehash(size_t slotCount);
+
+    bool latin1_;
+    std::vector<uchar> latin1Chars_;
+    std::vector<ushort> utf16Chars_;
+    std::vector<uint32_t> offsets_; // Begin of a term in the chars, size+1
+
+    // Open addressing with linear probing. Holds id+1, 0 is empty. The size
+    // is a power of two, at most half of the slots are used.
+    std::vector<uint32_t> slots_;
+};
+
+}
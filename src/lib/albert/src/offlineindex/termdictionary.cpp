@@ -0,0 +1,692 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <QFile>
+#include <QSaveFile>
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <utility>
+#include "termdictionary.h"
+using std::pair;
+using std::shared_ptr;
+using std::vector;
+
+namespace {
+
+// Number of postings collected before the buffer is flushed into a segment
+const uint32_t BUFFER_SIZE = 4096;
+
+// The file format. Bump the version on any change of the layout.
+const char FILE_MAGIC[8] = {'A','L','B','E','R','T','I','X'};
+const uint32_t FILE_VERSION = 7;
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+// Flags of the file header
+const uint32_t LATIN1_TERMS = 1;
+const uint32_t POSITIONAL_POSTINGS = 2;
+const uint32_t DIACRITIC_TERMS = 4;
+
+/*
+ * The header is followed by the arrays of the segment, each aligned to 8
+ * bytes: termOffsets, postingOffsets, maxWeights, termChars and postings. The
+ * term characters are Latin-1 if the flags say so, else UTF-16. The
+ * postings are followed by zero padding, so that decoding a corrupted list
+ * can not read past the mapping. The checksum covers the header only,
+ * loading does not read the arrays. The offsets are checked when used, see
+ * Segment::range. The generation is random, hence the checksum identifies
+ * the save too.
+ */
+struct FileHeader {
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint32_t itemCount;
+    uint32_t termCount;
+    uint32_t termCharCount;
+    uint32_t flags;
+    uint64_t postingsSize;
+    uint64_t postingCount;
+    uint32_t longestPostings;
+    uint32_t longestTerm;
+    uint64_t generation;
+    uint64_t checksum;
+};
+
+/** ***************************************************************************/
+struct FileLayout {
+    explicit FileLayout(const FileHeader &header) {
+        termOffsets = align(sizeof(FileHeader));
+        postingOffsets = align(termOffsets + (header.termCount + 1) * sizeof(uint32_t));
+        maxWeights = align(postingOffsets + (header.termCount + 1) * sizeof(uint32_t));
+        termChars = align(maxWeights + header.termCount);
+        postings = align(termChars + header.termCharCount * charSize(header));
+        size = align(postings + header.postingsSize + 8);
+    }
+    static uint64_t align(uint64_t offset) { return (offset + 7) & ~static_cast<uint64_t>(7); }
+    static uint64_t charSize(const FileHeader &header) { return (header.flags & LATIN1_TERMS) ? 1 : sizeof(ushort); }
+    uint64_t termOffsets;
+    uint64_t postingOffsets;
+    uint64_t maxWeights;
+    uint64_t termChars;
+    uint64_t postings;
+    uint64_t size;
+};
+
+/** ***************************************************************************/
+uint64_t checksum(const uint8_t *begin, const uint8_t *end, uint64_t hash = 0xcbf29ce484222325) {
+    // FNV-1a
+    for ( ; begin != end; ++begin )
+        hash = (hash ^ *begin) * 0x100000001b3;
+    return hash;
+}
+
+/*
+ * An id and its posting. The weight and the position are packed such that
+ * the better of two postings of an id is the greater one: the greater weight,
+ * on equal weights the smaller position.
+ */
+typedef pair<uint32_t,uint16_t> Entry;
+
+inline uint16_t pack(uint8_t weight, uint8_t position) {
+    return static_cast<uint16_t>(weight << 8 | (0xFF - position));
+}
+
+inline uint8_t weightOf(uint16_t posting) {
+    return static_cast<uint8_t>(posting >> 8);
+}
+
+inline uint8_t positionOf(uint16_t posting) {
+    return static_cast<uint8_t>(0xFF - (posting & 0xFF));
+}
+
+/** ***************************************************************************/
+void encodePostings(const vector<Entry> &postings, bool positional, vector<uint8_t> &out) {
+    uint8_t buffer[7];
+    uint32_t last = 0;
+    for ( const Entry &posting : postings ) {
+        uint8_t *bufferEnd = positional
+                ? Core::PostingList::encode(posting.first - last, weightOf(posting.second),
+                                            positionOf(posting.second), buffer)
+                : Core::PostingList::encode(posting.first - last, weightOf(posting.second), buffer);
+        out.insert(out.end(), buffer, bufferEnd);
+        last = posting.first;
+    }
+}
+
+/** ***************************************************************************/
+void decodePostings(Core::PostingList::const_iterator it, vector<Entry> &out) {
+    for ( ; it != Core::PostingList::const_iterator(); ++it ) {
+        if ( !out.empty() && out.back().first == *it )
+            out.back().second = std::max(out.back().second, pack(it.weight(), it.position()));
+        else
+            out.emplace_back(*it, pack(it.weight(), it.position()));
+    }
+}
+
+}
+
+constexpr uint32_t Core::TermDictionary::REMOVED;
+
+
+
+/** ***************************************************************************/
+/** ***************************************************************************/
+/** ***************************************************************************/
+/** ***************************************************************************/
+class Core::TermDictionary::SegmentBuilder
+{
+public:
+    explicit SegmentBuilder(bool positional)
+        : data_(std::make_shared<Data>()), postingCount_(0), longestPostings_(0), longestTerm_(UINT32_MAX) {
+        data_->positional = positional;
+        data_->termOffsets.push_back(0);
+        data_->postingOffsets.push_back(0);
+    }
+
+    // Appends a term, has to be greater than the last one
+    void append(const Term &term, const vector<Entry> &postings) {
+        uint8_t maxWeight = 0;
+        for ( const Entry &posting : postings )
+            maxWeight = std::max(maxWeight, weightOf(posting.second));
+        appendTerm(term, maxWeight);
+        encodePostings(postings, data_->positional, data_->postings);
+        data_->postingOffsets.push_back(static_cast<uint32_t>(data_->postings.size()));
+        count(static_cast<uint32_t>(postings.size()));
+    }
+
+    // Appends a term and its (self-contained) encoded postings. The postings
+    // of a file are decoded, which drops the ids out of its bounds.
+    void append(const Segment &segment, size_t i) {
+        if ( segment.idLimit != UINT32_MAX ) {
+            vector<Entry> postings;
+            decodePostings(segment.begin(i), postings);
+            append(segment.term(i), postings);
+            return;
+        }
+        appendTerm(segment.term(i), segment.maxWeights[i]);
+        const pair<uint32_t,uint32_t> range = segment.range(segment.postingOffsets, i);
+        const uint8_t *begin = segment.postings + range.first;
+        const uint8_t *end = segment.postings + range.second;
+        data_->postings.insert(data_->postings.end(), begin, end);
+        data_->postingOffsets.push_back(static_cast<uint32_t>(data_->postings.size()));
+        count(PostingList::count(begin, end, segment.positional));
+    }
+
+    void reserve(size_t terms, size_t postings) {
+        data_->termOffsets.reserve(terms + 1);
+        data_->postingOffsets.reserve(terms + 1);
+        data_->maxWeights.reserve(terms);
+        data_->postings.reserve(postings);
+    }
+
+    shared_ptr<const Segment> finish() {
+        data_->latin1TermChars.shrink_to_fit();
+        data_->utf16TermChars.shrink_to_fit();
+        data_->postings.shrink_to_fit();
+        shared_ptr<Segment> segment = std::make_shared<Segment>();
+        segment->size = static_cast<uint32_t>(data_->maxWeights.size());
+        segment->latin1 = data_->latin1;
+        segment->positional = data_->positional;
+        segment->idLimit = UINT32_MAX;
+        segment->termOffsets = data_->termOffsets.data();
+        if ( data_->latin1 )
+            segment->termChars = data_->latin1TermChars.data();
+        else
+            segment->termChars = data_->utf16TermChars.data();
+        segment->postingOffsets = data_->postingOffsets.data();
+        segment->postings = data_->postings.data();
+        segment->maxWeights = data_->maxWeights.data();
+        segment->postingCount = postingCount_;
+        segment->longestPostings = longestPostings_;
+        segment->longestTerm = (longestTerm_ == UINT32_MAX) ? segment->size : longestTerm_;
+        segment->memory = data_;
+        data_.reset();
+        return segment;
+    }
+
+private:
+    struct Data {
+        Data() : latin1(true), positional(false) {}
+        bool latin1;
+        bool positional;
+        vector<uint32_t> termOffsets;
+        vector<uchar> latin1TermChars;
+        vector<ushort> utf16TermChars;
+        vector<uint32_t> postingOffsets;
+        vector<uint8_t> postings;
+        vector<uint8_t> maxWeights;
+    };
+
+    void appendTerm(const Term &term, uint8_t maxWeight) {
+        // Terms are Latin-1 until the first one that does not fit
+        if ( data_->latin1 && !term.isLatin1() && !Term::fitsLatin1(term.utf16(), term.size()) ) {
+            data_->utf16TermChars.assign(data_->latin1TermChars.begin(), data_->latin1TermChars.end());
+            vector<uchar>().swap(data_->latin1TermChars);
+            data_->latin1 = false;
+        }
+        if ( data_->latin1 )
+            appendChars(term, data_->latin1TermChars);
+        else
+            appendChars(term, data_->utf16TermChars);
+        data_->maxWeights.push_back(maxWeight);
+    }
+
+    // Measures the list of the last term, stats do not decode the segment
+    void count(uint32_t length) {
+        postingCount_ += length;
+        if ( length > longestPostings_ ) {
+            longestPostings_ = length;
+            longestTerm_ = static_cast<uint32_t>(data_->maxWeights.size() - 1);
+        }
+    }
+
+    template<typename Char>
+    void appendChars(const Term &term, vector<Char> &chars) {
+        if ( term.isLatin1() )
+            chars.insert(chars.end(), term.latin1(), term.latin1() + term.size());
+        else
+            for ( uint32_t i = 0; i < term.size(); ++i )
+                chars.push_back(static_cast<Char>(term.utf16()[i]));
+        data_->termOffsets.push_back(static_cast<uint32_t>(chars.size()));
+    }
+
+    shared_ptr<Data> data_;
+    uint64_t postingCount_;
+    uint32_t longestPostings_;
+    uint32_t longestTerm_;
+};
+
+
+
+/** ***************************************************************************/
+/** ***************************************************************************/
+/** ***************************************************************************/
+/** ***************************************************************************/
+Core::TermDictionary::TermDictionary(bool positions, bool diacritics)
+    : bufferedPostings_(0), lastId_(0), positions_(positions), diacritics_(diacritics),
+      checksum_(0), generation_(0) {
+
+}
+
+
+
+/** ***************************************************************************/
+void Core::TermDictionary::add(const QString &term, uint32_t id, uint8_t weight, uint8_t position) {
+
+    // Flush the buffer when full, but never split the postings of an item
+    if ( bufferedPostings_ >= BUFFER_SIZE && id != lastId_ )
+        flush();
+
+    std::map<QString,PostingList>::iterator it = buffer_.lower_bound(term);
+    if ( it == buffer_.end() || it->first != term )
+        it = buffer_.emplace_hint(it, term, PostingList(positions_));
+    it->second.append(id, weight, position);
+    ++bufferedPostings_;
+    lastId_ = id;
+}
+
+
+
+/** ***************************************************************************/
+void Core::TermDictionary::add(vector<Posting> &postings) {
+
+    if ( postings.empty() )
+        return;
+
+    // Sort by term and id, postings of the same item end with the best one
+    const bool positions = positions_;
+    auto packed = [positions](const Posting &posting){
+        return pack(posting.weight, positions ? posting.position : 0);
+    };
+    std::sort(postings.begin(), postings.end(), [&packed](const Posting &lhs, const Posting &rhs){
+        const Term lhsTerm(lhs.term), rhsTerm(rhs.term);
+        if ( lhsTerm < rhsTerm )
+            return true;
+        if ( rhsTerm < lhsTerm )
+            return false;
+        return lhs.id < rhs.id || (lhs.id == rhs.id && packed(lhs) < packed(rhs));
+    });
+
+    // The buffered postings have smaller ids, they go to an older segment
+    flush();
+
+    SegmentBuilder builder(positions_);
+    vector<Entry> list;
+    for ( vector<Posting>::const_iterator it = postings.begin(); it != postings.end(); ) {
+        const Term term(it->term);
+        list.clear();
+        for ( ; it != postings.end() && Term(it->term) == term; ++it ) {
+            if ( !list.empty() && list.back().first == it->id )
+                list.back().second = packed(*it);
+            else
+                list.emplace_back(it->id, packed(*it));
+            lastId_ = std::max(lastId_, it->id);
+        }
+        builder.append(term, list);
+    }
+    push(builder.finish());
+}
+
+
+
+/** ***************************************************************************/
+void Core::TermDictionary::append(const TermDictionary &other) {
+
+    if ( other.segments_.empty() && other.buffer_.empty() )
+        return;
+
+    shared_ptr<const Segment> newer = other.merged();
+    if ( segments_.empty() && buffer_.empty() )
+        segments_.assign(1, newer);
+    else
+        segments_.assign(1, merge(*merged(), *newer));
+    buffer_.clear();
+    bufferedPostings_ = 0;
+    lastId_ = std::max(lastId_, other.lastId_);
+}
+
+
+
+/** ***************************************************************************/
+void Core::TermDictionary::clear() {
+    segments_.clear();
+    buffer_.clear();
+    checksum_ = 0;
+    generation_ = 0;
+    bufferedPostings_ = 0;
+    lastId_ = 0;
+}
+
+
+
+/** ***************************************************************************/
+void Core::TermDictionary::remap(const vector<uint32_t> &ids) {
+
+    vector<Entry> postings;
+    auto remapPostings = [&ids, &postings](PostingList::const_iterator it){
+        postings.clear();
+        decodePostings(it, postings);
+        vector<Entry>::iterator out = postings.begin();
+        for ( const Entry &posting : postings )
+            if ( ids[posting.first] != REMOVED )
+                *out++ = std::make_pair(ids[posting.first], posting.second);
+        postings.erase(out, postings.end());
+    };
+
+    // Rewrite the segments and merge them
+    vector<shared_ptr<const Segment>> segments;
+    for ( const shared_ptr<const Segment> &segment : segments_ ) {
+        SegmentBuilder builder(positions_);
+        for ( size_t i = 0; i < segment->size; ++i ) {
+            remapPostings(segment->begin(i));
+            if ( !postings.empty() )
+                builder.append(segment->term(i), postings);
+        }
+        shared_ptr<const Segment> remapped = builder.finish();
+        if ( remapped->size == 0 )
+            continue;
+        if ( segments.empty() )
+            segments.push_back(remapped);
+        else
+            segments.back() = merge(*segments.back(), *remapped);
+    }
+    segments_.swap(segments);
+
+    // Rewrite the buffer
+    std::map<QString,PostingList> buffer;
+    bufferedPostings_ = 0;
+    for ( const pair<const QString,PostingList> &entry : buffer_ ) {
+        remapPostings(entry.second.begin());
+        if ( postings.empty() )
+            continue;
+        PostingList &list = buffer.emplace_hint(buffer.end(), entry.first, PostingList(positions_))->second;
+        for ( const Entry &posting : postings )
+            list.append(posting.first, weightOf(posting.second), positionOf(posting.second));
+        bufferedPostings_ += list.size();
+    }
+    buffer_.swap(buffer);
+
+    lastId_ = 0;
+    for ( uint32_t id : ids )
+        if ( id != REMOVED )
+            lastId_ = id;
+}
+
+
+
+/** ***************************************************************************/
+bool Core::TermDictionary::save(const QString &path, const vector<uint32_t> &ids, uint32_t itemCount,
+                                uint64_t generation) const {
+
+    // Rewrite the dictionary into a single segment with the stored ids
+    shared_ptr<const Segment> segment = merged();
+    SegmentBuilder builder(positions_);
+    vector<Entry> postings;
+    for ( size_t i = 0; i < segment->size; ++i ) {
+        postings.clear();
+        for ( PostingList::const_iterator it = segment->begin(i); it != segment->end(i); ++it )
+            if ( ids[*it] != REMOVED )
+                postings.emplace_back(ids[*it], pack(it.weight(), it.position()));
+        if ( postings.empty() )
+            continue;
+        std::sort(postings.begin(), postings.end());
+        vector<Entry>::iterator out = postings.begin();
+        for ( vector<Entry>::const_iterator it = postings.begin() + 1; it != postings.end(); ++it )
+            if ( it->first == out->first )
+                out->second = std::max(out->second, it->second);
+            else
+                *++out = *it;
+        postings.erase(out + 1, postings.end());
+        builder.append(segment->term(i), postings);
+    }
+    segment = builder.finish();
+
+    FileHeader header;
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(header.magic));
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.version = FILE_VERSION;
+    header.itemCount = itemCount;
+    header.termCount = segment->size;
+    header.termCharCount = segment->termOffsets[segment->size];
+    header.flags = (segment->latin1 ? LATIN1_TERMS : 0) | (positions_ ? POSITIONAL_POSTINGS : 0)
+            | (diacritics_ ? DIACRITIC_TERMS : 0);
+    header.postingsSize = segment->postingOffsets[segment->size];
+    header.postingCount = segment->postingCount;
+    header.longestPostings = segment->longestPostings;
+    header.longestTerm = segment->longestTerm;
+    header.generation = generation;
+    header.checksum = 0;
+    const FileLayout layout(header);
+
+    // Assemble everything up to the postings in memory
+    QByteArray head(static_cast<int>(layout.postings), '\0');
+    uint8_t *data = reinterpret_cast<uint8_t*>(head.data());
+    std::memcpy(data + layout.termOffsets, segment->termOffsets, (header.termCount + 1) * sizeof(uint32_t));
+    std::memcpy(data + layout.postingOffsets, segment->postingOffsets, (header.termCount + 1) * sizeof(uint32_t));
+    std::memcpy(data + layout.maxWeights, segment->maxWeights, header.termCount);
+    std::memcpy(data + layout.termChars, segment->termChars, header.termCharCount * FileLayout::charSize(header));
+    header.checksum = ::checksum(reinterpret_cast<const uint8_t*>(&header),
+                                 reinterpret_cast<const uint8_t*>(&header) + sizeof(FileHeader));
+    std::memcpy(data, &header, sizeof(FileHeader));
+
+    // Write to a temporary file and replace the file, mappings of the old one stay valid
+    QSaveFile file(path);
+    if ( !file.open(QIODevice::WriteOnly) )
+        return false;
+    const QByteArray padding(static_cast<int>(layout.size - layout.postings - header.postingsSize), '\0');
+    if ( file.write(head) != head.size()
+         || file.write(reinterpret_cast<const char*>(segment->postings), static_cast<qint64>(header.postingsSize))
+            != static_cast<qint64>(header.postingsSize)
+         || file.write(padding) != padding.size() ) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+
+
+/** ***************************************************************************/
+bool Core::TermDictionary::load(const QString &path, uint32_t itemCount) {
+
+    shared_ptr<QFile> file = std::make_shared<QFile>(path);
+    if ( !file->open(QIODevice::ReadOnly) || file->size() < static_cast<qint64>(sizeof(FileHeader)) )
+        return false;
+    const uint8_t *data = file->map(0, file->size());
+    if ( !data )
+        return false;
+
+    // Check the header and the size, the arrays are checked when used
+    FileHeader header;
+    std::memcpy(&header, data, sizeof(FileHeader));
+    if ( std::memcmp(header.magic, FILE_MAGIC, sizeof(header.magic)) != 0
+         || header.byteOrder != BYTE_ORDER_MARK
+         || header.version != FILE_VERSION
+         || (header.flags & ~(LATIN1_TERMS | POSITIONAL_POSTINGS | DIACRITIC_TERMS)) != 0
+         || ((header.flags & POSITIONAL_POSTINGS) != 0) != positions_
+         || ((header.flags & DIACRITIC_TERMS) != 0) != diacritics_
+         || header.itemCount != itemCount )
+        return false;
+    const FileLayout layout(header);
+    if ( layout.size != static_cast<uint64_t>(file->size()) )
+        return false;
+    const uint64_t storedChecksum = header.checksum;
+    header.checksum = 0;
+    if ( ::checksum(reinterpret_cast<const uint8_t*>(&header),
+                    reinterpret_cast<const uint8_t*>(&header) + sizeof(FileHeader)) != storedChecksum )
+        return false;
+
+    shared_ptr<Segment> segment = std::make_shared<Segment>();
+    segment->size = header.termCount;
+    segment->termOffsets = reinterpret_cast<const uint32_t*>(data + layout.termOffsets);
+    segment->postingOffsets = reinterpret_cast<const uint32_t*>(data + layout.postingOffsets);
+    segment->maxWeights = data + layout.maxWeights;
+    segment->latin1 = (header.flags & LATIN1_TERMS) != 0;
+    segment->positional = positions_;
+    segment->idLimit = itemCount;
+    segment->termChars = data + layout.termChars;
+    segment->postings = data + layout.postings;
+    segment->postingCount = header.postingCount;
+    segment->longestPostings = header.longestPostings;
+    segment->longestTerm = std::min(header.longestTerm, header.termCount);
+    segment->memory = file;
+
+    // The last offsets bound the ranges of the terms, see Segment::range
+    if ( segment->termOffsets[header.termCount] != header.termCharCount
+         || segment->postingOffsets[header.termCount] != header.postingsSize )
+        return false;
+
+    segments_.assign(1, segment);
+    buffer_.clear();
+    bufferedPostings_ = 0;
+    lastId_ = itemCount ? itemCount - 1 : 0;
+    checksum_ = storedChecksum;
+    generation_ = header.generation;
+    return true;
+}
+
+
+
+/** ***************************************************************************/
+Core::TermDictionary::Shape Core::TermDictionary::shape() const {
+
+    // The segments are measured when built, the buffer is small
+    Shape shape{0, 0, 0, QString(), 0, 0};
+    for ( const shared_ptr<const Segment> &segment : segments_ ) {
+        // The offset arrays have size+1 entries
+        const size_t charSize = segment->latin1 ? sizeof(uchar) : sizeof(ushort);
+        shape.termBytes += (segment->size + 1) * sizeof(uint32_t) + segment->termOffsets[segment->size] * charSize;
+        shape.postingBytes += (segment->size + 1) * sizeof(uint32_t) + segment->postingOffsets[segment->size]
+                + segment->size * sizeof(uint8_t);
+        shape.terms += segment->size;
+        shape.postings += segment->postingCount;
+        if ( segment->longestPostings > shape.longestPostings && segment->longestTerm < segment->size ) {
+            shape.longestPostings = segment->longestPostings;
+            shape.longestTerm = segment->term(segment->longestTerm).toString();
+        }
+    }
+
+    // Map nodes hold three pointers and a color, strings a header of 24 bytes
+    for ( const pair<const QString,PostingList> &entry : buffer_ ) {
+        shape.termBytes += 4 * sizeof(void*) + sizeof(entry) + 24
+                + static_cast<size_t>(entry.first.size() + 1) * sizeof(QChar);
+        shape.postingBytes += entry.second.heapSize();
+        ++shape.terms;
+        shape.postings += entry.second.size();
+        if ( entry.second.size() > shape.longestPostings ) {
+            shape.longestPostings = entry.second.size();
+            shape.longestTerm = entry.first;
+        }
+    }
+    return shape;
+}
+
+
+
+/** ***************************************************************************/
+void Core::TermDictionary::flush() {
+
+    if ( buffer_.empty() )
+        return;
+
+    // Turn the buffer into a segment
+    SegmentBuilder builder(positions_);
+    builder.reserve(buffer_.size(), bufferedPostings_ * (positions_ ? 3 : 2));
+    vector<Entry> postings;
+    for ( const pair<const QString,PostingList> &entry : buffer_ ) {
+        postings.clear();
+        decodePostings(entry.second.begin(), postings);
+        builder.append(Term(entry.first), postings);
+    }
+    buffer_.clear();
+    bufferedPostings_ = 0;
+    push(builder.finish());
+}
+
+
+
+/** ***************************************************************************/
+void Core::TermDictionary::push(shared_ptr<const Segment> segment) {
+
+    segments_.push_back(std::move(segment));
+
+    // Merge segments of similar size
+    while ( segments_.size() > 1 ) {
+        const Segment &older = *segments_[segments_.size()-2];
+        const Segment &newer = *segments_.back();
+        if ( older.postingOffsets[older.size] >= 2 * newer.postingOffsets[newer.size] )
+            break;
+        shared_ptr<const Segment> merged = merge(older, newer);
+        segments_.pop_back();
+        segments_.back() = merged;
+    }
+}
+
+
+
+/** ***************************************************************************/
+shared_ptr<const Core::TermDictionary::Segment> Core::TermDictionary::merged() const {
+    TermDictionary copy(*this);
+    copy.flush();
+    shared_ptr<const Segment> result;
+    for ( const shared_ptr<const Segment> &segment : copy.segments_ )
+        result = result ? merge(*result, *segment) : segment;
+    return result ? result : SegmentBuilder(positions_).finish();
+}
+
+
+
+/** ***************************************************************************/
+uint8_t Core::TermDictionary::maxWeight(PostingList::const_iterator it) {
+    uint8_t result = 0;
+    for ( ; it != PostingList::const_iterator(); ++it )
+        result = std::max(result, it.weight());
+    return result;
+}
+
+
+
+/** ***************************************************************************/
+shared_ptr<const Core::TermDictionary::Segment>
+Core::TermDictionary::merge(const Segment &older, const Segment &newer) {
+
+    SegmentBuilder builder(older.positional);
+    builder.reserve(older.size + newer.size,
+                    older.postingOffsets[older.size] + newer.postingOffsets[newer.size]);
+
+    size_t i = 0, j = 0;
+    while ( i < older.size && j < newer.size ) {
+        if ( older.term(i) < newer.term(j) )
+            builder.append(older, i++);
+        else if ( newer.term(j) < older.term(i) )
+            builder.append(newer, j++);
+        else {
+            // The ids of the newer segment are greater, the lists can be concatenated
+            vector<Entry> postings;
+            decodePostings(older.begin(i), postings);
+            decodePostings(newer.begin(j), postings);
+            builder.append(older.term(i), postings);
+            ++i; ++j;
+        }
+    }
+    for ( ; i < older.size; ++i )
+        builder.append(older, i);
+    for ( ; j < newer.size; ++j )
+        builder.append(newer, j);
+
+    return builder.finish();
+}
@@ -0,0 +1,486 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QString>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "intersection.h"
+#include "postinglist.h"
+#include "scoring.h"
+#include "term.h"
+
+namespace Core {
+
+/**
+ * @brief The TermDictionary class
+ * Maps lowercase terms to the sorted ids of the items containing them and the
+ * weight of the term for the item.
+ *
+ * The bulk of the dictionary lives in immutable segments: a sorted array of
+ * terms and a single buffer holding the delta encoded posting lists of all
+ * terms back to back. All terms sharing a prefix form a contiguous range in
+ * such an array, so expanding a prefix is a binary search for the range
+ * followed by a merge of contiguous posting lists.
+ *
+ * New postings are collected in a small buffer which is flushed into a new
+ * segment once it is full. Segments of similar size are merged like the
+ * digits of a binary counter, which keeps the number of segments
+ * logarithmic and the amortized insertion cost low.
+ *
+ * Segments are flat arrays without pointers, hence a dictionary can be
+ * written to a file and mapped into memory to be searched in place. The terms
+ * of a segment are stored as Latin-1 if all of them fit, which is the case
+ * for most file names and halves the memory of the terms.
+ *
+ * A dictionary can store the position of every posting, see PostingList.
+ * Positions are scored by the prefix postings and reported for phrases.
+ */
+class TermDictionary final
+{
+public:
+
+    // A posting of a batch
+    struct Posting {
+        QString term;
+        uint32_t id;
+        uint8_t weight;
+        uint8_t position;
+    };
+
+    // The size of a dictionary, see OfflineIndex::Stats
+    struct Shape {
+        size_t terms;
+        size_t postings;
+        size_t longestPostings;
+        QString longestTerm;
+        size_t termBytes;
+        size_t postingBytes;
+    };
+
+    /**
+     * @param positions Whether the postings store their position
+     * @param diacritics Whether the terms keep their diacritics. The
+     * dictionary does not normalize terms, files are only loaded by
+     * dictionaries of the same kind.
+     */
+    explicit TermDictionary(bool positions = false, bool diacritics = false);
+
+    /**
+     * @brief Whether the postings store their position
+     */
+    inline bool positions() const { return positions_; }
+
+    /**
+     * @brief Whether the terms keep their diacritics
+     */
+    inline bool diacritics() const { return diacritics_; }
+
+    /**
+     * @brief Adds a posting to the dictionary
+     * @param term The term to index. Has to be lowercase.
+     * @param id The item id. Has to be greater or equal to the last id added.
+     * @param weight The weight of the term for the item
+     * @param position The position of the term in the item, see
+     * Scoring::position. Ignored if the dictionary stores no positions.
+     */
+    void add(const QString &term, uint32_t id, uint8_t weight, uint8_t position = 0);
+
+    /**
+     * @brief Adds a batch of postings to the dictionary
+     * The postings are sorted and written into a segment at once, which is a
+     * lot cheaper than adding them one by one.
+     * @param postings The postings to add, in any order. Sorted in place. The
+     * ids have to be greater or equal to the last id added.
+     */
+    void add(std::vector<Posting> &postings);
+
+    /**
+     * @brief Appends the postings of another dictionary
+     * Used to combine dictionaries built concurrently for consecutive ranges
+     * of ids. The segments are merged into a single one.
+     * @param other The dictionary to append. Its ids have to be greater than
+     * the ids of this dictionary, both have to store positions or not.
+     */
+    void append(const TermDictionary &other);
+
+    /**
+     * @brief Clears the dictionary
+     */
+    void clear();
+
+    /**
+     * @brief Replaces the id of every posting by ids[id]
+     * Postings mapped to REMOVED are dropped, terms without postings vanish.
+     * The mapping has to preserve the order of the ids. The segments are
+     * merged into a single one.
+     * @param ids The new ids, indexed by the current ids
+     */
+    void remap(const std::vector<uint32_t> &ids);
+
+    /**
+     * @brief Writes the dictionary to a file
+     * The postings are stored with the ids replaced by ids[id], which need not
+     * preserve the order. Postings mapped to REMOVED are dropped.
+     * @param path The file to write. Replaced atomically.
+     * @param ids The ids to store, indexed by the current ids
+     * @param itemCount The number of distinct ids stored
+     * @param generation Identifies the files saved together, see generation()
+     * @return True on success
+     */
+    bool save(const QString &path, const std::vector<uint32_t> &ids, uint32_t itemCount,
+              uint64_t generation) const;
+
+    /**
+     * @brief Replaces the dictionary by one written by save
+     * The file is mapped into memory and not read until it is searched. The
+     * file format version, the checksum of the header and the item count
+     * are checked, as well as whether the file stores positions and keeps
+     * diacritics like this dictionary.
+     * @param path The file to map
+     * @param itemCount The number of items the dictionary has to refer to
+     * The postings are not read, a posting list ends before the first id
+     * that is not less than itemCount.
+     * @return False if the file is not usable, the dictionary is unchanged
+     */
+    bool load(const QString &path, uint32_t itemCount);
+
+    /**
+     * @brief The checksum of the file the dictionary was loaded from last, 0
+     * if it was not loaded
+     * Identifies the file, files derived from it can refer to it by this.
+     */
+    inline uint64_t checksum() const { return checksum_; }
+
+    /**
+     * @brief The generation passed to save of the file the dictionary was
+     * loaded from last, 0 if it was not loaded
+     */
+    inline uint64_t generation() const { return generation_; }
+
+    /**
+     * @brief Measures the dictionary
+     * The segments are measured when they are built, linear in the number
+     * of segments and the size of the buffer.
+     */
+    Shape shape() const;
+
+    static constexpr uint32_t REMOVED = 0xFFFFFFFF;
+
+    /**
+     * @brief Calls visit(term, begin, end, maxWeight) for every term starting
+     * with prefix
+     * The posting lists of a term can be split across several segments, hence
+     * a term can be visited more than once (with disjoint posting lists).
+     * maxWeight is the greatest weight in the list, which bounds the scores
+     * the postings can contribute.
+     */
+    template<typename Visitor>
+    void visitPrefix(const QString &prefix, Visitor visit) const;
+
+    /**
+     * @brief Calls visit(term, begin, end) for the postings of term
+     */
+    template<typename Visitor>
+    void visitTerm(const QString &term, Visitor visit) const;
+    template<typename Visitor>
+    void visitTerm(const Term &term, Visitor visit) const;
+
+    /**
+     * @brief Calls visit(term, begin, end) for every term of the dictionary
+     */
+    template<typename Visitor>
+    void visitAll(Visitor visit) const;
+
+    /**
+     * @brief Appends the scored postings of all terms starting with prefix
+     * The score of a posting is its weight times the quality(term) of the
+     * term. Postings of the same item are merged keeping the best score, the
+     * result is sorted by id.
+     */
+    template<typename TermQuality>
+    void prefixPostings(const QString &prefix, TermQuality quality,
+                        std::vector<ScoredId> &postings) const;
+
+    /**
+     * @brief Appends the scored postings of all terms starting with prefix
+     * whose ids are among the candidates
+     * The candidates have to be sorted by id. The result is at most as long
+     * as the candidates.
+     */
+    template<typename TermQuality>
+    void prefixPostings(const QString &prefix, TermQuality quality,
+                        const std::vector<ScoredId> &candidates,
+                        std::vector<ScoredId> &postings) const;
+
+    /**
+     * @brief Appends the scored postings of all terms starting with prefix
+     * whose ids are among the candidates and the positions of the postings
+     * The position of a match is the one of its best posting, positions are
+     * aligned with the postings.
+     */
+    template<typename TermQuality>
+    void prefixPostings(const QString &prefix, TermQuality quality,
+                        const std::vector<ScoredId> &candidates,
+                        std::vector<ScoredId> &postings,
+                        std::vector<uint8_t> &positions) const;
+
+private:
+
+    struct Segment {
+        uint32_t size;                      // Number of terms
+        bool latin1;                        // Terms are Latin-1, else UTF-16
+        bool positional;                    // Postings store their position
+        uint32_t idLimit;                   // Ids are less, bounds the ids of a file
+        const uint32_t *termOffsets;        // Begin of a term in termChars, size+1
+        const void *termChars;              // Sorted terms back to back
+        const uint32_t *postingOffsets;     // Begin of the postings of a term, size+1
+        const uint8_t *postings;            // Delta encoded posting lists
+        const uint8_t *maxWeights;          // Greatest weight in the postings of a term
+        uint64_t postingCount;              // Number of postings, counted when built
+        uint32_t longestPostings;           // Length of the longest posting list
+        uint32_t longestTerm;               // The term having it, size if there is none
+        std::shared_ptr<const void> memory; // Owns the arrays, a buffer or a mapped file
+
+        inline const uchar *latin1Chars() const { return static_cast<const uchar*>(termChars); }
+        inline const ushort *utf16Chars() const { return static_cast<const ushort*>(termChars); }
+        inline std::pair<uint32_t,uint32_t> range(const uint32_t *offsets, size_t i) const {
+            // Files are not checked on load, the range of a corrupted entry is empty
+            const uint32_t first = offsets[i], last = offsets[i+1];
+            return ( first <= last && last <= offsets[size] ) ? std::make_pair(first, last)
+                                                              : std::make_pair(0u, 0u);
+        }
+        inline Term term(size_t i) const {
+            const std::pair<uint32_t,uint32_t> chars = range(termOffsets, i);
+            return latin1 ? Term(latin1Chars() + chars.first, chars.second - chars.first)
+                          : Term(utf16Chars() + chars.first, chars.second - chars.first);
+        }
+        inline PostingList::const_iterator begin(size_t i) const {
+            const std::pair<uint32_t,uint32_t> bytes = range(postingOffsets, i);
+            return PostingList::const_iterator(postings + bytes.first, postings + bytes.second,
+                                               positional, idLimit);
+        }
+        inline PostingList::const_iterator end(size_t) const { return PostingList::const_iterator(); }
+        inline size_t lowerBound(const Term &term) const {
+            // Dispatch once, the binary search compares fixed encodings
+            if ( latin1 )
+                return term.isLatin1() ? lowerBound(latin1Chars(), term.latin1(), term.size())
+                                       : lowerBound(latin1Chars(), term.utf16(), term.size());
+            return term.isLatin1() ? lowerBound(utf16Chars(), term.latin1(), term.size())
+                                   : lowerBound(utf16Chars(), term.utf16(), term.size());
+        }
+        template<typename Char, typename KeyChar>
+        inline size_t lowerBound(const Char *chars, const KeyChar *key, uint32_t keySize) const {
+            size_t first = 0, count = size;
+            while ( count > 0 ) {
+                size_t step = count / 2;
+                const std::pair<uint32_t,uint32_t> term = range(termOffsets, first + step);
+                if ( Term::less(chars + term.first, term.second - term.first, key, keySize) ) {
+                    first += step + 1;
+                    count -= step + 1;
+                } else
+                    count = step;
+            }
+            return first;
+        }
+    };
+
+    class SegmentBuilder;
+
+    void flush();
+    void push(std::shared_ptr<const Segment> segment);
+    std::shared_ptr<const Segment> merged() const;
+    static uint8_t maxWeight(PostingList::const_iterator it);
+    template<typename TermQuality>
+    void mergePostings(const QString &prefix, TermQuality quality,
+                       const std::vector<ScoredId> *candidates,
+                       std::vector<ScoredId> &postings,
+                       std::vector<uint8_t> *positions) const;
+    static std::shared_ptr<const Segment> merge(const Segment &older, const Segment &newer);
+
+    // Segments are immutable, copies of the dictionary share them
+    std::vector<std::shared_ptr<const Segment>> segments_;
+    std::map<QString,PostingList> buffer_;
+    uint32_t bufferedPostings_;
+    uint32_t lastId_;
+    bool positions_;
+    bool diacritics_;
+    uint64_t checksum_;
+    uint64_t generation_;
+
+};
+
+
+
+/** ***************************************************************************/
+template<typename Visitor>
+void TermDictionary::visitPrefix(const QString &prefix, Visitor visit) const {
+    const Term prefixTerm(prefix);
+    for ( const std::shared_ptr<const Segment> &segment : segments_ ) {
+        for ( size_t i = segment->lowerBound(prefixTerm);
+              i < segment->size && segment->term(i).startsWith(prefixTerm); ++i )
+            visit(segment->term(i), segment->begin(i), segment->end(i), segment->maxWeights[i]);
+    }
+    for ( std::map<QString,PostingList>::const_iterator it = buffer_.lower_bound(prefix);
+          it != buffer_.end() && it->first.startsWith(prefix); ++it )
+        visit(Term(it->first), it->second.begin(), it->second.end(), maxWeight(it->second.begin()));
+}
+
+
+
+/** ***************************************************************************/
+template<typename TermQuality>
+void TermDictionary::prefixPostings(const QString &prefix, TermQuality quality,
+                                    std::vector<ScoredId> &postings) const {
+    mergePostings(prefix, quality, nullptr, postings, nullptr);
+}
+
+
+
+/** ***************************************************************************/
+template<typename TermQuality>
+void TermDictionary::prefixPostings(const QString &prefix, TermQuality quality,
+                                    const std::vector<ScoredId> &candidates,
+                                    std::vector<ScoredId> &postings) const {
+    mergePostings(prefix, quality, &candidates, postings, nullptr);
+}
+
+
+
+/** ***************************************************************************/
+template<typename TermQuality>
+void TermDictionary::prefixPostings(const QString &prefix, TermQuality quality,
+                                    const std::vector<ScoredId> &candidates,
+                                    std::vector<ScoredId> &postings,
+                                    std::vector<uint8_t> &positions) const {
+    mergePostings(prefix, quality, &candidates, postings, &positions);
+}
+
+
+
+/** ***************************************************************************/
+template<typename TermQuality>
+void TermDictionary::mergePostings(const QString &prefix, TermQuality quality,
+                                   const std::vector<ScoredId> *candidates,
+                                   std::vector<ScoredId> &postings,
+                                   std::vector<uint8_t> *positions) const {
+
+    // Collect the posting lists of the range
+    struct Cursor {
+        Cursor(PostingList::const_iterator it, uint32_t quality) : it(it), quality(quality) {}
+        PostingList::const_iterator it;
+        uint32_t quality;
+    };
+    std::vector<Cursor> cursors;
+    visitPrefix(prefix, [&cursors, &quality](const Term &term, PostingList::const_iterator begin,
+                                             PostingList::const_iterator end, uint8_t){
+        if ( begin != end )
+            cursors.emplace_back(begin, quality(term));
+    });
+
+    // K-way merge of the sorted lists using a min heap on the current ids.
+    // The ids come in ascending order, so do the candidates they are looked up in.
+    std::vector<ScoredId>::const_iterator candidate;
+    if ( candidates )
+        candidate = candidates->begin();
+    auto greater = [](const Cursor &lhs, const Cursor &rhs){ return *lhs.it > *rhs.it; };
+    std::make_heap(cursors.begin(), cursors.end(), greater);
+    const size_t offset = postings.size();
+    while ( !cursors.empty() ) {
+        std::pop_heap(cursors.begin(), cursors.end(), greater);
+        Cursor &cursor = cursors.back();
+        bool match = true;
+        if ( candidates ) {
+            candidate = gallop(candidate, candidates->end(), *cursor.it);
+            if ( candidate == candidates->end() )
+                break;
+            match = candidate->id == *cursor.it;
+        }
+        if ( match ) {
+            // Ties keep the smaller position, whatever the order of the lists
+            const uint32_t score = Scoring::wordScore(cursor.it.weight(), cursor.quality, cursor.it.position());
+            if ( postings.size() == offset || postings.back().id != *cursor.it ) {
+                postings.emplace_back(*cursor.it, score);
+                if ( positions )
+                    positions->push_back(cursor.it.position());
+            } else if ( score > postings.back().score ) {
+                postings.back().score = score;
+                if ( positions )
+                    positions->back() = cursor.it.position();
+            } else if ( positions && score == postings.back().score )
+                positions->back() = std::min(positions->back(), cursor.it.position());
+        }
+        if ( ++cursor.it == PostingList::const_iterator() )
+            cursors.pop_back();
+        else
+            std::push_heap(cursors.begin(), cursors.end(), greater);
+    }
+}
+
+
+
+/** ***************************************************************************/
+template<typename Visitor>
+void TermDictionary::visitTerm(const QString &term, Visitor visit) const {
+    const Term key(term);
+    for ( const std::shared_ptr<const Segment> &segment : segments_ ) {
+        size_t i = segment->lowerBound(key);
+        if ( i < segment->size && segment->term(i) == key )
+            visit(segment->term(i), segment->begin(i), segment->end(i));
+    }
+    std::map<QString,PostingList>::const_iterator it = buffer_.find(term);
+    if ( it != buffer_.end() )
+        visit(Term(it->first), it->second.begin(), it->second.end());
+}
+
+
+
+/** ***************************************************************************/
+template<typename Visitor>
+void TermDictionary::visitTerm(const Term &term, Visitor visit) const {
+    for ( const std::shared_ptr<const Segment> &segment : segments_ ) {
+        size_t i = segment->lowerBound(term);
+        if ( i < segment->size && segment->term(i) == term )
+            visit(segment->term(i), segment->begin(i), segment->end(i));
+    }
+    if ( buffer_.empty() )
+        return;
+
+    // The buffer is keyed by strings, wrap UTF-16 terms without a copy
+    const QString key = term.isLatin1()
+            ? term.toString()
+            : QString::fromRawData(reinterpret_cast<const QChar*>(term.utf16()), static_cast<int>(term.size()));
+    std::map<QString,PostingList>::const_iterator it = buffer_.find(key);
+    if ( it != buffer_.end() )
+        visit(Term(it->first), it->second.begin(), it->second.end());
+}
+
+
+
+/** ***************************************************************************/
+template<typename Visitor>
+void TermDictionary::visitAll(Visitor visit) const {
+    for ( const std::shared_ptr<const Segment> &segment : segments_ )
+        for ( size_t i = 0; i < segment->size; ++i )
+            visit(segment->term(i), segment->begin(i), segment->end(i));
+    for ( const std::pair<const QString,PostingList> &entry : buffer_ )
+        visit(Term(entry.first), entry.second.begin(), entry.second.end());
+}
+
+}
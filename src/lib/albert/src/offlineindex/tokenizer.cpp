@@ -0,0 +1,252 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <atomic>
+#include "tokenizer.h"
+
+namespace {
+
+// Separate words, like in "file_name.tar.gz" or "Visual Studio Code"
+const char SEPARATORS[] = "!?<>\"'=+*.:,;\\/ _-";
+
+// Marks a separator in the tables
+const ushort SEPARATOR = 0;
+
+/** ***************************************************************************/
+uint foldedCase(uint ucs4) {
+    return QChar::toCaseFolded(ucs4);
+}
+
+// The Hangul syllables, which decompose into letters rather than diacritics
+const uint HANGUL_FIRST = 0xAC00;
+const uint HANGUL_LAST = 0xD7A3;
+
+// Marks a computed entry of the cache
+const uint32_t CACHED = 0x80000000;
+
+/** ***************************************************************************/
+uint withoutDiacritics(uint ucs4) {
+    // The base character of the canonical decomposition, which can itself
+    // be decomposable, e.g. ǘ to ü to u. Only if the rest are non-spacing
+    // marks, the Bengali "ো" decomposes into two spacing vowel signs.
+    while ( QChar::decompositionTag(ucs4) == QChar::Canonical
+            && (ucs4 < HANGUL_FIRST || ucs4 > HANGUL_LAST) ) {
+        const QString decomposition = QChar::decomposition(ucs4);
+        uint base = 0;
+        for ( int i = 0; i < decomposition.size(); ++i ) {
+            uint c = decomposition.at(i).unicode();
+            if ( decomposition.at(i).isHighSurrogate() && i + 1 < decomposition.size() )
+                c = QChar::surrogateToUcs4(decomposition.at(i), decomposition.at(i+1));
+            if ( i == 0 )
+                base = c;
+            else if ( QChar::category(c) != QChar::Mark_NonSpacing )
+                return ucs4;
+            if ( QChar::requiresSurrogates(c) )
+                ++i;
+        }
+        if ( base == ucs4 )
+            break;
+        ucs4 = base;
+    }
+    return ucs4;
+}
+
+/** ***************************************************************************/
+uint stripped(uint ucs4) {
+    // Returns 0 for code points to drop
+    if ( QChar::category(ucs4) == QChar::Mark_NonSpacing )
+        return 0;
+    return foldedCase(withoutDiacritics(foldedCase(ucs4)));
+}
+
+/** ***************************************************************************/
+struct Latin1Table {
+    Latin1Table() {
+        for ( uint c = 0; c < 256; ++c ) {
+            folded[c] = static_cast<ushort>(foldedCase(c));
+            stripped[c] = static_cast<ushort>(foldedCase(withoutDiacritics(foldedCase(c))));
+        }
+        folded[0] = stripped[0] = SEPARATOR;
+        for ( const char *c = SEPARATORS; *c; ++c )
+            folded[static_cast<uchar>(*c)] = stripped[static_cast<uchar>(*c)] = SEPARATOR;
+    }
+    // The normalized code unit or SEPARATOR
+    ushort folded[256];
+    ushort stripped[256];
+};
+
+/** ***************************************************************************/
+const Latin1Table &latin1Table() {
+    static const Latin1Table table;
+    return table;
+}
+
+/** ***************************************************************************/
+bool isBoundary(const QString &text, int i) {
+    // Between i-1 and i, like in camel|Case, XML|Parser, version|2
+    const QChar previous = text.at(i-1), current = text.at(i);
+    if ( previous.isLower() && current.isUpper() )
+        return true;
+    if ( previous.isDigit() != current.isDigit() && (previous.isLetter() || current.isLetter()) )
+        return true;
+    return previous.isUpper() && current.isUpper() && i + 1 < text.size() && text.at(i+1).isLower();
+}
+
+}
+
+
+
+/** ***************************************************************************/
+Core::Tokenizer::Tokenizer(bool stripDiacritics) : stripDiacritics_(stripDiacritics) {
+    // Build the table before the first use on concurrent threads
+    latin1Table();
+}
+
+
+
+/** ***************************************************************************/
+QStringList Core::Tokenizer::tokenize(const QString &text) const {
+    QStringList words;
+    tokenize(text, [&words](const QString &word){ words.append(word); });
+    return words;
+}
+
+
+
+/** ***************************************************************************/
+QStringList Core::Tokenizer::subwords(const QString &text) const {
+
+    const ushort *latin1 = latin1Table().folded;
+    const ushort *data = text.utf16();
+    const int size = text.size();
+    QStringList subwords;
+    QString initials;
+    int partCount = 0;
+
+    for ( int position = 0; ; ) {
+        while ( position < size && data[position] < 256 && latin1[data[position]] == SEPARATOR )
+            ++position;
+        if ( position == size )
+            break;
+        int end = position;
+        while ( end < size && (data[end] >= 256 || latin1[data[end]] != SEPARATOR) )
+            ++end;
+
+        // Split the word at the boundaries, normalizing the parts
+        QStringList parts;
+        for ( int begin = position, i = position + 1; i <= end; ++i ) {
+            if ( i < end && !isBoundary(text, i) )
+                continue;
+            int partPosition = 0;
+            QString part;
+            if ( next(text.mid(begin, i - begin), partPosition, part) )
+                parts.append(part);
+            begin = i;
+        }
+        for ( int i = 1; i < parts.size(); ++i )
+            subwords.append(parts.at(i));
+        for ( const QString &part : parts )
+            initials.append(part.left(part.at(0).isHighSurrogate() ? 2 : 1));
+        partCount += parts.size();
+        position = end;
+    }
+
+    if ( partCount > 1 )
+        subwords.append(initials);
+    return subwords;
+}
+
+
+
+/** ***************************************************************************/
+bool Core::Tokenizer::next(const QString &text, int &position, QString &word) const {
+
+    const Latin1Table &table = latin1Table();
+    const ushort *latin1 = stripDiacritics_ ? table.stripped : table.folded;
+    const ushort *data = text.utf16();
+    const int size = text.size();
+
+    do {
+        // Skip leading separators, there are no separators outside of Latin-1
+        while ( position < size && data[position] < 256 && latin1[data[position]] == SEPARATOR )
+            ++position;
+        if ( position == size )
+            return false;
+
+        // Find the end of the word
+        int end = position;
+        bool latin1Only = true;
+        while ( end < size && (data[end] >= 256 || latin1[data[end]] != SEPARATOR) ) {
+            latin1Only = latin1Only && data[end] < 256;
+            ++end;
+        }
+
+        // Latin-1 words normalize code unit by code unit
+        word = QString(end - position, Qt::Uninitialized);
+        QChar *out = word.data();
+        if ( latin1Only ) {
+            for ( ; position < end; ++position )
+                *out++ = QChar(latin1[data[position]]);
+            return true;
+        }
+
+        // Others shrink by dropped combining marks and surrogate pairs may
+        // fold to single code units. No code unit folds to a pair.
+        for ( ; position < end; ++position ) {
+            uint ucs4 = data[position];
+            if ( ucs4 < 256 ) {
+                *out++ = QChar(latin1[ucs4]);
+                continue;
+            }
+            if ( QChar::isHighSurrogate(ucs4) && position + 1 < end && QChar::isLowSurrogate(data[position+1]) )
+                ucs4 = QChar::surrogateToUcs4(static_cast<ushort>(ucs4), data[++position]);
+            ucs4 = normalized(ucs4);
+            if ( ucs4 == 0 )
+                continue;
+            if ( QChar::requiresSurrogates(ucs4) ) {
+                *out++ = QChar(QChar::highSurrogate(ucs4));
+                *out++ = QChar(QChar::lowSurrogate(ucs4));
+            } else
+                *out++ = QChar(static_cast<ushort>(ucs4));
+        }
+        word.truncate(static_cast<int>(out - word.data()));
+
+    // Words of combining marks only vanish
+    } while ( word.isEmpty() );
+
+    return true;
+}
+
+
+
+/** ***************************************************************************/
+uint Core::Tokenizer::normalized(uint ucs4) const {
+    // Returns 0 for code points to drop
+    if ( !stripDiacritics_ )
+        return foldedCase(ucs4);
+    if ( ucs4 > 0xFFFF )
+        return stripped(ucs4);
+
+    // Decompositions are costly, the BMP is cached like the Latin-1 table.
+    // Threads filling an entry concurrently store the same value.
+    static std::atomic<uint32_t> cache[0x10000];
+    uint32_t entry = cache[ucs4].load(std::memory_order_relaxed);
+    if ( !(entry & CACHED) ) {
+        entry = stripped(ucs4) | CACHED;
+        cache[ucs4].store(entry, std::memory_order_relaxed);
+    }
+    return entry & ~CACHED;
+}
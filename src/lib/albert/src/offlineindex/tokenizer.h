@@ -0,0 +1,86 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+#include <QString>
+#include <QStringList>
+
+namespace Core {
+
+/**
+ * @brief The Tokenizer class
+ * Splits text into the normalized words the offline index is built of and
+ * searched by. Words are separated by ASCII punctuation and spaces. They are
+ * case folded and optionally stripped of diacritics, so that "Café" and
+ * "cafe" are the same word.
+ *
+ * Latin-1 code units are classified and normalized by a precomputed table,
+ * the Unicode database is consulted for other code units only. The
+ * normalizations of the BMP are cached, each is looked up once.
+ */
+class Tokenizer final
+{
+public:
+
+    /**
+     * @param stripDiacritics Whether to drop diacritics from the words
+     */
+    explicit Tokenizer(bool stripDiacritics = true);
+
+    /**
+     * @brief Calls visit(const QString &word) for the words of text in order
+     */
+    template<typename Visitor>
+    void tokenize(const QString &text, Visitor visit) const;
+
+    /**
+     * @brief The words of text in order
+     */
+    QStringList tokenize(const QString &text) const;
+
+    /**
+     * @brief The sub-words of text, normalized like words
+     * Words are split at camelCase and digit boundaries, e.g. "LibreOffice"
+     * into "libre" and "office" or "XMLParser2" into "xml", "parser" and "2".
+     * The sub-words are the parts but the first of every split word, which
+     * the word starts with anyway, followed by the initials of all parts if
+     * there are several, e.g. "gimp" for "GNU Image Manipulation Program" or
+     * "lo" for "LibreOffice".
+     */
+    QStringList subwords(const QString &text) const;
+
+    inline bool stripsDiacritics() const { return stripDiacritics_; }
+
+private:
+
+    bool next(const QString &text, int &position, QString &word) const;
+    uint normalized(uint ucs4) const;
+
+    bool stripDiacritics_;
+};
+
+
+
+/** ***************************************************************************/
+template<typename Visitor>
+void Tokenizer::tokenize(const QString &text, Visitor visit) const {
+    int position = 0;
+    QString word;
+    while ( next(text, position, word) )
+        visit(static_cast<const QString&>(word));
+}
+
+}
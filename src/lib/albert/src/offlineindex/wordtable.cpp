@@ -0,0 +1,228 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <QFile>
+#include <QSaveFile>
+#include <cstring>
+#include "wordtable.h"
+using std::shared_ptr;
+using std::vector;
+
+namespace {
+
+// The file format. Bump the version on any change of the layout.
+const char FILE_MAGIC[8] = {'A','L','B','E','R','T','W','T'};
+const uint32_t FILE_VERSION = 2;
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+/*
+ * The header is followed by the arrays of the table, each aligned to 8 bytes:
+ * wordOffsets, wordChars (UTF-16), keys, keyOffsets and records. The checksum
+ * covers the header only, the offsets are checked when used, see range.
+ */
+struct FileHeader {
+    char magic[8];
+    uint32_t byteOrder;
+    uint32_t version;
+    uint32_t parameter;
+    uint32_t recordSize;
+    uint32_t wordCount;
+    uint32_t wordCharCount;
+    uint32_t keyCount;
+    uint32_t recordCount;
+    uint64_t tag;
+    uint64_t checksum;
+};
+
+/** ***************************************************************************/
+struct FileLayout {
+    explicit FileLayout(const FileHeader &header) {
+        wordOffsets = align(sizeof(FileHeader));
+        wordChars = align(wordOffsets + (header.wordCount + 1) * sizeof(uint32_t));
+        keys = align(wordChars + header.wordCharCount * sizeof(ushort));
+        keyOffsets = align(keys + header.keyCount * sizeof(uint64_t));
+        records = align(keyOffsets + (header.keyCount + 1) * sizeof(uint32_t));
+        size = align(records + static_cast<uint64_t>(header.recordCount) * header.recordSize);
+    }
+    static uint64_t align(uint64_t offset) { return (offset + 7) & ~static_cast<uint64_t>(7); }
+    uint64_t wordOffsets;
+    uint64_t wordChars;
+    uint64_t keys;
+    uint64_t keyOffsets;
+    uint64_t records;
+    uint64_t size;
+};
+
+/** ***************************************************************************/
+uint64_t checksum(const uint8_t *begin, const uint8_t *end, uint64_t hash = 0xcbf29ce484222325) {
+    // FNV-1a
+    for ( ; begin != end; ++begin )
+        hash = (hash ^ *begin) * 0x100000001b3;
+    return hash;
+}
+
+}
+
+
+
+/** ***************************************************************************/
+Core::WordTable::WordTable() {
+    clear();
+}
+
+
+
+/** ***************************************************************************/
+void Core::WordTable::clear() {
+    static const uint32_t emptyOffsets[1] = {0};
+    wordCount_ = 0;
+    wordOffsets_ = emptyOffsets;
+    wordChars_ = nullptr;
+    keyCount_ = 0;
+    keys_ = nullptr;
+    keyOffsets_ = emptyOffsets;
+    records_ = nullptr;
+    memory_.reset();
+}
+
+
+
+/** ***************************************************************************/
+uint32_t Core::WordTable::find(const Term &word) const {
+    uint32_t first = 0;
+    uint32_t count = wordCount_;
+    while ( count > 0 ) {
+        const uint32_t step = count / 2;
+        if ( this->word(first + step) < word ) {
+            first += step + 1;
+            count -= step + 1;
+        } else
+            count = step;
+    }
+    return ( first < wordCount_ && this->word(first) == word ) ? first : wordCount_;
+}
+
+
+
+/** ***************************************************************************/
+size_t Core::WordTable::bytes() const {
+    return memory_ ? static_cast<size_t>(memory_->size()) : 0;
+}
+
+
+
+/** ***************************************************************************/
+bool Core::WordTable::write(const QString &path, uint64_t tag, uint32_t parameter, const vector<Term> &words,
+                            const vector<uint64_t> &keys, const vector<uint32_t> &keyOffsets,
+                            const void *records, uint32_t recordSize) {
+
+    vector<uint32_t> wordOffsets(1, 0);
+    for ( const Term &word : words )
+        wordOffsets.push_back(wordOffsets.back() + word.size());
+
+    FileHeader header;
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(header.magic));
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.version = FILE_VERSION;
+    header.parameter = parameter;
+    header.recordSize = recordSize;
+    header.wordCount = static_cast<uint32_t>(words.size());
+    header.wordCharCount = wordOffsets.back();
+    header.keyCount = static_cast<uint32_t>(keys.size());
+    header.recordCount = keyOffsets.back();
+    header.tag = tag;
+    header.checksum = 0;
+    const FileLayout layout(header);
+
+    // Assemble everything up to the records in memory
+    QByteArray head(static_cast<int>(layout.records), '\0');
+    uint8_t *data = reinterpret_cast<uint8_t*>(head.data());
+    std::memcpy(data + layout.wordOffsets, wordOffsets.data(), wordOffsets.size() * sizeof(uint32_t));
+    ushort *chars = reinterpret_cast<ushort*>(data + layout.wordChars);
+    for ( const Term &word : words )
+        for ( uint32_t i = 0; i < word.size(); ++i )
+            *chars++ = word.at(i);
+    std::memcpy(data + layout.keys, keys.data(), keys.size() * sizeof(uint64_t));
+    std::memcpy(data + layout.keyOffsets, keyOffsets.data(), keyOffsets.size() * sizeof(uint32_t));
+    header.checksum = checksum(reinterpret_cast<const uint8_t*>(&header),
+                               reinterpret_cast<const uint8_t*>(&header) + sizeof(FileHeader));
+    std::memcpy(data, &header, sizeof(FileHeader));
+
+    // Write to a temporary file and replace the file, mappings of the old one stay valid
+    QSaveFile file(path);
+    if ( !file.open(QIODevice::WriteOnly) )
+        return false;
+    const qint64 recordBytes = static_cast<qint64>(header.recordCount) * recordSize;
+    const QByteArray padding(static_cast<int>(layout.size - layout.records - recordBytes), '\0');
+    if ( file.write(head) != head.size()
+         || file.write(static_cast<const char*>(records), recordBytes) != recordBytes
+         || file.write(padding) != padding.size() ) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+
+
+/** ***************************************************************************/
+bool Core::WordTable::load(const QString &path, uint64_t tag, uint32_t parameter, uint32_t recordSize) {
+
+    clear();
+    shared_ptr<QFile> file = std::make_shared<QFile>(path);
+    if ( !file->open(QIODevice::ReadOnly) || file->size() < static_cast<qint64>(sizeof(FileHeader)) )
+        return false;
+    const uint8_t *data = file->map(0, file->size());
+    if ( !data )
+        return false;
+
+    // Check the header and the size, the arrays are checked when used
+    FileHeader header;
+    std::memcpy(&header, data, sizeof(FileHeader));
+    if ( std::memcmp(header.magic, FILE_MAGIC, sizeof(header.magic)) != 0
+         || header.byteOrder != BYTE_ORDER_MARK
+         || header.version != FILE_VERSION
+         || header.parameter != parameter
+         || header.recordSize != recordSize
+         || header.tag != tag )
+        return false;
+    const FileLayout layout(header);
+    if ( layout.size != static_cast<uint64_t>(file->size()) )
+        return false;
+    const uint64_t storedChecksum = header.checksum;
+    header.checksum = 0;
+    if ( checksum(reinterpret_cast<const uint8_t*>(&header),
+                  reinterpret_cast<const uint8_t*>(&header) + sizeof(FileHeader)) != storedChecksum )
+        return false;
+
+    // The last offsets bound the ranges of the entries, see range
+    const uint32_t *wordOffsets = reinterpret_cast<const uint32_t*>(data + layout.wordOffsets);
+    const uint32_t *keyOffsets = reinterpret_cast<const uint32_t*>(data + layout.keyOffsets);
+    if ( wordOffsets[header.wordCount] != header.wordCharCount
+         || keyOffsets[header.keyCount] != header.recordCount )
+        return false;
+
+    wordCount_ = header.wordCount;
+    wordOffsets_ = wordOffsets;
+    wordChars_ = reinterpret_cast<const ushort*>(data + layout.wordChars);
+    keyCount_ = header.keyCount;
+    keys_ = reinterpret_cast<const uint64_t*>(data + layout.keys);
+    keyOffsets_ = keyOffsets;
+    records_ = data + layout.records;
+    memory_ = file;
+    return true;
+}
@@ -0,0 +1,155 @@
+// albert - a simple application launcher for linux
+// Copyright (C) 2014-2017 Manuel Schneider
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+
+#pragma once
+#include <QString>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "term.h"
+class QFile;
+
+namespace Core {
+
+/**
+ * @brief The WordTable class
+ * The distinct words of a saved index and a table mapping 64 bit keys to
+ * records referencing the words, like the q-grams or deletions of a fuzzy
+ * search. The table is written next to the dictionary and mapped into memory
+ * on load, such that it is not rebuilt from the terms on every start.
+ *
+ * The words are sorted and numbered by their rank. The file is tagged with
+ * the checksum of the dictionary it was built from, a table never loads for
+ * another dictionary. Like a dictionary the table is not read on load, only
+ * its header is checksummed. A corrupted entry reads as empty, record ids
+ * have to be checked against size() by the reader.
+ */
+class WordTable final
+{
+public:
+
+    WordTable();
+
+    /**
+     * @brief Writes a table
+     * @param tag Identifies the dictionary the words are taken from
+     * @param parameter Identifies the parameters the keys are computed with
+     * @param words The sorted distinct words
+     * @param entries The keys and their records, sorted by key
+     */
+    template<typename Record>
+    static bool save(const QString &path, uint64_t tag, uint32_t parameter, const std::vector<Term> &words,
+                     const std::vector<std::pair<uint64_t,Record>> &entries);
+
+    /**
+     * @brief Maps a table into memory
+     * Fails and leaves the table empty if the file is missing, its header is
+     * corrupted or it does not match the tag, the parameter or the record
+     * size.
+     */
+    bool load(const QString &path, uint64_t tag, uint32_t parameter, uint32_t recordSize);
+
+    /**
+     * @brief Unmaps the table
+     */
+    void clear();
+
+    /**
+     * @brief The number of words
+     */
+    inline uint32_t size() const { return wordCount_; }
+
+    /**
+     * @brief The word of an id
+     */
+    inline Term word(uint32_t id) const {
+        const std::pair<uint32_t,uint32_t> chars = range(wordOffsets_, wordCount_, id);
+        return Term(wordChars_ + chars.first, chars.second - chars.first);
+    }
+
+    /**
+     * @brief The id of a word, size() if not contained
+     */
+    uint32_t find(const Term &word) const;
+
+    /**
+     * @brief The records of a key
+     */
+    template<typename Record>
+    std::pair<const Record*,const Record*> records(uint64_t key) const {
+        const uint64_t *it = std::lower_bound(keys_, keys_ + keyCount_, key);
+        if ( it == keys_ + keyCount_ || *it != key )
+            return std::pair<const Record*,const Record*>(nullptr, nullptr);
+        const Record *records = reinterpret_cast<const Record*>(records_);
+        const std::pair<uint32_t,uint32_t> entries = range(keyOffsets_, keyCount_, it - keys_);
+        return std::make_pair(records + entries.first, records + entries.second);
+    }
+
+    /**
+     * @brief The bytes of the mapped file
+     */
+    size_t bytes() const;
+
+private:
+
+    static inline std::pair<uint32_t,uint32_t> range(const uint32_t *offsets, uint32_t count, size_t i) {
+        // Files are not checked on load, the range of a corrupted entry is empty
+        const uint32_t first = offsets[i], last = offsets[i+1];
+        return ( first <= last && last <= offsets[count] ) ? std::make_pair(first, last)
+                                                           : std::make_pair(0u, 0u);
+    }
+
+    static bool write(const QString &path, uint64_t tag, uint32_t parameter, const std::vector<Term> &words,
+                      const std::vector<uint64_t> &keys, const std::vector<uint32_t> &keyOffsets,
+                      const void *records, uint32_t recordSize);
+
+    uint32_t wordCount_;
+    const uint32_t *wordOffsets_; // Begin of a word in the chars, size+1
+    const ushort *wordChars_;
+    uint32_t keyCount_;
+    const uint64_t *keys_;
+    const uint32_t *keyOffsets_; // Begin of the records of a key, keyCount+1
+    const uint8_t *records_;
+
+    // Owns the mapping, shared by the copies of a table
+    std::shared_ptr<QFile> memory_;
+};
+
+
+
+/** ***************************************************************************/
+template<typename Record>
+bool WordTable::save(const QString &path, uint64_t tag, uint32_t parameter, const std::vector<Term> &words,
+                     const std::vector<std::pair<uint64_t,Record>> &entries) {
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> keyOffsets;
+    std::vector<Record> records;
+    records.reserve(entries.size());
+    for ( const std::pair<uint64_t,Record> &entry : entries ) {
+        if ( keys.empty() || keys.back() != entry.first ) {
+            keys.push_back(entry.first);
+            keyOffsets.push_back(static_cast<uint32_t>(records.size()));
+        }
+        records.push_back(entry.second);
+    }
+    keyOffsets.push_back(static_cast<uint32_t>(records.size()));
+    return write(path, tag, parameter, words, keys, keyOffsets, records.data(), sizeof(Record));
+}
+
+}
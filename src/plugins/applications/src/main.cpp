@@ -35,10 +35,8 @@
 #include <memory>
 #include <vector>
 #include "configwidget.h"
+#include "indexservice.h"
 #include "main.h"
-#include "offlineindex.h"
-#include "query.h"
-#include "queryhandler.h"
 #include "standardaction.h"
 #include "standardindexitem.h"
 #include "xdgiconlookup.h"
@@ -488,7 +486,6 @@ public:
     QFileSystemWatcher watcher;
 
     vector<shared_ptr<Core::StandardIndexItem>> index;
-    OfflineIndex offlineIndex;
 
     QFutureWatcher<vector<shared_ptr<Core::StandardIndexItem>>> futureWatcher;
     bool rerun = false;
@@ -530,10 +527,9 @@ void Applications::ApplicationsPrivate::finishIndexing() {
     // Get the thread results
     index = futureWatcher.future().result();
 
-    // Rebuild the offline index
-    offlineIndex.clear();
-    for (const auto &item : index)
-        offlineIndex.add(item);
+    // Replace the items in the shared index
+    IndexService::instance->setItems(q->Core::Extension::id,
+                                     vector<shared_ptr<Core::Indexable>>(index.begin(), index.end()));
 
     // Finally update the watches (maybe folders changed)
     if (!watcher.directories().isEmpty())
@@ -548,6 +544,7 @@ void Applications::ApplicationsPrivate::finishIndexing() {
 
     // Notification
     qDebug() << qPrintable(QString("Indexed %1 applications.").arg(index.size()));
+    qDebug() << qPrintable(IndexService::instance->statsReport(q->Core::Extension::id));
     emit q->statusInfo(QString("%1 applications indexed.").arg(index.size()));
 
     if ( rerun ) {
@@ -564,7 +561,6 @@ void Applications::ApplicationsPrivate::finishIndexing() {
 /** ***************************************************************************/
 Applications::Extension::Extension()
     : Core::Extension("org.albert.extension.applications"),
-      Core::QueryHandler(Core::Extension::id),
       d(new ApplicationsPrivate(this)) {
 
     qunsetenv("DESKTOP_AUTOSTART_ID");
@@ -572,7 +568,8 @@ Applications::Extension::Extension()
     // Load settings
     QSettings s(qApp->applicationName());
     s.beginGroup(Core::Extension::id);
-    d->offlineIndex.setFuzzy(s.value(CFG_FUZZY, DEF_FUZZY).toBool());
+    IndexService::instance->setFuzzy(Core::Extension::id, s.value(CFG_FUZZY, DEF_FUZZY).toBool());
+    IndexService::instance->setSubwords(Core::Extension::id); // Initials and camelCase parts, e.g. "vsc" or "lo"
     d->ignoreShowInKeys = s.value(CFG_IGNORESHOWINKEYS, DEF_IGNORESHOWINKEYS).toBool();
 
     // If the filesystem changed, trigger the scan
@@ -588,6 +585,9 @@ Applications::Extension::Extension()
 /** ***************************************************************************/
 Applications::Extension::~Extension() {
     d->futureWatcher.waitForFinished();
+
+    // The items are about to be unloaded with this library
+    IndexService::instance->removeNamespace(Core::Extension::id);
 }
 
 
@@ -598,7 +598,7 @@ QWidget *Applications::Extension::widget(QWidget *parent) {
         d->widget = new ConfigWidget(parent);
 
         // Fuzzy
-        d->widget->ui.checkBox_fuzzy->setChecked(d->offlineIndex.fuzzy());
+        d->widget->ui.checkBox_fuzzy->setChecked(fuzzy());
         connect(d->widget->ui.checkBox_fuzzy, &QCheckBox::toggled,
                  this, &Extension::setFuzzy);
 
@@ -611,37 +611,24 @@ QWidget *Applications::Extension::widget(QWidget *parent) {
             d->startIndexing();
         });
 
-        // Status bar
+        // Status bar, the tooltip reports the items and the index shared by them
         ( d->futureWatcher.isRunning() )
             ? d->widget->ui.label_statusbar->setText("Indexing applications ...")
             : d->widget->ui.label_statusbar->setText(QString("%1 applications indexed.").arg(d->index.size()));
+        d->widget->ui.label_statusbar->setToolTip(IndexService::instance->statsReport(Core::Extension::id));
         connect(this, &Extension::statusInfo, d->widget->ui.label_statusbar, &QLabel::setText);
+        connect(this, &Extension::statusInfo, d->widget->ui.label_statusbar, [this](){
+            d->widget->ui.label_statusbar->setToolTip(IndexService::instance->statsReport(Core::Extension::id));
+        });
     }
     return d->widget;
 }
 
 
 
-/** ***************************************************************************/
-void Applications::Extension::handleQuery(Core::Query * query) {
-
-    // Search for matches
-    const vector<shared_ptr<Core::Indexable>> &indexables = d->offlineIndex.search(query->searchTerm().toLower());
-
-    // Add results to query
-    vector<pair<shared_ptr<Core::Item>,short>> results;
-    for (const shared_ptr<Core::Indexable> &item : indexables)
-        // TODO `Search` has to determine the relevance. Set to 0 for now
-        results.emplace_back(std::static_pointer_cast<Core::StandardIndexItem>(item), 1);
-
-    query->addMatches(results.begin(), results.end());
-}
-
-
-
 /** ***************************************************************************/
 bool Applications::Extension::fuzzy() {
-    return d->offlineIndex.fuzzy();
+    return IndexService::instance->fuzzy(Core::Extension::id);
 }
 
 
@@ -649,7 +636,7 @@ bool Applications::Extension::fuzzy() {
 /** ***************************************************************************/
 void Applications::Extension::setFuzzy(bool b) {
     QSettings(qApp->applicationName()).setValue(QString("%1/%2").arg(Core::Extension::id, CFG_FUZZY), b);
-    d->offlineIndex.setFuzzy(b);
+    IndexService::instance->setFuzzy(Core::Extension::id, b);
 }
 
 
@@ -18,7 +18,6 @@
 #include <QObject>
 #include <memory>
 #include "extension.h"
-#include "queryhandler.h"
 
 namespace Applications {
 
@@ -27,8 +26,7 @@ class ConfigWidget;
 
 class Extension final :
         public QObject,
-        public Core::Extension,
-        public Core::QueryHandler
+        public Core::Extension
 {
     Q_OBJECT
     Q_PLUGIN_METADATA(IID ALBERT_EXTENSION_IID FILE "metadata.json")
@@ -44,7 +42,6 @@ public:
 
     QString name() const override { return "Applications"; }
     QWidget *widget(QWidget *parent = nullptr) override;
-    void handleQuery(Core::Query * query) override;
 
     /*
      * Extension specific members
@@ -41,9 +41,7 @@
 #include "configwidget.h"
 #include "main.h"
 #include "indexable.h"
-#include "offlineindex.h"
-#include "query.h"
-#include "queryhandler.h"
+#include "indexservice.h"
 #include "standardaction.h"
 #include "standardindexitem.h"
 #include "xdgiconlookup.h"
@@ -156,7 +154,6 @@ public:
     QString bookmarksFile;
 
     vector<shared_ptr<Core::StandardIndexItem>> index;
-    Core::OfflineIndex offlineIndex;
     QFutureWatcher<vector<shared_ptr<Core::StandardIndexItem>>> futureWatcher;
 
     void finishIndexing();
@@ -194,10 +191,9 @@ void ChromeBookmarks::ChromeBookmarksPrivate::finishIndexing() {
     // Get the thread results
     index = futureWatcher.future().result();
 
-    // Rebuild the offline index
-    offlineIndex.clear();
-    for (const auto &item : index)
-        offlineIndex.add(item);
+    // Replace the items in the shared index
+    IndexService::instance->setItems(q->Core::Extension::id,
+                                     vector<shared_ptr<Core::Indexable>>(index.begin(), index.end()));
 
     /*
      * Finally update the watches (maybe folders changed)
@@ -212,6 +208,7 @@ void ChromeBookmarks::ChromeBookmarksPrivate::finishIndexing() {
 
     // Notification
     qDebug() << qPrintable(QString("Indexed %1 Chrome bookmarks.").arg(index.size()));
+    qDebug() << qPrintable(IndexService::instance->statsReport(q->Core::Extension::id));
     emit q->statusInfo(QString("%1 bookmarks indexed.").arg(index.size()));
 }
 
@@ -223,13 +220,13 @@ void ChromeBookmarks::ChromeBookmarksPrivate::finishIndexing() {
 /** ***************************************************************************/
 ChromeBookmarks::Extension::Extension()
     : Core::Extension("org.albert.extension.chromebookmarks"),
-      Core::QueryHandler(Core::Extension::id),
       d(new ChromeBookmarksPrivate(this)) {
 
     // Load settings
     QSettings s(qApp->applicationName());
     s.beginGroup(Core::Extension::id);
-    d->offlineIndex.setFuzzy(s.value(CFG_FUZZY, DEF_FUZZY).toBool());
+    IndexService::instance->setFuzzy(Core::Extension::id, s.value(CFG_FUZZY, DEF_FUZZY).toBool());
+    IndexService::instance->setSubwords(Core::Extension::id); // Initials and camelCase parts, e.g. "vsc" or "lo"
 
     // Load and set a valid path
     QVariant v = s.value(CFG_PATH);
@@ -261,7 +258,8 @@ ChromeBookmarks::Extension::Extension()
 
 /** ***************************************************************************/
 ChromeBookmarks::Extension::~Extension() {
-
+    // The items are about to be unloaded with this library
+    IndexService::instance->removeNamespace(Core::Extension::id);
 }
 
 
@@ -280,33 +278,21 @@ QWidget *ChromeBookmarks::Extension::widget(QWidget *parent) {
         d->widget->ui.checkBox_fuzzy->setChecked(fuzzy());
         connect(d->widget->ui.checkBox_fuzzy, &QCheckBox::toggled, this, &Extension::setFuzzy);
 
-        // Status bar
+        // Status bar, the tooltip reports the items and the index shared by them
         ( d->futureWatcher.isRunning() )
             ? d->widget->ui.label_statusbar->setText("Indexing bookmarks ...")
             : d->widget->ui.label_statusbar->setText(QString("%1 bookmarks indexed.").arg(d->index.size()));
+        d->widget->ui.label_statusbar->setToolTip(IndexService::instance->statsReport(Core::Extension::id));
         connect(this, &Extension::statusInfo, d->widget->ui.label_statusbar, &QLabel::setText);
+        connect(this, &Extension::statusInfo, d->widget->ui.label_statusbar, [this](){
+            d->widget->ui.label_statusbar->setToolTip(IndexService::instance->statsReport(Core::Extension::id));
+        });
     }
     return d->widget;
 }
 
 
 
-/** ***************************************************************************/
-void ChromeBookmarks::Extension::handleQuery(Core::Query * query) {
-
-    // Search for matches
-    const vector<shared_ptr<Core::Indexable>> &indexables = d->offlineIndex.search(query->searchTerm().toLower());
-
-    // Add results to query
-    vector<pair<shared_ptr<Core::Item>,short>> results;
-    for (const shared_ptr<Core::Indexable> &item : indexables)
-        results.emplace_back(std::static_pointer_cast<Core::StandardIndexItem>(item), 0);
-
-    query->addMatches(results.begin(), results.end());
-}
-
-
-
 /** ***************************************************************************/
 const QString &ChromeBookmarks::Extension::path() {
     return d->bookmarksFile;
@@ -345,7 +331,7 @@ void ChromeBookmarks::Extension::restorePath() {
 
 /** ***************************************************************************/
 bool ChromeBookmarks::Extension::fuzzy() {
-    return d->offlineIndex.fuzzy();
+    return IndexService::instance->fuzzy(Core::Extension::id);
 }
 
 
@@ -360,6 +346,6 @@ void ChromeBookmarks::Extension::updateIndex() {
 /** ***************************************************************************/
 void ChromeBookmarks::Extension::setFuzzy(bool b) {
     QSettings(qApp->applicationName()).setValue(QString("%1/%2").arg(Core::Extension::id, CFG_FUZZY), b);
-    d->offlineIndex.setFuzzy(b);
+    IndexService::instance->setFuzzy(Core::Extension::id, b);
 }
 
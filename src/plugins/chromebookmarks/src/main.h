@@ -18,7 +18,6 @@
 #include <QObject>
 #include <memory>
 #include "extension.h"
-#include "queryhandler.h"
 
 
 namespace ChromeBookmarks {
@@ -28,8 +27,7 @@ class ConfigWidget;
 
 class Extension final :
         public QObject,
-        public Core::Extension,
-        public Core::QueryHandler
+        public Core::Extension
 {
     Q_OBJECT
     Q_PLUGIN_METADATA(IID ALBERT_EXTENSION_IID FILE "metadata.json")
@@ -45,7 +43,6 @@ public:
 
     QString name() const override { return "Chrome bookmarks"; }
     QWidget *widget(QWidget *parent = nullptr) override;
-    void handleQuery(Core::Query * query) override;
 
     /*
      * Extension specific members
@@ -83,6 +83,9 @@ Files::ConfigWidget::ConfigWidget(Extension *_extension, QWidget *_parent)
     ui.checkBox_fuzzy->setChecked(extension->fuzzy());
     connect(ui.checkBox_fuzzy, &QCheckBox::toggled, extension, &Extension::setFuzzy);
 
+    ui.checkBox_infix->setChecked(extension->infix());
+    connect(ui.checkBox_infix, &QCheckBox::toggled, extension, &Extension::setInfix);
+
     ui.spinBox_interval->setValue(static_cast<int>(extension->scanInterval()));
     connect(ui.spinBox_interval, static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged),
             extension, &Extension::setScanInterval);
@@ -234,8 +237,12 @@ Files::ConfigWidget::ConfigWidget(Extension *_extension, QWidget *_parent)
         }
     });
 
-    // Status bar
+    // Status bar, the tooltip reports the shape of the offline index
+    ui.label_statusbar->setToolTip(extension->indexStats());
     connect(extension, &Extension::statusInfo, ui.label_statusbar, &QLabel::setText);
+    connect(extension, &Extension::statusInfo, ui.label_statusbar, [this](){
+        ui.label_statusbar->setToolTip(extension->indexStats());
+    });
 }
 
 
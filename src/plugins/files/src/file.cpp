@@ -103,3 +103,16 @@ vector<Core::Indexable::WeightedKeyword> Files::File::indexKeywords() const {
     // TODO ADD PATH
     return res;
 }
+
+
+
+/** ***************************************************************************/
+vector<Core::Indexable::Facet> Files::File::indexFacets() const {
+    // "in" is the directory, it covers the files below as well
+    QFileInfo fileInfo(path_);
+    std::vector<Indexable::Facet> res;
+    res.emplace_back("ext", fileInfo.suffix(), Indexable::Facet::Match::Exact);
+    res.emplace_back("mime", mimetype_.name());
+    res.emplace_back("in", fileInfo.absolutePath(), Indexable::Facet::Match::Path);
+    return res;
+}
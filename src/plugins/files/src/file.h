@@ -42,6 +42,7 @@ public:
     QString completionString() const override;
     QString iconPath() const override;
     std::vector<Core::Indexable::WeightedKeyword> indexKeywords() const override;
+    std::vector<Core::Indexable::Facet> indexFacets() const override;
     std::vector<std::shared_ptr<Core::Action>> actions() override;
 
     /*
@@ -29,6 +29,7 @@
 #include <QTimer>
 #include <memory>
 #include <functional>
+#include <map>
 #include <vector>
 #include <set>
 #include "configwidget.h"
@@ -52,6 +53,8 @@ const char* CFG_FILTERS         = "filters";
 const QStringList DEF_FILTERS   = { "inode/directory", "application/*" };
 const char* CFG_FUZZY           = "fuzzy";
 const bool  DEF_FUZZY           = false;
+const char* CFG_INFIX           = "infix";
+const bool  DEF_INFIX           = false;
 const char* CFG_INDEX_HIDDEN    = "indexhidden";
 const bool  DEF_INDEX_HIDDEN    = false;
 const char* CFG_FOLLOW_SYMLINKS = "follow_symlinks";
@@ -59,6 +62,7 @@ const bool  DEF_FOLLOW_SYMLINKS = false;
 const char* CFG_SCAN_INTERVAL   = "scan_interval";
 const uint  DEF_SCAN_INTERVAL   = 60;
 const char* IGNOREFILE          = ".albertignore";
+const uint  MAX_RESULTS         = 100;
 
 struct IndexSettings {
     QStringList rootDirs;
@@ -97,6 +101,7 @@ public:
 
     vector<shared_ptr<File>> index;
     Core::OfflineIndex offlineIndex;
+    Core::OfflineIndex::Session session;
     QFutureWatcher<vector<shared_ptr<File>>> futureWatcher;
     QTimer indexIntervalTimer;
     bool abort;
@@ -107,6 +112,7 @@ public:
     void finishIndexing();
     void startIndexing();
     vector<shared_ptr<File>> indexFiles(const IndexSettings &indexSettings) const;
+    vector<shared_ptr<File>> updateOfflineIndex(const IndexSettings &indexSettings, vector<shared_ptr<File>> oldIndex);
 };
 
 
@@ -133,7 +139,7 @@ void Files::FilesPrivate::startIndexing() {
 
     // Run the indexer thread
     qDebug() << "Start indexing files.";
-    futureWatcher.setFuture(QtConcurrent::run(this, &FilesPrivate::indexFiles, indexSettings));
+    futureWatcher.setFuture(QtConcurrent::run(this, &FilesPrivate::updateOfflineIndex, indexSettings, index));
 
     // Notification
     emit q->statusInfo("Indexing files ...");
@@ -144,19 +150,15 @@ void Files::FilesPrivate::startIndexing() {
 /** ***************************************************************************/
 void Files::FilesPrivate::finishIndexing() {
 
-    // In case of abortion the returned data is invalid
-    if ( !abort ) {
-        // Get the thread results
-        index = futureWatcher.future().result();
-
-        // Rebuild the offline index
-        offlineIndex.clear();
-        for (const auto &item : index)
-            offlineIndex.add(item);
+    // Get the thread results, the offline index has already been updated
+    index = futureWatcher.future().result();
 
-        // Notification
+    // Notification
+    if ( !abort ) {
+        Core::OfflineIndex::Stats stats = offlineIndex.stats();
         qDebug() << qPrintable(QString("Indexed %1 files.").arg(index.size()));
-        emit q->statusInfo(QString("%1 files indexed.").arg(index.size()));
+        qDebug() << qPrintable(stats.toString());
+        emit q->statusInfo(QString("%1 files indexed, %2 KiB.").arg(index.size()).arg(stats.bytes() / 1024));
     }
 
     abort = false;
@@ -169,12 +171,69 @@ void Files::FilesPrivate::finishIndexing() {
 
 
 
+/** ***************************************************************************/
+vector<shared_ptr<Files::File>>
+Files::FilesPrivate::updateOfflineIndex(const IndexSettings &indexSettings, vector<shared_ptr<File>> oldIndex) {
+
+    vector<shared_ptr<File>> newIndex = indexFiles(indexSettings);
+
+    // In case of abortion the returned data is invalid, keep the old index
+    if ( abort )
+        return oldIndex;
+
+    if ( oldIndex.empty() ) {
+        // Nothing to update, build the offline index in bulk
+        offlineIndex.build(vector<shared_ptr<Core::Indexable>>(newIndex.begin(), newIndex.end()));
+    } else {
+        // Update the offline index by the changes only
+        std::map<QString,shared_ptr<File>> oldFiles;
+        for (const shared_ptr<File> &file : oldIndex)
+            if ( !oldFiles.emplace(file->path(), file).second )
+                offlineIndex.remove(file); // A duplicate cached by an older version
+        for (shared_ptr<File> &file : newIndex) {
+            std::map<QString,shared_ptr<File>>::iterator it = oldFiles.find(file->path());
+            if ( it != oldFiles.end() && it->second->mimetype() == file->mimetype() ) {
+                // Unchanged, keep the indexed item
+                file = it->second;
+                oldFiles.erase(it);
+            } else
+                offlineIndex.add(file);
+        }
+        for (const pair<const QString,shared_ptr<File>> &oldFile : oldFiles)
+            offlineIndex.remove(oldFile.second);
+    }
+
+    // Searches running meanwhile used the old index, publish the new one
+    offlineIndex.commit();
+
+    // Serialize data. The offline index refers to the files by their position.
+    QDir cacheDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+    QString indexPath = cacheDir.filePath(QString("%1.index").arg(q->Core::Extension::id));
+    Core::OfflineIndex::removeFiles(indexPath);
+    QFile file(cacheDir.filePath(QString("%1.txt").arg(q->Core::Extension::id)));
+    if ( file.open(QIODevice::WriteOnly|QIODevice::Text) ) {
+        qDebug() << qPrintable(QString("Serializing files to '%1'").arg(file.fileName()));
+        QTextStream out(&file);
+        for (const shared_ptr<File> &item : newIndex)
+            out << item->path() << endl << item->mimetype().name() << endl;
+        file.close();
+        if ( !offlineIndex.save(indexPath, vector<shared_ptr<Core::Indexable>>(newIndex.begin(), newIndex.end())) )
+            qWarning() << qPrintable(QString("Could not write to file '%1'").arg(indexPath));
+    } else
+        qWarning() << qPrintable(QString("Could not write to file '%1': %2").arg(file.fileName(), file.errorString()));
+
+    return newIndex;
+}
+
+
+
 /** ***************************************************************************/
 vector<shared_ptr<Files::File>>
 Files::FilesPrivate::indexFiles(const IndexSettings &indexSettings) const {
 
     // Get a new index
     std::vector<shared_ptr<File>> newIndex;
+    std::set<QString> indexedFiles;
     std::set<QString> indexedDirs;
     QMimeDatabase mimeDatabase;
     std::vector<QRegExp> mimeFilters;
@@ -196,9 +255,12 @@ Files::FilesPrivate::indexFiles(const IndexSettings &indexSettings) const {
         const QMimeType mimetype = mimeDatabase.mimeTypeForFile(canonicalPath);
         const QString mimeName = mimetype.name();
 
-        // If the file matches the index options, index it
+        // If the file matches the index options, index it. Followed symlinks
+        // and nested root dirs can reach a file twice, the rescan diff and
+        // the offline index expect every path once.
         if ( std::any_of(mimeFilters.begin(), mimeFilters.end(),
-                         [&](const QRegExp &re){ return re.exactMatch(mimeName); }) )
+                         [&](const QRegExp &re){ return re.exactMatch(mimeName); })
+             && indexedFiles.insert(canonicalPath).second )
             newIndex.push_back(std::make_shared<File>(canonicalPath, mimetype));
 
         if (fileInfo.isDir()) {
@@ -284,17 +346,6 @@ Files::FilesPrivate::indexFiles(const IndexSettings &indexSettings) const {
             return vector<shared_ptr<Files::File>>();
     }
 
-    // Serialize data
-    QFile file(QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).
-                   filePath(QString("%1.txt").arg(q->Core::Extension::id)));
-    if ( file.open(QIODevice::WriteOnly|QIODevice::Text) ) {
-        qDebug() << qPrintable(QString("Serializing files to '%1'").arg(file.fileName()));
-        QTextStream out(&file);
-        for (const shared_ptr<File> &item : newIndex)
-            out << item->path() << endl << item->mimetype().name() << endl;
-    } else
-        qWarning() << qPrintable(QString("Could not write to file '%1': %2").arg(file.fileName(), file.errorString()));
-
     return newIndex;
 }
 
@@ -315,6 +366,7 @@ Files::Extension::Extension()
     d->indexSettings.indexHidden = s.value(CFG_INDEX_HIDDEN, DEF_INDEX_HIDDEN).toBool();
     d->indexSettings.followSymlinks = s.value(CFG_FOLLOW_SYMLINKS, DEF_FOLLOW_SYMLINKS).toBool();
     d->offlineIndex.setFuzzy(s.value(CFG_FUZZY, DEF_FUZZY).toBool());
+    d->offlineIndex.setInfix(s.value(CFG_INFIX, DEF_INFIX).toBool()); // Words inside of file names, e.g. "book" in "notebook.pdf"
     d->indexIntervalTimer.setInterval(s.value(CFG_SCAN_INTERVAL, DEF_SCAN_INTERVAL).toInt()*60000); // Will be started in the initial index update
     d->indexSettings.rootDirs = s.value(CFG_PATHS).toStringList();
     if (d->indexSettings.rootDirs.isEmpty())
@@ -333,9 +385,14 @@ Files::Extension::Extension()
                 d->index.emplace_back(new File(in.readLine(), mimedatabase.mimeTypeForName(in.readLine())));
             file.close();
 
-            // Build the offline index
-            for (const auto &item : d->index)
-                d->offlineIndex.add(item);
+            // Map the offline index saved along, build it if not usable
+            QString indexPath = QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).
+                    filePath(QString("%1.index").arg(Core::Extension::id));
+            if ( !d->offlineIndex.load(indexPath, vector<shared_ptr<Core::Indexable>>(d->index.begin(), d->index.end())) ) {
+                qDebug() << qPrintable(QString("Building the offline index, '%1' is not usable.").arg(indexPath));
+                d->offlineIndex.build(vector<shared_ptr<Core::Indexable>>(d->index.begin(), d->index.end()));
+            }
+            d->offlineIndex.commit();
         } else
             qWarning() << qPrintable(QString("Could not read from file '%1': %2").arg(file.fileName(), file.errorString()));
     }
@@ -418,21 +475,26 @@ void Files::Extension::handleQuery(Core::Query * query) {
             query->addMatch(standardItem);
         }
 
-        // Search for matches
-        const vector<shared_ptr<Core::Indexable>> &indexables = d->offlineIndex.search(query->searchTerm().toLower());
-
-        // Add results to query
-        vector<pair<shared_ptr<Core::Item>,short>> results;
-        for (const shared_ptr<Core::Indexable> &item : indexables)
-            // TODO `Search` has to determine the relevance. Set to 0 for now
-            results.emplace_back(std::static_pointer_cast<File>(item), -1);
+        // Facet operators like "ext:pdf" or "in:~/work" filter inside the index.
+        // Directories are indexed absolute, substitute the tilde.
+        static const QRegularExpression tilde("(^|\\s)(-?in:\"?)~", QRegularExpression::CaseInsensitiveOption);
+        QString searchTerm = query->searchTerm();
+        searchTerm.replace(tilde, QString("\\1\\2%1").arg(QDir::homePath()));
 
-        query->addMatches(results.begin(), results.end());
+        // Search for the best matches, short queries match most of the index
+        query->addMatches<File>(d->offlineIndex.matches(searchTerm, MAX_RESULTS, d->session));
     }
 }
 
 
 
+/** ***************************************************************************/
+QString Files::Extension::indexStats() const {
+    return d->offlineIndex.stats().toString();
+}
+
+
+
 /** ***************************************************************************/
 const QStringList &Files::Extension::paths() const {
     return d->indexSettings.rootDirs;
@@ -551,6 +613,21 @@ void Files::Extension::setFuzzy(bool b) {
 
 
 
+/** ***************************************************************************/
+bool Files::Extension::infix() const {
+    return d->offlineIndex.infix();
+}
+
+
+
+/** ***************************************************************************/
+void Files::Extension::setInfix(bool b) {
+    QSettings(qApp->applicationName()).setValue(QString("%1/%2").arg(Core::Extension::id, CFG_INFIX), b);
+    d->offlineIndex.setInfix(b);
+}
+
+
+
 /** ***************************************************************************/
 const QStringList &Files::Extension::filters() const {
     return d->indexSettings.filters;
@@ -67,10 +67,14 @@ public:
     bool fuzzy() const;
     void setFuzzy(bool b = true);
 
+    bool infix() const;
+    void setInfix(bool b = true);
+
     const QStringList &filters() const;
     void setFilters(const QStringList &);
 
     void updateIndex();
+    QString indexStats() const;
 
 private:
 
@@ -42,11 +42,10 @@
 #include "main.h"
 #include "configwidget.h"
 #include "extension.h"
+#include "indexservice.h"
 #include "item.h"
-#include "offlineindex.h"
 #include "standardaction.h"
 #include "standardindexitem.h"
-#include "query.h"
 #include "xdgiconlookup.h"
 using std::pair;
 using std::shared_ptr;
@@ -83,7 +82,6 @@ public:
     QFileSystemWatcher databaseWatcher;
 
     vector<shared_ptr<Core::StandardIndexItem>> index;
-    Core::OfflineIndex offlineIndex;
 
     QTimer updateDelayTimer;
     void startIndexing();
@@ -120,13 +118,13 @@ void FirefoxBookmarks::FirefoxBookmarksPrivate::finishIndexing() {
     // Get the thread results
     index = futureWatcher.future().result();
 
-    // Rebuild the offline index
-    offlineIndex.clear();
-    for (const auto &item : index)
-        offlineIndex.add(item);
+    // Replace the items in the shared index
+    IndexService::instance->setItems(q->Core::Extension::id,
+                                     vector<shared_ptr<Core::Indexable>>(index.begin(), index.end()));
 
     // Notification
     qDebug() <<  qPrintable(QString("Indexed %1 Firefox bookmarks.").arg(index.size()));
+    qDebug() << qPrintable(IndexService::instance->statsReport(q->Core::Extension::id));
     emit q->statusInfo(QString("%1 bookmarks indexed.").arg(index.size()));
 }
 
@@ -260,7 +258,9 @@ FirefoxBookmarks::Extension::Extension()
     QSettings s(qApp->applicationName());
     s.beginGroup(Core::Extension::id);
     d->currentProfileId = s.value(CFG_PROFILE).toString();
-    d->offlineIndex.setFuzzy(s.value(CFG_FUZZY, DEF_FUZZY).toBool());
+    IndexService::instance->setFuzzy(Core::Extension::id, s.value(CFG_FUZZY, DEF_FUZZY).toBool());
+    IndexService::instance->setSubwords(Core::Extension::id); // Initials and camelCase parts, e.g. "vsc" or "lo"
+    IndexService::instance->setInfix(Core::Extension::id); // Words inside of keywords, e.g. "book" in "notebook"
     d->openWithFirefox = s.value(CFG_USE_FIREFOX, DEF_USE_FIREFOX).toBool();
 
     // If the id does not exist find a proper default
@@ -316,7 +316,8 @@ FirefoxBookmarks::Extension::Extension()
 
 /** ***************************************************************************/
 FirefoxBookmarks::Extension::~Extension() {
-
+    // The items are about to be unloaded with this library
+    IndexService::instance->removeNamespace(Core::Extension::id);
 }
 
 
@@ -355,7 +356,7 @@ QWidget *FirefoxBookmarks::Extension::widget(QWidget *parent) {
 
         // Fuzzy
         QCheckBox *ckb = d->widget->ui.fuzzy;
-        ckb->setChecked(d->offlineIndex.fuzzy());
+        ckb->setChecked(IndexService::instance->fuzzy(Core::Extension::id));
         connect(ckb, &QCheckBox::clicked, this, &Extension::changeFuzzyness);
 
         // Which app to use
@@ -363,11 +364,15 @@ QWidget *FirefoxBookmarks::Extension::widget(QWidget *parent) {
         ckb->setChecked(d->openWithFirefox);
         connect(ckb, &QCheckBox::clicked, this, &Extension::changeOpenPolicy);
 
-        // Status bar
+        // Status bar, the tooltip reports the items and the index shared by them
         ( d->futureWatcher.isRunning() )
             ? d->widget->ui.label_statusbar->setText("Indexing bookmarks ...")
             : d->widget->ui.label_statusbar->setText(QString("%1 bookmarks indexed.").arg(d->index.size()));
+        d->widget->ui.label_statusbar->setToolTip(IndexService::instance->statsReport(Core::Extension::id));
         connect(this, &Extension::statusInfo, d->widget->ui.label_statusbar, &QLabel::setText);
+        connect(this, &Extension::statusInfo, d->widget->ui.label_statusbar, [this](){
+            d->widget->ui.label_statusbar->setToolTip(IndexService::instance->statsReport(Core::Extension::id));
+        });
 
     }
     return d->widget;
@@ -375,22 +380,6 @@ QWidget *FirefoxBookmarks::Extension::widget(QWidget *parent) {
 
 
 
-/** ***************************************************************************/
-void FirefoxBookmarks::Extension::handleQuery(Core::Query *query) {
-
-    // Search for matches
-    const vector<shared_ptr<Core::Indexable>> &indexables = d->offlineIndex.search(query->searchTerm().toLower());
-
-    // Add results to query.
-    vector<pair<shared_ptr<Core::Item>,short>> results;
-    for (const shared_ptr<Core::Indexable> &item : indexables)
-        results.emplace_back(std::static_pointer_cast<Core::StandardIndexItem>(item), 0);
-
-    query->addMatches(results.begin(), results.end());
-}
-
-
-
 /** ***************************************************************************/
 void FirefoxBookmarks::Extension::setProfile(const QString& profile) {
 
@@ -439,7 +428,7 @@ void FirefoxBookmarks::Extension::setProfile(const QString& profile) {
 
 /** ***************************************************************************/
 void FirefoxBookmarks::Extension::changeFuzzyness(bool fuzzy) {
-    d->offlineIndex.setFuzzy(fuzzy);
+    IndexService::instance->setFuzzy(Core::Extension::id, fuzzy);
     QSettings(qApp->applicationName()).setValue(QString("%1/%2").arg(Core::Extension::id, CFG_FUZZY), fuzzy);
 }
 
@@ -17,7 +17,6 @@
 #pragma once
 #include <QObject>
 #include "extension.h"
-#include "queryhandler.h"
 #include <memory>
 #include <vector>
 namespace Core {
@@ -31,8 +30,7 @@ class ConfigWidget;
 
 class Extension final :
         public QObject,
-        public Core::Extension,
-        public Core::QueryHandler
+        public Core::Extension
 {
     Q_OBJECT
     Q_PLUGIN_METADATA(IID ALBERT_EXTENSION_IID FILE "metadata.json")
@@ -48,7 +46,6 @@ public:
 
     QString name() const override { return "Firefox bookmarks"; }
     QWidget *widget(QWidget *parent = nullptr) override;
-    void handleQuery(Core::Query * query) override;
 
     /*
      * Extension specific members